@@ -0,0 +1,79 @@
+// Compares object hashing paths on inputs shaped like tree entries and small
+// blobs. Build with -DMYGIT_BUILD_BENCHMARKS=ON; run with
+// MYGIT_SHA1_IMPL=avx2 or =openssl to pin the batch kernel.
+//
+//   hash_bench [count] [min_size] [max_size]
+
+#include "headers/hash.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <openssl/sha.h>
+
+namespace {
+
+template <typename F>
+double time_ns_per_item(size_t items, int rounds, F&& body) {
+    double best = 1e300;
+    for (int r = 0; r < rounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / items);
+    }
+    return best;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    size_t min_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 40;
+    size_t max_size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 400;
+    if (count == 0 || max_size < min_size) {
+        std::fprintf(stderr, "usage: hash_bench [count] [min_size] [max_size]\n");
+        return 1;
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> size_dist(min_size, max_size);
+    std::vector<std::string> data(count);
+    size_t total_bytes = 0;
+    for (auto& s : data) {
+        s.resize(size_dist(rng));
+        for (auto& c : s) c = static_cast<char>(rng());
+        total_bytes += s.size();
+    }
+    std::vector<std::string_view> views(data.begin(), data.end());
+
+    std::vector<ObjectId> expected(count), single(count), batch(count);
+    double oneshot_ns = time_ns_per_item(count, 3, [&] {
+        for (size_t i = 0; i < count; ++i) {
+            SHA1(reinterpret_cast<const unsigned char*>(data[i].data()), data[i].size(), expected[i].bytes.data());
+        }
+    });
+    double single_ns = time_ns_per_item(count, 3, [&] {
+        for (size_t i = 0; i < count; ++i) single[i] = sha1_of(views[i]);
+    });
+    double batch_ns = time_ns_per_item(count, 3, [&] { sha1_batch(views.data(), count, batch.data()); });
+
+    for (size_t i = 0; i < count; ++i) {
+        if (single[i] != expected[i] || batch[i] != expected[i]) {
+            std::fprintf(stderr, "MISMATCH at input %zu (%zu bytes)\n", i, data[i].size());
+            return 1;
+        }
+    }
+
+    double avg = double(total_bytes) / count;
+    std::printf("%zu inputs, %zu-%zu bytes (avg %.0f), batch kernel: %s\n", count, min_size, max_size, avg,
+                sha1_batch_implementation());
+    std::printf("  SHA1() one-shot  %8.1f ns/item %8.1f MB/s\n", oneshot_ns, avg * 1e3 / oneshot_ns);
+    std::printf("  sha1_of          %8.1f ns/item %8.1f MB/s  (%.2fx)\n", single_ns, avg * 1e3 / single_ns, oneshot_ns / single_ns);
+    std::printf("  sha1_batch       %8.1f ns/item %8.1f MB/s  (%.2fx)\n", batch_ns, avg * 1e3 / batch_ns, oneshot_ns / batch_ns);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CHECKOUT_H
+#define CHECKOUT_H
+
+#include <string>
+#include <vector>
+
+class Index;
+
+// Brings the working tree from `old_index` to `new_index` and records the
+// stat data of every file found or written in `new_index`. Used by
+// read-tree -u, and so by checkout and fast-forward merges.
+//
+// The work is planned first: files that are no longer tracked or that now
+// have the skip-worktree bit (sparse checkout), files whose content or mode
+// differs from the new index, and the directories the new files need.
+// Deletions and directory creation run in path order on the calling thread
+// (parents before children); reading and inflating blobs and writing the
+// files is spread over checkout.workers threads (MYGIT_CHECKOUT_WORKERS
+// overrides it, 0 means one per core). Messages and errors are printed in
+// path order whatever the thread count.
+//
+// With `changed` (sorted paths, as from Index::from_tree), every other
+// entry of `new_index` that has stat data is taken to be the same as in
+// `old_index` and its file is left alone, so a switch between similar trees
+// only looks at the paths that differ. Local changes to those files are kept.
+//
+// Returns false if some paths could not be updated; each was reported on
+// stderr and keeps empty stat data in `new_index`, so status shows it as
+// modified.
+bool checkout_index(const Index& old_index, Index& new_index, const std::vector<std::string>* changed = nullptr);
+
+#endif
@@ -6,10 +6,13 @@
 #include <optional>
 
 int handle_init();
-int handle_add(const std::vector<std::string>& files_to_add);
+int handle_add(const std::vector<std::string>& args);
 int handle_rm(const std::vector<std::string>& files_to_remove, bool cached_mode);
 int handle_commit(const std::string& message);
 int handle_status();
+// diff [--name-status | --stat] [--cached [<commit>] | <commit> <commit>]:
+// index against working tree, tree against index, or tree against tree.
+int handle_diff(const std::vector<std::string>& args);
 int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name_opt);
 
 int handle_branch(const std::vector<std::string>& args);
@@ -24,7 +27,16 @@ int handle_merge(const std::string& branch_to_merge);
 int handle_ls_tree(const std::vector<std::string>& args);
 
 int handle_cat_file(const std::string& operation, const std::string& sha1_prefix);
+// cat-file --batch / --batch-check: reads one object name per line from
+// stdin and answers "<sha> <type> <size>" (followed by the raw content and a
+// newline with --batch), or "<name> missing" / "<name> ambiguous".
+int handle_cat_file_batch(bool with_content);
 int handle_hash_object(const std::string& filename, const std::string& type, bool write_mode);
 int handle_rev_parse(const std::vector<std::string>& args);
+int handle_pack_objects(const std::vector<std::string>& args);
+int handle_repack(const std::vector<std::string>& args);
+int handle_gc(const std::vector<std::string>& args);
+int handle_fsmonitor(const std::vector<std::string>& args);
+int handle_sparse_checkout(const std::vector<std::string>& args);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <optional>
+#include <cstdint>
+
+// Looks up "section.key" in .mygit/config. Section and key names are
+// case-insensitive and the last assignment wins, as in Git. The file is read
+// once per process.
+std::optional<std::string> get_config_value(const std::string& name);
+
+// Sets "section.key" in .mygit/config, replacing its last assignment or
+// adding it to the end of the section (which is created if missing).
+// Throws std::runtime_error if the file cannot be written.
+void set_config_value(const std::string& name, const std::string& value);
+
+// Parses a byte count with an optional k/m/g suffix (e.g. "64m").
+// Throws std::invalid_argument on malformed input.
+uint64_t parse_size_value(const std::string& value);
+
+// Parses a Git boolean (true/false, yes/no, on/off, 1/0; case-insensitive).
+// Throws std::invalid_argument on anything else.
+bool parse_bool_value(const std::string& value);
+
+#endif
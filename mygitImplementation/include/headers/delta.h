@@ -0,0 +1,28 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Git's delta format: varint source size, varint target size, then a stream
+// of copy (from source) and insert (literal) instructions.
+
+// Block index of a delta source, built once and reused for every target
+// it is tried against.
+struct DeltaIndex {
+    const std::string* source = nullptr;
+    std::vector<int32_t> buckets;   // hash -> first block, -1 when empty
+    std::vector<int32_t> chain;     // block -> next block with the same hash
+    uint32_t hash_mask = 0;
+};
+
+DeltaIndex create_delta_index(const std::string& source);
+
+// Returns false if no delta of at most max_delta_size bytes could be produced.
+bool create_delta(const DeltaIndex& index, const std::string& target, size_t max_delta_size, std::string& delta_out);
+
+std::string apply_delta(const std::string& base, const unsigned char* delta, size_t delta_size);
+
+#endif
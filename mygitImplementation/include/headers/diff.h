@@ -2,8 +2,12 @@
 #define DIFF_H
 
 #include "headers/objects.h"
+#include <functional>
 #include <string>
+#include <string_view>
 #include <map>
+#include <optional>
+#include <vector>
 
 enum class FileStatus {
     Unmodified,     // Matches HEAD and index
@@ -22,12 +26,52 @@ struct StatusEntry {
     FileStatus workdir_status = FileStatus::Unmodified; // Status Workdir vs Index
 };
 
-std::string get_workdir_sha(const std::string& path);
+// Blob name of the working tree file, or nullopt if it cannot be read.
+std::optional<ObjectId> get_workdir_sha(const std::string& path);
+// Same for many files at once: small files are read in groups and hashed
+// together with sha1_batch.
+std::vector<std::optional<ObjectId>> get_workdir_shas(const std::vector<std::string>& paths);
 
+// Every path that differs between HEAD, the index and the working tree,
+// untracked files included; unchanged paths are not listed.
 std::map<std::string, StatusEntry> get_repository_status();
 
-std::map<std::string, std::string> read_tree_contents(const std::string& tree_sha1);
+class Index;
 
-std::map<std::string, TreeEntry> read_tree_full(const std::string &tree_sha1);
+// Flattened {path: blob} contents of a tree.
+std::map<std::string, ObjectId> read_tree_contents(const ObjectId& tree_sha1);
+
+std::map<std::string, TreeEntry> read_tree_full(const ObjectId& tree_sha1);
+
+// One path that differs between the two sides of a diff: 'A'dded,
+// 'D'eleted, 'M'odified (content or executable bit), 'T' (changed between
+// file, symlink and submodule) or 'U'nmerged. On the side the path is
+// missing from, the mode is 0 and the object name null.
+struct DiffEntry {
+    char status = 'M';
+    std::string path;
+    uint32_t old_mode = 0;
+    uint32_t new_mode = 0;
+    ObjectId old_sha1;
+    ObjectId new_sha1;
+};
+using DiffCallback = std::function<void(const DiffEntry&)>;
+
+// Differences between two trees (a null id is the empty tree), in tree
+// order. The trees are read one at a time and walked in lockstep; subtrees
+// with the same object name on both sides are skipped unread, so comparing
+// two similar commits only reads the trees along the changed paths.
+void diff_trees(const ObjectId& old_tree, const ObjectId& new_tree, const DiffCallback& emit);
+// Differences from `tree` to the index, in the same way: directories whose
+// cached tree (or sparse directory entry) names the same tree are skipped.
+void diff_tree_to_index(const ObjectId& tree, const Index& index, const DiffCallback& emit);
+// Differences from the index to the working tree: tracked files that are
+// missing, or whose content or mode differs. Files are only hashed when
+// their stat data no longer matches; new_sha1 is that hash (null if the
+// file could not be read). Entries outside the sparse checkout are skipped.
+void diff_index_to_workdir(const Index& index, const DiffCallback& emit);
+
+// Lines added and deleted by a minimal line diff from `a` to `b`.
+void count_line_changes(std::string_view a, std::string_view b, size_t& added, size_t& deleted);
 
 #endif
\ No newline at end of file
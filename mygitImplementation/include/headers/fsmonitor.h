@@ -0,0 +1,46 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Filesystem monitor. `mygit fsmonitor start` runs a daemon (Linux only, on
+// inotify) that watches the working tree and journals every changed path
+// under an increasing sequence number. Clients connect to
+// .mygit/fsmonitor.sock and ask what changed since a token from an earlier
+// answer, so with core.fsmonitor set, status only has to look at the
+// reported paths. A token from another daemon run, or from before the
+// journal was trimmed or overflowed, gets a "rescan everything" answer.
+
+// What the daemon reported since a token.
+struct FsmonitorChanges {
+    std::string token;                // To ask with next time
+    bool complete = false;            // false: anything may have changed
+    std::vector<std::string> paths;   // Sorted; directories stand for everything below them
+    std::vector<std::string> parents; // Sorted directories ("" or "a/b/") holding a reported path
+
+    // True if `path`, or a directory above it, was reported.
+    bool path_changed(std::string_view path) const;
+    // True if entries may have been added to or removed from `dir` ("" for
+    // the top, else ending in '/').
+    bool listing_changed(std::string_view dir) const;
+};
+
+// core.fsmonitor (off by default).
+bool fsmonitor_configured();
+
+// Asks the running daemon for the changes since `token` (empty for none).
+// nullopt if no daemon answers.
+std::optional<FsmonitorChanges> query_fsmonitor(const std::string& token);
+
+// Runs the daemon for the repository in the current directory, detached
+// into the background or in the foreground. Returns the exit code.
+int run_fsmonitor_daemon(bool detach);
+// Asks a running daemon to exit; false if none was running.
+bool stop_fsmonitor_daemon();
+// Process ID of the running daemon, or -1.
+long fsmonitor_daemon_pid();
+
+#endif
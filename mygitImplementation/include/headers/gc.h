@@ -0,0 +1,33 @@
+#ifndef GC_H
+#define GC_H
+
+#include "headers/pack.h"
+
+#include <string>
+#include <vector>
+#include <ctime>
+
+// Every object reachable from refs/, HEAD, MERGE_HEAD and the index, each with
+// the path it was first seen at (empty for commits, tags and root trees).
+// Throws if any of them is missing or cannot be read.
+std::vector<PackInput> collect_reachable_objects();
+
+struct RepackResult {
+    std::string pack_checksum;      // Empty if there was nothing to pack
+    PackStats stats;
+    size_t loose_removed = 0;       // Loose copies now covered by the new pack
+    size_t packs_removed = 0;
+    size_t loosened = 0;            // Unreachable objects moved out of old packs
+};
+
+// Writes all reachable objects into one new pack, then drops the old packs and
+// the loose copies it makes redundant. Unreachable objects found in old packs
+// are written back as loose objects carrying the pack's mtime, so the prune
+// grace period still applies to them.
+RepackResult repack_objects(const std::vector<PackInput>& reachable, const PackOptions& options);
+
+// Removes unreachable loose objects (and stale temporary pack files) whose
+// mtime is not after `expire`.
+size_t prune_loose_objects(const std::vector<PackInput>& reachable, std::time_t expire);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "headers/object_id.h"
+
+#include <cstddef>
+#include <string_view>
+
+// SHA-1 for object names, pack trailers and index checksums.
+//
+// Single buffers go through OpenSSL's EVP interface, which already picks
+// SHA-NI or SIMD code for the running CPU. The digest is fetched once per
+// process and contexts are reused, so small inputs no longer pay for a
+// lookup on every call as the one-shot SHA1() does in OpenSSL 3.
+//
+// Many small buffers (tree entries, small blobs) can be hashed together with
+// sha1_batch. On x86-64 CPUs with AVX2 but without SHA-NI that runs an
+// eight-lane multi-buffer kernel; elsewhere it loops over the EVP path.
+// MYGIT_SHA1_IMPL=openssl|avx2 overrides the choice (avx2 is ignored when
+// the CPU does not support it).
+
+struct evp_md_ctx_st;
+
+class Sha1Context {
+public:
+    Sha1Context();
+    ~Sha1Context();
+    Sha1Context(const Sha1Context&) = delete;
+    Sha1Context& operator=(const Sha1Context&) = delete;
+
+    void update(const void* data, size_t len);
+    void update(std::string_view data) { update(data.data(), data.size()); }
+    // Returns the digest and resets the context for the next message.
+    ObjectId finish();
+
+private:
+    evp_md_ctx_st* ctx_;
+};
+
+ObjectId sha1_of(std::string_view data);
+
+// out[i] = SHA-1 of inputs[i] for every i in [0, count).
+void sha1_batch(const std::string_view* inputs, size_t count, ObjectId* out);
+
+// Name of the kernel sha1_batch uses: "avx2-multibuffer" or "openssl".
+const char* sha1_batch_implementation();
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include "headers/object_id.h"
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One ignore file (.gitignore, info/exclude, core.excludesFile), compiled.
+// Patterns without a slash are matched against the base name: plain names
+// are looked up in a hash table, "name*" and "*.ext" by prefix or suffix
+// (one hash lookup per distinct length), and only the rest go through the
+// glob matcher. As in Git, the last matching pattern of a file wins, so
+// every bucket keeps pattern numbers and the highest applicable one decides.
+class IgnoreList {
+public:
+    enum class Match { None, Ignored, Included };
+
+    IgnoreList() = default;
+    // `base` is the directory the patterns are relative to ("" or ending in '/').
+    IgnoreList(std::string_view content, std::string base);
+
+    // `path` is relative to the top and lies below base().
+    Match match(std::string_view path, bool is_dir) const;
+    const std::string& base() const { return base_; }
+    bool empty() const { return patterns_.empty(); }
+
+private:
+    struct Pattern {
+        std::string text;    // Without '!', a leading '/' and a trailing '/'
+        bool negated = false;
+        bool dir_only = false;
+        bool anchored = false; // Had a slash: matched against the path below base
+    };
+    using Bucket = std::unordered_map<std::string, std::vector<int>>;
+    // Fixed strings of one length, for prefix and suffix matching.
+    struct SizedBucket {
+        size_t size = 0;
+        Bucket patterns;
+    };
+
+    void add(Pattern pattern);
+    // Highest pattern number in `candidates` that applies, or -1.
+    int best_of(const std::vector<int>& candidates, bool is_dir, int best) const;
+
+    std::string base_;
+    std::vector<Pattern> patterns_;
+    Bucket names_;                   // Base name equals
+    Bucket paths_;                   // Anchored, no wildcards: path equals
+    std::vector<SizedBucket> prefixes_;
+    std::vector<SizedBucket> suffixes_;
+    std::vector<int> globs_;
+};
+
+// Glob match as in .gitignore: '*', '?' and [...] do not match '/', "**"
+// as a whole path component matches any number of directories, and a
+// trailing "/**" everything inside.
+bool wildmatch(std::string_view pattern, std::string_view text);
+
+// The ignore rules of the working tree: .gitignore files in every directory
+// (closer ones take precedence), then .mygit/info/exclude, then the file
+// named by core.excludesFile. .gitignore files are read the first time a
+// path in their directory is checked; safe to use from several threads.
+class IgnoreRules {
+public:
+    IgnoreRules();
+
+    // Whether `path` (relative to the top) is ignored. Its directories are
+    // assumed not to be: walkers do not descend into ignored directories.
+    bool is_ignored(std::string_view path, bool is_dir);
+    // Same, but also true if one of its directories is ignored.
+    bool is_ignored_with_parents(std::string_view path, bool is_dir);
+
+    // Object name of the contents of dir's .gitignore ("" or ending in
+    // '/'), null if there is none; for the top directory, info/exclude and
+    // core.excludesFile are included. The untracked cache keeps it to see
+    // when a directory's rules changed.
+    ObjectId rules_id(const std::string& dir);
+
+private:
+    struct DirRules {
+        IgnoreList list;
+        ObjectId id;
+    };
+    const DirRules& rules_for(const std::string& dir);
+
+    std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<DirRules>> dirs_;
+    IgnoreList info_exclude_;
+    IgnoreList excludes_file_;
+    std::string global_content_; // Of the two above, folded into the top's rules_id
+};
+
+#endif
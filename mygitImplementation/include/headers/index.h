@@ -2,13 +2,46 @@
 #define INDEX_H
 
 #include <string>
-#include <map>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+
+#include "headers/object_id.h"
+#include "headers/utils.h"
+
+// Stat data of the working tree file, recorded when the entry was last known
+// to match it. All zero when unknown (e.g. for entries read from a tree), in
+// which case the file has to be hashed to compare it.
+struct IndexStat {
+    uint32_t ctime_sec = 0;
+    uint32_t ctime_nsec = 0;
+    uint32_t mtime_sec = 0;
+    uint32_t mtime_nsec = 0;
+    uint32_t dev = 0;
+    uint32_t ino = 0;
+    uint32_t mode = 0;     // Git mode of the file (0100644, 0100755, 0120000)
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    uint32_t size = 0;     // Truncated to 32 bits, as in Git
+
+    bool empty() const { return mtime_sec == 0 && mtime_nsec == 0 && size == 0 && ino == 0; }
+    bool operator==(const IndexStat& other) const {
+        return ctime_sec == other.ctime_sec && ctime_nsec == other.ctime_nsec &&
+               mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+               dev == other.dev && ino == other.ino && mode == other.mode &&
+               uid == other.uid && gid == other.gid && size == other.size;
+    }
+    bool operator!=(const IndexStat& other) const { return !(*this == other); }
+};
 
 struct IndexEntry {
     std::string mode;      // e.g., "100644"
-    std::string sha1;      // Hex SHA-1 of the blob object
+    ObjectId sha1;         // SHA-1 of the blob object
     int stage = 0;         // Stage number (0 = normal, 1 = base, 2 = ours, 3 = theirs for merges)
     std::string path;      // File path relative to repository root
+    IndexStat stat;
 
     bool operator<(const IndexEntry& other) const {
         if (path != other.path) return path < other.path;
@@ -20,14 +53,224 @@ struct IndexEntry {
 
 };
 
-using IndexMap = std::map<std::string, std::map<int, IndexEntry>>;
+// One entry as held in memory: fixed size, with the path pointing into the
+// mapped index file or into the Index's own path storage.
+struct IndexRecord {
+    IndexStat stat;
+    ObjectId sha1;
+    uint32_t mode = 0;         // Git mode, e.g. 0100644
+    uint32_t stage = 0;
+    const char* path_data = nullptr;
+    uint32_t path_size = 0;
+    // The file was unchanged as of the filesystem monitor token stored with
+    // the index, so only a change the monitor reports can make it dirty.
+    bool fsmonitor_valid = false;
+    // Outside the sparse checkout: the file is not in the working tree and
+    // is not looked at. Written as Git's extended flag, in a version 3 index.
+    bool skip_worktree = false;
+
+    std::string_view path() const { return std::string_view(path_data, path_size); }
+    // A whole directory outside the sparse checkout, held as one entry of
+    // a sparse index: path "dir/", mode 040000, sha1 its tree.
+    bool is_sparse_directory() const { return mode == 040000; }
+};
+
+// Cached tree object for one directory of the index (Git's "TREE" extension).
+// entry_count is the number of index entries below the directory when oid
+// was written (a sparse directory entry counts as one and has no node), or
+// -1 once any of them changed; only invalid directories are rebuilt by
+// Index::write_tree.
+struct CacheTreeNode {
+    int entry_count = -1;
+    ObjectId oid;
+    // Kept in index order of the directories ("name/" comparison).
+    std::vector<std::pair<std::string, std::unique_ptr<CacheTreeNode>>> subtrees;
+
+    CacheTreeNode* find(std::string_view name);
+    const CacheTreeNode* find(std::string_view name) const { return const_cast<CacheTreeNode*>(this)->find(name); }
+    CacheTreeNode& get_or_add(std::string_view name);
+};
+
+// One directory of the untracked cache: the directory's stat data and
+// ignore rules (IgnoreRules::rules_id) when it was last read, the names of
+// the files in it that were neither in the index nor ignored then, and its
+// subdirectories that were not ignored, both sorted by name. While the stat data
+// still matches, nothing was created, removed or renamed in the directory,
+// so status can use the lists instead of reading it. Directories read within
+// the same second as their last change are not valid (a later change in that
+// second would keep the mtime) and are read again.
+struct UntrackedCacheDir {
+    IndexStat stat;
+    ObjectId ignore_id;
+    bool valid = false;
+    std::vector<std::string> untracked;
+    std::vector<std::pair<std::string, std::unique_ptr<UntrackedCacheDir>>> subdirs;
+
+    UntrackedCacheDir* find(std::string_view name);
+    const UntrackedCacheDir* find(std::string_view name) const { return const_cast<UntrackedCacheDir*>(this)->find(name); }
+};
+
+// The staging area: records sorted by path and stage in one contiguous array.
+// read_index() maps the index file and points the records' paths into the
+// mapping, so loading is a single pass with no per-entry allocation, and
+// lookups are binary searches. Paths of entries added later are copied into
+// blocks owned by the Index. Move-only, since records point into both.
+class Index {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
 
-IndexMap read_index();
+    Index() = default;
+    // The entries of `tree`, with the tree and its subtrees as the cached
+    // tree. Directories whose cached tree in `base` has the same object name
+    // are copied from `base` (records with their stat data, and cached
+    // trees) without reading their tree objects; files with the same object
+    // name and mode as in `base` keep its stat data. The paths of the other
+    // files, which differ from `base`, are added to *changed in order.
+    // Directories ("dir/") for which `collapse` returns true become sparse
+    // directory entries, and their trees are not read.
+    // Throws if a tree cannot be read.
+    static Index from_tree(const ObjectId& tree, const Index* base = nullptr, std::vector<std::string>* changed = nullptr,
+                           const std::function<bool(std::string_view)>& collapse = nullptr);
+
+    Index(Index&&) noexcept = default;
+    Index& operator=(Index&&) noexcept = default;
+    Index(const Index&) = delete;
+    Index& operator=(const Index&) = delete;
+
+    size_t size() const { return records_.size(); }
+    bool empty() const { return records_.empty(); }
+    const IndexRecord& operator[](size_t i) const { return records_[i]; }
+    std::vector<IndexRecord>::const_iterator begin() const { return records_.begin(); }
+    std::vector<IndexRecord>::const_iterator end() const { return records_.end(); }
+
+    // Position of (path, stage), or npos.
+    size_t find(std::string_view path, int stage = 0) const;
+    // Position of the first record for path (any stage), or of the first
+    // record sorting after it.
+    size_t lower_bound(std::string_view path) const;
+    bool contains(std::string_view path) const;
+    bool has_conflicts() const;
+
+    IndexEntry entry(size_t i) const;
+    void add_or_update(const IndexEntry& entry);
+    // stage -1 removes every stage of the path.
+    void remove(std::string_view path, int stage = -1);
+    void set_stat(size_t i, const IndexStat& stat) { records_[i].stat = stat; }
+    void set_fsmonitor_valid(size_t i, bool valid) { records_[i].fsmonitor_valid = valid; }
+    // Setting the bit also forgets the stat data, so the file is looked at
+    // again once the bit is cleared.
+    void set_skip_worktree(size_t i, bool skip);
+
+    // Sparse index (index.sparse): directories whose entries all have the
+    // skip-worktree bit can be held as a single sparse directory entry, so
+    // the index grows with the sparse checkout rather than the repository.
+    // Such an entry is expanded, one level at a time, only when something
+    // looks inside it: add_or_update and remove do that themselves, and
+    // callers looking up a path that may be inside one call expand_to first.
+    bool is_sparse() const { return sparse_; }
+    // Replaces each directory that has a valid cached tree and only stage 0
+    // skip-worktree entries by a sparse directory entry, highest first.
+    void collapse_sparse_directories();
+    // Replaces sparse directory entry i by the entries of its tree, with the
+    // skip-worktree bit; subdirectories stay sparse directory entries.
+    void expand_sparse_directory(size_t i);
+    // Expands the sparse directory entries holding `path`.
+    void expand_to(std::string_view path);
+    // Expands every sparse directory entry.
+    void ensure_full();
+
+    // True when `current` matches the recorded stat data of record i, so the
+    // file can be assumed to still hold its sha1 without reading it. Entries
+    // whose mtime is not older than the index file are "racily clean" (the
+    // file could have changed within the same timestamp tick) and never count
+    // as up to date.
+    bool up_to_date(size_t i, const IndexStat& current) const;
+
+    // Writes the tree objects for the stage 0 entries and returns the root
+    // tree. Directories whose cached tree is still valid are not revisited,
+    // so after a small change only the trees along its path are rebuilt.
+    // Sets *cache_updated when the cache changed and the index is worth
+    // writing back. Callers must reject conflicted indexes first.
+    ObjectId write_tree(bool* cache_updated = nullptr);
+    // Records `tree` (which the entries were just read from) as the cached
+    // tree, so the next write_tree has nothing to rebuild.
+    void prime_cache_tree(const ObjectId& tree);
+    const CacheTreeNode* cache_tree() const { return cache_tree_.get(); }
+
+    // Untracked cache from the last status; null when there is none (or
+    // core.untrackedCache is off). Adding or removing an entry invalidates
+    // the directory holding it, since its untracked list no longer applies.
+    const UntrackedCacheDir* untracked_cache() const { return untracked_cache_.get(); }
+    void set_untracked_cache(std::unique_ptr<UntrackedCacheDir> cache) { untracked_cache_ = std::move(cache); }
+
+    // Filesystem monitor token the fsmonitor_valid flags (and the untracked
+    // cache) are current as of; empty when the monitor is not in use.
+    const std::string& fsmonitor_token() const { return fsmonitor_token_; }
+    void set_fsmonitor_token(std::string token) { fsmonitor_token_ = std::move(token); }
+
+private:
+    friend Index read_index();
+    friend void write_index(const Index& index);
+
+    const char* store_path(std::string_view path);
+    void invalidate_cache_tree(std::string_view path);
+    void invalidate_untracked_cache(std::string_view path);
+    ObjectId build_tree(CacheTreeNode& node, size_t begin, size_t end, size_t prefix_size);
+    int add_tree(CacheTreeNode& node, const ObjectId& tree, std::string& prefix, const Index* base,
+                 const CacheTreeNode* base_node, std::vector<std::string>* changed,
+                 const std::function<bool(std::string_view)>& collapse);
+    void append(const IndexRecord& rec, std::string_view path);
+    // Cache tree changes collapse_tree works out, made only once its
+    // records replace the index's.
+    struct CollapseEdits {
+        bool collapsed = false;
+        std::vector<std::pair<CacheTreeNode*, int>> counts;             // New entry counts
+        std::vector<std::pair<CacheTreeNode*, CacheTreeNode*>> dropped; // (parent, child) now a sparse entry
+    };
+    size_t collapse_tree(CacheTreeNode* node, size_t begin, size_t end, size_t prefix_size, std::vector<IndexRecord>& out,
+                         CollapseEdits& edits);
+
+    MappedFile file_;
+    std::vector<IndexRecord> records_;
+    std::vector<std::unique_ptr<char[]>> path_blocks_;
+    size_t block_used_ = 0;
+    size_t block_size_ = 0;
+    std::unique_ptr<CacheTreeNode> cache_tree_;
+    std::unique_ptr<UntrackedCacheDir> untracked_cache_;
+    std::string fsmonitor_token_;
+    bool sparse_ = false; // May hold sparse directory entries
+    // Split index: the shared base the entries were merged from, kept to
+    // work out what changed when writing.
+    MappedFile base_file_;
+    std::vector<IndexRecord> base_records_;
+    ObjectId base_oid_;
+    uint32_t timestamp_sec_ = 0;  // mtime of the index file when read
+    uint32_t timestamp_nsec_ = 0;
+};
 
-void write_index(const IndexMap& index_data);
+// The index file is Git's binary "DIRC" version 2 layout (version 3 when an
+// entry has the skip-worktree bit, which needs the extended flags word):
+// header, entries sorted by path and stage (stat data, object name, flags,
+// NUL-padded path), optional extensions ("TREE", "sdir" marking a sparse
+// index, "link" for a split index, and mygit's own untracked cache "MGUC"
+// and filesystem monitor state "MGFM", which Git skips as optional), then a
+// SHA-1 of everything before it. The older text format ("<mode> <sha>
+// <stage>\t<path>" lines) is still read and is replaced on the next write.
+//
+// Large indexes are split (core.splitIndex overrides): a shared base file
+// holds most entries and .mygit/index only what changed since, so staging
+// one file rewrites kilobytes. When more than splitIndex.maxPercentChange
+// (default 20) percent of the base has changed, a new base is written.
+Index read_index();
 
-void add_or_update_entry(IndexMap& index_data, const IndexEntry& entry);
+// Writes the records in one sequential pass.
+void write_index(const Index& index);
 
-void remove_entry(IndexMap& index_data, const std::string& path, int stage = -1);
+// Stats a working tree file the way the blob readers see it (following
+// symlinks for times and size, but reporting a symlink's mode as 0120000).
+// Returns false if it does not exist.
+bool stat_workdir_file(const std::string& path, IndexStat& out);
+// Same for a directory (not through a symlink); mode is 040000.
+bool stat_workdir_directory(const std::string& path, IndexStat& out);
 
-#endif
\ No newline at end of file
+#endif
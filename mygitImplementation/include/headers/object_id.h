@@ -0,0 +1,59 @@
+#ifndef OBJECT_ID_H
+#define OBJECT_ID_H
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+
+// Binary 20-byte SHA-1 object name. Trivially copyable: it lives inline in
+// structs and containers, compares with memcmp and hashes without allocating.
+// Hex is only produced at the edges (output, ref files, the text index).
+struct ObjectId {
+    static constexpr size_t RAW_SIZE = 20;
+    static constexpr size_t HEX_SIZE = 40;
+
+    std::array<unsigned char, RAW_SIZE> bytes{};
+
+    static ObjectId from_raw(const unsigned char* raw) {
+        ObjectId id;
+        std::memcpy(id.bytes.data(), raw, RAW_SIZE);
+        return id;
+    }
+    // Requires exactly 40 hex digits; throws std::invalid_argument otherwise.
+    static ObjectId from_hex(std::string_view hex);
+    static bool try_from_hex(std::string_view hex, ObjectId& out);
+
+    std::string hex() const;
+    std::string short_hex(size_t len = 7) const { return hex().substr(0, len); }
+    void write_hex(char* out) const; // Writes HEX_SIZE chars, no terminator
+
+    const unsigned char* data() const { return bytes.data(); }
+    bool is_null() const;
+
+    bool operator==(const ObjectId& other) const { return std::memcmp(bytes.data(), other.bytes.data(), RAW_SIZE) == 0; }
+    bool operator!=(const ObjectId& other) const { return !(*this == other); }
+    bool operator<(const ObjectId& other) const { return std::memcmp(bytes.data(), other.bytes.data(), RAW_SIZE) < 0; }
+};
+
+std::ostream& operator<<(std::ostream& os, const ObjectId& id);
+
+// Value of one hex digit (either case), or -1.
+int hex_digit_value(char c);
+
+namespace std {
+template <>
+struct hash<ObjectId> {
+    size_t operator()(const ObjectId& id) const noexcept {
+        // Object names are uniformly distributed already; any 8 bytes will do.
+        size_t h;
+        std::memcpy(&h, id.bytes.data(), sizeof(h));
+        return h;
+    }
+};
+}
+
+#endif
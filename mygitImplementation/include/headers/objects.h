@@ -4,9 +4,14 @@
 #include <string>
 #include <vector>
 #include <variant>
+#include <string_view>
+#include <memory>
+#include <cstdint>
 
 #include <map>
 
+#include "headers/object_id.h"
+
 struct IndexEntry;
 
 struct BlobObject {
@@ -16,7 +21,7 @@ struct BlobObject {
 struct TreeEntry {
     std::string mode;
     std::string name;
-    std::string sha1;
+    ObjectId sha1;
 };
 
 struct TreeObject {
@@ -24,15 +29,15 @@ struct TreeObject {
 };
 
 struct CommitObject {
-    std::string tree_sha1;
-    std::vector<std::string> parent_sha1s;
+    ObjectId tree_sha1;
+    std::vector<ObjectId> parent_sha1s;
     std::string author_info;
     std::string committer_info;
     std::string message;
 };
 
 struct TagObject {
-    std::string object_sha1;
+    ObjectId object_sha1;
     std::string type;
     std::string tag_name;
     std::string tagger_info;
@@ -47,26 +52,107 @@ struct ParsedObject {
     ParsedObjectData data;
 };
 
+// Type and content size from an object's header, without its content.
+struct ObjectHeader {
+    std::string type;
+    size_t size = 0;
+};
+
+// Object type and content as stored, before parsing (no "type size\0" header).
+struct RawObject {
+    std::string type;
+    std::string content;
+};
+
 std::string find_object(const std::string& sha1_prefix);
 std::string get_object_path(const std::string& sha1);
+std::string get_object_path(const ObjectId& id);
 void ensure_object_directory_exists(const std::string& sha1);
 
 void write_object(const std::string& sha1, const std::string& object_type, const std::string& content);
 void write_object(const std::string& sha1, const std::vector<unsigned char>& compressed_data);
 
+bool has_object(const std::string& sha1);
+bool has_object(const ObjectId& id);
+// Every object stored loose under objects/xx/, in no particular order.
+std::vector<ObjectId> list_loose_objects();
+
+RawObject read_raw_object(const std::string& sha1);
+RawObject read_raw_object(const ObjectId& id);
+// Inflates only the first bytes of a loose object, or decodes a packed
+// entry's header (following delta bases for the type, reading the result size
+// from the start of the delta). Use this when the type or size is all you need.
+ObjectHeader read_object_header(const ObjectId& id);
+ObjectHeader read_object_header(const std::string& sha1_prefix_or_full);
 ParsedObject read_object(const std::string& sha1_prefix_or_full);
+ParsedObject read_object(const ObjectId& id);
+
+// Parsed objects are kept in a process-wide LRU bounded in bytes
+// (core.objectCacheLimit or MYGIT_OBJECT_CACHE_LIMIT, default 64m; 0 disables).
+// read_object returns a copy; hot loops should share the cached object instead.
+std::shared_ptr<const ParsedObject> read_object_cached(const std::string& sha1_prefix_or_full);
+std::shared_ptr<const ParsedObject> read_object_cached(const ObjectId& id);
+
+struct ObjectCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    uint64_t bytes = 0;
+    uint64_t limit = 0;
+};
+
+ObjectCacheStats get_object_cache_stats();
+void set_object_cache_limit(uint64_t bytes);
+// Also printed to stderr at exit when MYGIT_TRACE_OBJECT_CACHE is set.
+void print_object_cache_stats();
+
+BlobObject parse_blob_content(std::string content);
+TreeObject parse_tree_content(std::string_view content);
+CommitObject parse_commit_content(std::string_view content);
+TagObject parse_tag_content(std::string_view content);
+
+// Non-owning views for walks that only need a few fields: they point into the
+// RawObject content they were parsed from, which must outlive them.
+struct TreeEntryView {
+    std::string_view mode;
+    std::string_view name;
+    ObjectId sha1;
+};
 
-BlobObject parse_blob_content(const std::string& content);
-TreeObject parse_tree_content(const std::string& content);
-CommitObject parse_commit_content(const std::string& content);
-TagObject parse_tag_content(const std::string& content);
+class TreeReader {
+public:
+    explicit TreeReader(std::string_view content) : data_(content) {}
+    // Returns false at the end of the tree; throws on malformed entries.
+    bool next(TreeEntryView& entry);
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+};
+
+struct CommitView {
+    ObjectId tree_sha1;
+    std::vector<ObjectId> parent_sha1s;
+    std::string_view author_info;
+    std::string_view committer_info;
+    std::string_view message;
+};
+
+CommitView parse_commit_view(std::string_view content);
 
 std::string format_tree_content(const std::vector<TreeEntry>& entries);
-std::string format_commit_content(const std::string& tree_sha1, const std::vector<std::string>& parent_sha1s,
+std::string format_commit_content(const ObjectId& tree_sha1, const std::vector<ObjectId>& parent_sha1s,
                                   const std::string& author, const std::string& committer, const std::string& message);
-std::string format_tag_content(const std::string& object_sha1, const std::string& type, const std::string& tag_name,
+std::string format_tag_content(const ObjectId& object_sha1, const std::string& type, const std::string& tag_name,
                                const std::string& tagger, const std::string& message);
 
-std::string hash_and_write_object(const std::string& type, const std::string& content);
+ObjectId hash_and_write_object(const std::string& type, const std::string& content);
+
+// Object name of the file at `path` stored as `type`, writing the object too
+// when `write` is set. Files larger than a few chunks are never held in memory:
+// they are read in fixed-size chunks fed to SHA-1 and deflate, and the
+// compressed stream goes to a temporary file that is renamed into place.
+ObjectId hash_file_object(const std::string& path, const std::string& type, bool write);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef OID_TABLE_H
+#define OID_TABLE_H
+
+#include "headers/object_id.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sorted table of every object name in the repository: the names from all
+// pack indexes plus one readdir pass over the loose fanout directories. Built
+// on first use and kept for the process; objects written by this process are
+// added as they are created.
+
+// All objects whose hex name starts with `hex_prefix` (lowercase hex, any
+// length up to 40), in sorted order.
+std::vector<ObjectId> find_objects_by_prefix(std::string_view hex_prefix);
+
+// Shortest prefix of `id`, at least `min_len` digits, that names no other
+// known object. Works for ids not in the table too.
+std::string find_unique_abbrev(const ObjectId& id, size_t min_len = 7);
+
+// Records an object written after the table was built.
+void note_new_object(const ObjectId& id);
+
+// Drops the table so it is rebuilt from disk on next use (after gc/prune).
+void reset_oid_table();
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include "headers/objects.h"
+#include "headers/utils.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Object type codes used in pack entry headers (same numbering as Git).
+enum class PackObjectType : uint8_t {
+    Commit = 1,
+    Tree = 2,
+    Blob = 3,
+    Tag = 4,
+    OfsDelta = 6,   // Delta against an earlier entry, base given as a backwards offset
+    RefDelta = 7    // Delta against an object named by its SHA-1
+};
+
+// One .pack/.idx pair under objects/pack.
+// The .idx layout is Git's version 2 format: 256-entry fanout table,
+// sorted 20-byte object names, CRC32s, 32-bit offsets, 64-bit offset table,
+// then the pack checksum and the index checksum.
+struct PackFile {
+    std::string pack_path;
+    std::string idx_path;
+    std::string checksum_hex;          // Trailing SHA-1 of the .pack file
+    uint32_t object_count = 0;
+    uint64_t pack_size = 0;
+    MappedFile idx_map;
+    MappedFile pack_map;               // Mapped lazily on first read
+    std::vector<uint64_t> sorted_offsets; // Built lazily, gives each entry's extent
+};
+
+// All packs in objects/pack, loaded on first use and cached for the process.
+std::vector<PackFile>& get_packs();
+void reload_packs();
+
+bool pack_has_object(const ObjectId& id);
+bool read_packed_object(const ObjectId& id, RawObject& out);
+bool read_packed_object_header(const ObjectId& id, ObjectHeader& out);
+std::vector<ObjectId> list_packed_objects(const PackFile& pack);
+
+// An object to pack. The path (if known) only steers the delta search, which
+// tries to pair up versions of the same file.
+struct PackInput {
+    ObjectId sha1;
+    std::string path;
+};
+
+struct PackOptions {
+    int window = 10;   // Number of preceding candidates tried as delta bases
+    int depth = 50;    // Maximum length of a delta chain
+};
+
+struct PackStats {
+    size_t total = 0;
+    size_t deltas = 0;
+};
+
+// Writes the given objects (read through read_raw_object) into a new pack and
+// index in objects/pack, storing objects as deltas where that is smaller.
+// Returns the pack checksum used in the file names.
+std::string write_pack(const std::vector<PackInput>& objects, const PackOptions& options = PackOptions(),
+                       PackStats* stats = nullptr);
+
+#endif
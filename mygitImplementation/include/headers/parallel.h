@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Worker count for -j style options: `requested` if positive, otherwise
+// std::thread::hardware_concurrency() (at least 1).
+unsigned resolve_thread_count(int requested);
+
+// Runs fn(i) for every i in [0, count) on up to `threads` threads, the calling
+// thread included. Indexes are handed out one at a time, so a few large items
+// do not hold up a fixed slice of the work. If fn throws, the remaining
+// indexes are skipped and the first exception is rethrown once all workers
+// have stopped.
+void parallel_for(size_t count, unsigned threads, const std::function<void(size_t)>& fn);
+
+#endif
@@ -5,11 +5,15 @@
 #include <vector>
 #include <optional>
 
+#include "headers/object_id.h"
+
 void update_ref(const std::string& ref_name, const std::string& value, bool symbolic = false);
 
 std::string read_ref_direct(const std::string& ref_name);
 
 std::optional<std::string> resolve_ref(const std::string& ref_or_sha_prefix);
+// resolve_ref, returning the binary object name.
+std::optional<ObjectId> resolve_ref_id(const std::string& ref_or_sha_prefix);
 
 std::string read_head();
 
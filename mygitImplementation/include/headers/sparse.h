@@ -0,0 +1,70 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Index;
+
+// Sparse checkout in cone mode: only the files at the top, everything below
+// the listed directories, and the files directly inside the directories
+// leading to them are in the working tree. Other index entries get the
+// skip-worktree bit. The cone is kept in .mygit/info/sparse-checkout in
+// Git's cone format, so Git reads it the same way:
+//
+//   /*          top-level files
+//   !/*/        but no directories
+//   /src/       src/ itself (files directly inside it)
+//   !/src/*/    but not its subdirectories
+//   /src/app/   except src/app/ and everything below it
+//
+// and is used while core.sparseCheckout is true.
+class SparseCone {
+public:
+    SparseCone() = default; // Top-level files only
+    // `dirs` are relative to the top, with or without slashes around them;
+    // ones below another listed directory are dropped.
+    explicit SparseCone(const std::vector<std::string>& dirs);
+    // Throws std::runtime_error on a line that is not a cone pattern.
+    static SparseCone parse(std::string_view content);
+    std::string format() const;
+
+    // Whether the file at `path` is in the working tree.
+    bool includes(std::string_view path) const;
+    // Whether any file below directory `dir` (trailing slash optional) is.
+    bool reaches(std::string_view dir) const;
+
+    // The listed directories, sorted.
+    const std::set<std::string, std::less<>>& dirs() const { return recursive_; }
+
+private:
+    void add(std::string dir);
+
+    std::set<std::string, std::less<>> recursive_; // Everything below is included
+    std::set<std::string, std::less<>> parents_;   // Hold a listed directory: own files only
+};
+
+// The cone in use: nullopt unless core.sparseCheckout is true. A pattern file
+// that is missing counts as top-level files only; one that cannot be read
+// as a cone is warned about and ignored.
+std::optional<SparseCone> load_sparse_cone();
+// Replaces .mygit/info/sparse-checkout.
+void write_sparse_cone(const SparseCone& cone);
+
+// Whether index.sparse is set: directories outside the cone are then kept
+// in the index as single sparse directory entries.
+bool sparse_index_enabled();
+
+// Expands the sparse directory entries of `index` that hold paths in `cone`
+// (all of them when `cone` is null).
+void expand_into_cone(Index& index, const SparseCone* cone);
+
+// Sets the skip-worktree bit of every stage 0 entry outside `cone` and clears
+// it for the others (for all of them when `cone` is null), expanding sparse
+// directory entries first as needed. Returns true if a bit changed.
+bool apply_sparse_cone(Index& index, const SparseCone* cone);
+
+#endif
@@ -5,11 +5,38 @@
 #include <vector>
 #include <filesystem>
 
+#include "headers/object_id.h"
+
 namespace fs = std::filesystem;
 
 extern const std::string GIT_DIR;
 extern const std::string OBJECTS_DIR;
 extern const std::string REFS_DIR;
+extern const std::string PACK_DIR;
+
+// Read-only view of a whole file. Files of at least min_map_size bytes are
+// mmap'd; smaller ones (where a plain read is cheaper) are read into memory.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path, size_t min_map_size = 0);
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return map_ ? static_cast<const unsigned char*>(map_) : buffer_.data(); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    void release();
+
+    void* map_ = nullptr;
+    size_t size_ = 0;
+    std::vector<unsigned char> buffer_;
+};
 
 std::string read_file(const std::string& filename);
 void write_file(const std::string& filename, const std::string& data);
@@ -23,8 +50,10 @@ void set_file_executable(const std::string& filename, bool executable);
 
 std::string compute_sha1(const std::string& data);
 std::string compute_sha1(const std::vector<unsigned char>& data);
+ObjectId compute_object_id(const std::string& data);
 std::vector<unsigned char> compress_data(const std::string& input);
 std::string decompress_chunk(const std::vector<unsigned char>& compressed_data, size_t initial_chunk_size = 1024);
+std::string decompress_exact(const unsigned char* compressed_data, size_t compressed_size, size_t expected_size);
 std::string sha1_to_hex(const unsigned char* sha1_binary);
 std::vector<unsigned char> hex_to_sha1(const std::string& sha1_hex);
 
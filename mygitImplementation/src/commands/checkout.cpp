@@ -0,0 +1,238 @@
+#include "headers/checkout.h"
+#include "headers/config.h"
+#include "headers/index.h"
+#include "headers/objects.h"
+#include "headers/pack.h"
+#include "headers/parallel.h"
+#include "headers/utils.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <set>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Below this many files, starting threads costs more than it saves.
+const size_t CHECKOUT_PARALLEL_THRESHOLD = 100;
+
+// MYGIT_CHECKOUT_WORKERS or checkout.workers; 0 (the default) means one per core.
+unsigned checkout_worker_count() {
+    const char* env = std::getenv("MYGIT_CHECKOUT_WORKERS");
+    std::optional<std::string> value = env ? std::optional<std::string>(env) : get_config_value("checkout.workers");
+    int requested = 0;
+    if (value) {
+        if (!value->empty() && value->size() <= 4 && value->find_first_not_of("0123456789") == std::string::npos) {
+            requested = std::stoi(*value);
+        } else {
+            std::cerr << "Warning: Ignoring checkout.workers '" << *value << "'" << std::endl;
+        }
+    }
+    return resolve_thread_count(requested);
+}
+
+enum class Action { Keep, Write, Chmod };
+
+struct PlannedPath {
+    Action action = Action::Keep;
+    IndexStat stat;    // Of the file as found, then as written
+    std::string error; // Set by the worker that failed
+};
+
+std::string errno_message(const std::string& what, const std::string& path) {
+    return what + " '" + path + "': " + std::strerror(errno);
+}
+
+// Decides what has to happen to new_index[i], from a stat of the file and,
+// when the old index cannot vouch for its content, a hash of it.
+void plan_path(const Index& old_index, const Index& new_index, size_t i, PlannedPath& plan) {
+    const IndexRecord& rec = new_index[i];
+    std::string path(rec.path());
+    if (!stat_workdir_file(path, plan.stat)) {
+        plan.action = Action::Write;
+        return;
+    }
+    size_t old_pos = old_index.find(rec.path());
+    bool same_mode = plan.stat.mode == rec.mode;
+    if (old_pos != Index::npos && old_index.up_to_date(old_pos, plan.stat)) {
+        // The file still holds what the old index says: no need to read it.
+        if (old_index[old_pos].sha1 != rec.sha1) plan.action = Action::Write;
+        else if (!same_mode) plan.action = Action::Chmod;
+        return;
+    }
+    try {
+        if (hash_file_object(path, "blob", false) != rec.sha1) plan.action = Action::Write;
+        else if (!same_mode) plan.action = Action::Chmod;
+    } catch (const std::exception&) {
+        plan.action = Action::Write; // Unreadable: replace it
+    }
+}
+
+// Replaces whatever is at `path` with a new file, created with its final
+// permissions so no chmod is needed afterwards.
+void write_checkout_file(const std::string& path, const std::string& content, bool executable) {
+    if (::unlink(path.c_str()) != 0 && errno != ENOENT) throw std::runtime_error(errno_message("unable to unlink", path));
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, executable ? 0777 : 0666);
+    if (fd < 0) throw std::runtime_error(errno_message("unable to create file", path));
+    const char* data = content.data();
+    size_t left = content.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            std::string message = errno_message("unable to write file", path);
+            ::close(fd);
+            throw std::runtime_error(message);
+        }
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+    if (::close(fd) != 0) throw std::runtime_error(errno_message("unable to write file", path));
+}
+
+// Creates `dir` unless it already exists as a directory.
+bool make_directory(const std::string& dir, std::string& error) {
+    if (::mkdir(dir.c_str(), 0777) == 0) return true;
+    int saved = errno;
+    struct stat st;
+    if (saved == EEXIST && ::stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) return true;
+    errno = saved == EEXIST ? ENOTDIR : saved;
+    error = errno_message("unable to create directory", dir);
+    return false;
+}
+
+} // namespace
+
+bool checkout_index(const Index& old_index, Index& new_index, const std::vector<std::string>* changed) {
+    bool ok = true;
+
+    // 1. Deletions, in path order: files no longer tracked, or now outside
+    //    the sparse checkout. Directories left empty go too, deepest first,
+    //    so a file may take the place of a directory that is gone.
+    std::set<std::string> emptied_dirs;
+    for (const IndexRecord& old_rec : old_index) {
+        if (old_rec.stage != 0 || old_rec.skip_worktree) continue;
+        size_t new_pos = new_index.find(old_rec.path());
+        if (new_pos != Index::npos ? !new_index[new_pos].skip_worktree : new_index.contains(old_rec.path())) continue;
+        std::string path(old_rec.path());
+        struct stat st;
+        if (::lstat(path.c_str(), &st) != 0) continue;
+        std::cout << "  Deleting " << path << std::endl;
+        if (::unlink(path.c_str()) != 0) {
+            std::cerr << "error: " << errno_message("unable to unlink", path) << std::endl;
+            ok = false;
+            continue;
+        }
+        for (size_t slash = path.rfind('/'); slash != std::string::npos; slash = path.rfind('/', slash - 1)) {
+            emptied_dirs.insert(path.substr(0, slash));
+            if (slash == 0) break;
+        }
+    }
+    for (auto it = emptied_dirs.rbegin(); it != emptied_dirs.rend(); ++it) {
+        ::rmdir(it->c_str()); // Fails, as it should, if anything is left inside
+    }
+
+    // 2. What each path of the new index needs. Stat calls and hashing are
+    //    independent per path, so they run on the workers as well.
+    //    Entries carried over from old_index unchanged need no look, unless
+    //    their file was never seen.
+    size_t count = new_index.size();
+    std::vector<PlannedPath> plan(count);
+    std::vector<size_t> to_check;
+    auto next_changed = changed ? changed->begin() : std::vector<std::string>::const_iterator();
+    for (size_t i = 0; i < count; ++i) {
+        const IndexRecord& rec = new_index[i];
+        if (rec.stage != 0 || rec.skip_worktree) continue;
+        bool listed = false;
+        if (changed) {
+            while (next_changed != changed->end() && *next_changed < rec.path()) ++next_changed;
+            listed = next_changed != changed->end() && *next_changed == rec.path();
+        }
+        if (!changed || listed || rec.stat.empty()) to_check.push_back(i);
+    }
+    unsigned workers = to_check.size() < CHECKOUT_PARALLEL_THRESHOLD ? 1 : checkout_worker_count();
+    get_packs(); // Map packs up front rather than from the first worker to miss
+    parallel_for(to_check.size(), workers, [&](size_t k) {
+        size_t i = to_check[k];
+        plan_path(old_index, new_index, i, plan[i]);
+    });
+
+    std::vector<size_t> writes;
+    std::set<std::string> dirs;
+    for (size_t i : to_check) {
+        std::string_view path = new_index[i].path();
+        switch (plan[i].action) {
+        case Action::Keep:
+            new_index.set_stat(i, plan[i].stat);
+            break;
+        case Action::Chmod:
+            std::cout << "  Updating mode for " << path << std::endl;
+            set_file_executable(std::string(path), new_index[i].mode == 0100755);
+            if (!stat_workdir_file(std::string(path), plan[i].stat)) plan[i].stat = IndexStat();
+            new_index.set_stat(i, plan[i].stat);
+            break;
+        case Action::Write:
+            std::cout << "  Checking out " << path << std::endl;
+            writes.push_back(i);
+            for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+                dirs.emplace(path.substr(0, slash));
+            }
+            break;
+        }
+    }
+
+    // 3. Directories, in path order: a parent sorts before its children.
+    //    Files below one that cannot be created are not attempted.
+    std::vector<std::string> failed_dirs;
+    auto in_failed_dir = [&](std::string_view path) {
+        for (const std::string& failed : failed_dirs) {
+            if (path.size() > failed.size() && path.compare(0, failed.size(), failed) == 0 && path[failed.size()] == '/') return true;
+        }
+        return false;
+    };
+    for (const std::string& dir : dirs) {
+        if (in_failed_dir(dir)) continue;
+        std::string error;
+        if (!make_directory(dir, error)) {
+            std::cerr << "error: " << error << std::endl;
+            failed_dirs.push_back(dir);
+            ok = false;
+        }
+    }
+
+    // 4. Blobs are read, inflated and written by the workers, each holding
+    //    one blob at a time.
+    workers = writes.size() < CHECKOUT_PARALLEL_THRESHOLD ? 1 : checkout_worker_count();
+    parallel_for(writes.size(), workers, [&](size_t w) {
+        size_t i = writes[w];
+        const IndexRecord& rec = new_index[i];
+        PlannedPath& planned = plan[i];
+        std::string path(rec.path());
+        if (in_failed_dir(path)) {
+            planned.error = "unable to create file '" + path + "': leading directory could not be created";
+            return;
+        }
+        try {
+            RawObject blob = read_raw_object(rec.sha1);
+            if (blob.type != "blob") throw std::runtime_error("object " + rec.sha1.hex() + " is a " + blob.type + ", not a blob");
+            write_checkout_file(path, blob.content, rec.mode == 0100755);
+            if (!stat_workdir_file(path, planned.stat)) planned.stat = IndexStat();
+        } catch (const std::exception& e) {
+            planned.error = e.what();
+            planned.stat = IndexStat();
+        }
+    });
+
+    for (size_t i : writes) {
+        new_index.set_stat(i, plan[i].stat);
+        if (!plan[i].error.empty()) {
+            std::cerr << "error: " << plan[i].error << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
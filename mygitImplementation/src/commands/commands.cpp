@@ -4,18 +4,32 @@
 #include "headers/objects.h"
 #include "headers/utils.h"
 #include "headers/index.h"
+#include "headers/pack.h"
+#include "headers/gc.h"
+#include "headers/oid_table.h"
+#include "headers/parallel.h"
+#include "headers/fsmonitor.h"
+#include "headers/ignore.h"
+#include "headers/checkout.h"
+#include "headers/sparse.h"
+#include "headers/config.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <set>
+#include <unordered_set>
 #include <queue>
 #include <map>
 #include <optional>
 
 #include <algorithm>
 #include <functional>
+#include <ctime>
+
+#include <poll.h>
+#include <unistd.h>
 
 enum class MergeStatus { Unmodified, Added, Deleted, Modified, Conflict };
 struct MergePathResult {
@@ -89,81 +103,154 @@ int handle_init() {
     }
 }
 
-bool add_single_file_to_index(const std::string& file_path_to_add, IndexMap& index_map) {
+namespace {
+
+// What one worker produced for one path; applied to the index afterwards on
+// the main thread, in file list order.
+struct StagedFile {
+    bool ok = true;
+    bool skip = false; // Nothing to record (inside .mygit, or a directory)
+    IndexEntry entry;
+    std::string warning;
+    std::string error;
+};
+
+// Reads, hashes and writes the blob for one path. Touches no shared state
+// besides the object store (the index is only read), so it runs on any
+// worker thread. `changes` (may be null) are the filesystem monitor's
+// complete changes since the index's token.
+StagedFile stage_file_for_add(const std::string& file_path_to_add, const Index& index, const FsmonitorChanges* changes) {
+    StagedFile result;
     try {
         // Basic ignore check (can be expanded with .gitignore later)
         if (file_path_to_add == GIT_DIR || file_path_to_add.rfind(GIT_DIR + "/", 0) == 0) {
-            // std::cout << "DEBUG_ADD: Ignoring path within .mygit: " << file_path_to_add << std::endl;
-            return true; // Skipping is considered success in this context
+            result.skip = true; // Skipping is considered success in this context
+            return result;
         }
 
-        // 1. Read file content
-        std::string content = read_file(file_path_to_add);
-        // Note: read_file might return empty if file doesn't exist or is empty.
-        // hash_and_write_object handles empty content correctly (creates empty blob).
+        // 0. Unchanged since it was staged (the monitor saw no change, or
+        // same stat data): keep the entry without reading the file. The stat
+        // is taken before hashing, so a change made while hashing shows up as
+        // a mismatch next time.
+        if (changes) {
+            size_t pos = index.find(file_path_to_add);
+            if (pos != Index::npos && index[pos].fsmonitor_valid && !changes->path_changed(file_path_to_add)) {
+                result.entry = index.entry(pos);
+                return result;
+            }
+        }
+        IndexStat file_stat;
+        bool have_stat = stat_workdir_file(file_path_to_add, file_stat);
+        if (have_stat) {
+            size_t pos = index.find(file_path_to_add);
+            if (pos != Index::npos && index.up_to_date(pos, file_stat)) {
+                result.entry = index.entry(pos);
+                return result;
+            }
+        }
 
-        // 2. Create blob object (writes if not exists)
-        std::string sha1 = hash_and_write_object("blob", content);
+        // 1. Hash the content and write the blob (if not there yet); large
+        // files are streamed rather than read into memory.
+        ObjectId sha1 = hash_file_object(file_path_to_add, "blob", true);
 
-        // 3. Get file mode
+        // 2. Get file mode
         mode_t mode_raw = get_file_mode(file_path_to_add);
          if (mode_raw == 0) {
-              std::cerr << "Warning: Could not determine mode for file: " << file_path_to_add << ". Using default 100644." << std::endl;
+              result.warning = "Warning: Could not determine mode for file: " + file_path_to_add + ". Using default 100644.";
               mode_raw = 0100644; // Default to non-executable
          }
          // Skip adding directories themselves to index (Git doesn't store empty dirs)
          if (mode_raw == 0040000) {
-             return true; // Successfully skipped directory placeholder
+             result.skip = true; // Successfully skipped directory placeholder
+             return result;
          }
 
         std::stringstream ss;
         ss << std::oct << mode_raw;
-        std::string mode_str = ss.str();
-
-        // 4. Prepare index entry (stage 0)
-        IndexEntry entry;
-        entry.mode = mode_str;
-        entry.sha1 = sha1;
-        entry.stage = 0;
-        entry.path = file_path_to_add; // Use the relative path passed in
-
-        // 5. Add/Update entry in the index map
-        remove_entry(index_map, file_path_to_add, 1);
-        remove_entry(index_map, file_path_to_add, 2);
-        remove_entry(index_map, file_path_to_add, 3);
-        add_or_update_entry(index_map, entry);
-        // std::cout << "DEBUG_ADD: Added/Updated " << file_path_to_add << std::endl;
 
+        // 3. Prepare index entry (stage 0)
+        result.entry.mode = ss.str();
+        result.entry.sha1 = sha1;
+        result.entry.stage = 0;
+        result.entry.path = file_path_to_add; // Use the relative path passed in
+        if (have_stat) result.entry.stat = file_stat;
     } catch (const std::exception& e) {
-        std::cerr << "Error adding file '" << file_path_to_add << "': " << e.what() << std::endl;
-        return false; // Indicate error for this specific file
+        result.ok = false;
+        result.error = e.what();
     }
-    return true; // Success for this file
+    return result;
+}
+
+// Parses the value of -j/--jobs; 0 means "one per core".
+bool parse_jobs_value(const std::string& value, int& jobs) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 4) return false;
+    jobs = std::stoi(value);
+    return true;
 }
 
-int handle_add(const std::vector<std::string>& files_to_add) {
+} // namespace
+
+int handle_add(const std::vector<std::string>& args) {
+    int jobs = 0;
+    bool force = false;
+    std::vector<std::string> files_to_add;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        std::string value;
+        bool is_jobs = true;
+        if (arg == "-f" || arg == "--force") {
+            force = true;
+            continue;
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (i + 1 >= args.size()) {
+                std::cerr << "fatal: option '" << arg << "' requires a value" << std::endl;
+                return 1;
+            }
+            value = args[++i];
+        } else if (arg.rfind("--jobs=", 0) == 0) {
+            value = arg.substr(7);
+        } else if (arg.size() > 2 && arg.rfind("-j", 0) == 0) {
+            value = arg.substr(2);
+        } else {
+            is_jobs = false;
+            files_to_add.push_back(arg);
+        }
+        if (is_jobs && !parse_jobs_value(value, jobs)) {
+            std::cerr << "fatal: invalid number of jobs '" << value << "'" << std::endl;
+            return 1;
+        }
+    }
+
     if (files_to_add.empty()) {
         std::cerr << "Nothing specified, nothing added." << std::endl;
         std::cerr << "Maybe you wanted to say 'mygit add .'?" << std::endl;
         return 1;
     }
 
-    IndexMap index = read_index(); // Read index once
-    std::set<std::string> processed_files; // Track files actually added/attempted
+    Index index = read_index(); // Read index once
     bool errors_encountered = false;
-
-    std::vector<std::string> paths_to_process = files_to_add; // Start with arguments
+    // Untracked paths matching .gitignore / info/exclude are left out of
+    // directories, and refused when named explicitly, unless forced.
+    IgnoreRules ignore;
+    std::vector<std::string> ignored_paths;
+    auto is_untracked_and_ignored = [&](const std::string& path, bool is_dir) {
+        if (force) return false;
+        if (is_dir) return ignore.is_ignored(path, true);
+        return !index.contains(path) && ignore.is_ignored(path, false);
+    };
 
     // --- Expand directories ---
     // We might need a temporary vector to avoid modifying while iterating if we used range-based for
     std::vector<std::string> final_file_list;
     std::vector<std::string> current_paths = files_to_add; // Start with arguments
+    size_t explicit_count = current_paths.size();
 
     // Basic '.' expansion (add everything in current dir)
      if (std::find(current_paths.begin(), current_paths.end(), ".") != current_paths.end()) {
          std::cout << "Expanding '.' ..." << std::endl;
          // Remove '.' itself
          current_paths.erase(std::remove(current_paths.begin(), current_paths.end(), "."), current_paths.end());
+         explicit_count = current_paths.size();
          // Add contents of current directory (respecting ignores later)
          try {
               for (const auto& entry : fs::directory_iterator(".")) {
@@ -176,8 +263,19 @@ int handle_add(const std::vector<std::string>& files_to_add) {
      }
 
 
+    // Files under an ignored directory are still updated if tracked.
+    auto add_tracked_below = [&](const std::string& dir) {
+        std::string prefix = dir + "/";
+        for (size_t i = index.lower_bound(prefix); i < index.size() && index[i].path().compare(0, prefix.size(), prefix) == 0; ++i) {
+            std::string tracked(index[i].path());
+            if (index[i].stage == 0 && fs::exists(fs::symlink_status(tracked))) final_file_list.push_back(tracked);
+        }
+    };
+
     // Expand directories recursively and collect file paths
-    for (const std::string& path_arg : current_paths) {
+    for (size_t arg_index = 0; arg_index < current_paths.size(); ++arg_index) {
+         const std::string& path_arg = current_paths[arg_index];
+         bool named_explicitly = arg_index < explicit_count;
          fs::path current_fs_path = path_arg;
          std::string relative_path = current_fs_path.lexically_normal().generic_string();
 
@@ -187,7 +285,16 @@ int handle_add(const std::vector<std::string>& files_to_add) {
             continue;
         }
 
-        if (fs::is_directory(current_fs_path)) {
+        bool is_dir = fs::is_directory(current_fs_path);
+        if (relative_path != GIT_DIR && !force &&
+            (named_explicitly ? (!index.contains(relative_path) && ignore.is_ignored_with_parents(relative_path, is_dir))
+                              : is_untracked_and_ignored(relative_path, is_dir))) {
+            if (named_explicitly) ignored_paths.push_back(relative_path);
+            if (is_dir) add_tracked_below(relative_path);
+            continue;
+        }
+
+        if (is_dir) {
              // --- RECURSIVE DIRECTORY ADD ---
              try {
                 // Iterate recursively
@@ -199,15 +306,17 @@ int handle_add(const std::vector<std::string>& files_to_add) {
                           if (sub_relative_path.empty() || sub_relative_path == ".") continue;
                       } catch (...) { continue; }
 
-                     // Basic ignore check (can be expanded)
+                     bool sub_is_dir = it->is_directory() && !it->is_symlink();
                      bool ignored = false;
                      if (sub_relative_path == GIT_DIR || sub_relative_path.rfind(GIT_DIR + "/", 0) == 0) {
                          ignored = true;
+                     } else if (is_untracked_and_ignored(sub_relative_path, sub_is_dir)) {
+                         ignored = true;
+                         if (sub_is_dir) add_tracked_below(sub_relative_path);
                      }
-                     // TODO: Add .gitignore check here
 
                      if (ignored) {
-                         if (it->is_directory()) {
+                         if (sub_is_dir) {
                              it.disable_recursion_pending(); // Don't go into ignored dirs
                          }
                          continue;
@@ -232,12 +341,45 @@ int handle_add(const std::vector<std::string>& files_to_add) {
 
 
     // --- Process the final list of files ---
+    // Blobs are read, hashed, compressed and written by a pool of workers, each
+    // taking one file at a time, so at most one file per worker is in memory.
+    // The index is only touched below, in list order, which keeps the result
+    // (and the messages) the same whatever the thread count.
     std::cout << "Adding " << final_file_list.size() << " file(s) to index..." << std::endl;
-    for (const std::string& final_file_path : final_file_list) {
-         // Use the helper function to add each file
-         if (!add_single_file_to_index(final_file_path, index)) {
-             errors_encountered = true; // Track if any individual add failed
-         }
+    std::vector<StagedFile> staged(final_file_list.size());
+    // The token stays as it is: status, which checks every entry, moves it on.
+    std::optional<FsmonitorChanges> fsmonitor;
+    if (!index.fsmonitor_token().empty() && fsmonitor_configured()) fsmonitor = query_fsmonitor(index.fsmonitor_token());
+    const FsmonitorChanges* changes = fsmonitor && fsmonitor->complete ? &*fsmonitor : nullptr;
+    try {
+        get_packs(); // Map packs up front rather than from the first worker to miss
+        parallel_for(final_file_list.size(), resolve_thread_count(jobs),
+                     [&](size_t i) { staged[i] = stage_file_for_add(final_file_list[i], index, changes); });
+    } catch (const std::exception& e) {
+        std::cerr << "Error adding files: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<size_t> to_apply;
+    for (size_t i = 0; i < staged.size(); ++i) {
+        const StagedFile& result = staged[i];
+        if (!result.warning.empty()) std::cerr << result.warning << std::endl;
+        if (!result.ok) {
+            std::cerr << "Error adding file '" << final_file_list[i] << "': " << result.error << std::endl;
+            errors_encountered = true; // Track if any individual add failed
+            continue;
+        }
+        if (!result.skip) to_apply.push_back(i);
+    }
+    // Applied in path order, so new paths mostly land at the end of the index.
+    std::stable_sort(to_apply.begin(), to_apply.end(),
+                     [&](size_t a, size_t b) { return staged[a].entry.path < staged[b].entry.path; });
+    for (size_t i : to_apply) {
+        const IndexEntry& entry = staged[i].entry;
+        index.remove(entry.path, 1);
+        index.remove(entry.path, 2);
+        index.remove(entry.path, 3);
+        index.add_or_update(entry);
     }
 
 
@@ -250,11 +392,18 @@ int handle_add(const std::vector<std::string>& files_to_add) {
             std::cerr << "Error writing index file: " << e.what() << std::endl;
             return 1; // Fail hard if index cannot be written
         }
-    } else if (!errors_encountered) {
+    } else if (!errors_encountered && ignored_paths.empty()) {
          std::cerr << "Nothing specified, nothing added." << std::endl; // Case where only non-existent files were given
          return 1;
     }
 
+    if (!ignored_paths.empty()) {
+        std::cerr << "The following paths are ignored by one of your .gitignore files:" << std::endl;
+        for (const std::string& path : ignored_paths) std::cerr << path << std::endl;
+        std::cerr << "Use -f if you really want to add them." << std::endl;
+        return 1;
+    }
+
     // Return 0 if successful or partially successful (Git often returns 0 even if some paths fail)
     // Return 1 only for major errors like cannot write index, or maybe if *all* paths failed?
     // Let's return 0 unless index write fails.
@@ -269,7 +418,7 @@ int handle_rm(const std::vector<std::string>& files_to_remove, bool cached_mode)
         return 1;
     }
 
-     IndexMap index = read_index();
+     Index index = read_index();
      bool changes_made = false;
 
      for (const std::string& filepath_arg : files_to_remove) {
@@ -277,14 +426,14 @@ int handle_rm(const std::vector<std::string>& files_to_remove, bool cached_mode)
           std::string relative_path = filepath.lexically_normal().generic_string();
 
           // Check if file is actually in the index
-          auto it = index.find(relative_path);
-          if (it == index.end() || it->second.empty()) {
+          index.expand_to(relative_path);
+          if (!index.contains(relative_path)) {
                std::cerr << "fatal: pathspec '" << relative_path << "' did not match any files" << std::endl;
                continue; // Git continues
           }
 
            // Remove entry from index (all stages)
-           remove_entry(index, relative_path, -1); // -1 removes all stages
+           index.remove(relative_path); // All stages
            changes_made = true;
 
            // If not --cached, remove from working directory
@@ -318,84 +467,9 @@ int handle_rm(const std::vector<std::string>& files_to_remove, bool cached_mode)
     return 0;
 }
 
-// --- Recursive Helper for write-tree ---
-// Takes index entries relevant to a specific directory level (relative paths)
-// Returns the SHA1 of the created tree object for this level
-std::string build_tree_recursive(const std::vector<IndexEntry>& entries_for_level) {
-    std::cout << "DEBUG_BUILD_TREE: ENTERING build_tree_recursive. Entry count = " << entries_for_level.size() << std::endl;
-    if (!entries_for_level.empty()) {
-        std::cout << "DEBUG_BUILD_TREE: First entry path = " << entries_for_level[0].path << std::endl;
-    }
-
-    // Maps to hold entries categorized for this level
-    std::map<std::string, TreeEntry> files_in_level; // key=basename, value=TreeEntry
-    std::map<std::string, std::vector<IndexEntry>> dirs_in_level; // key=dirname, value=vector of entries for that dir
-
-    // Categorize entries passed to this function
-    for (const IndexEntry& entry : entries_for_level) {
-        size_t slash_pos = entry.path.find('/');
-        if (slash_pos == std::string::npos) { // File/link/placeholder at this level
-             if (entry.mode == "100644" || entry.mode == "100755" || entry.mode == "120000") {
-                 // Use entry.path as the key since it's just the basename here
-                 files_in_level[entry.path] = {entry.mode, entry.path, entry.sha1};
-                 std::cout << "DEBUG_BUILD_TREE: Categorized FILE: " << entry.path << std::endl;
-             } else {
-                 std::cout << "DEBUG_BUILD_TREE: Ignoring non-file/link entry at this level: " << entry.path << " Mode=" << entry.mode << std::endl;
-             }
-        } else { // Belongs in a subdirectory
-            std::string dir_name = entry.path.substr(0, slash_pos);
-            std::string rest_of_path = entry.path.substr(slash_pos + 1);
-
-            IndexEntry sub_entry = entry;
-            sub_entry.path = rest_of_path; // Adjust path for recursive call
-            dirs_in_level[dir_name].push_back(sub_entry);
-            std::cout << "DEBUG_BUILD_TREE: Categorized DIR entry: " << dir_name << "/" << rest_of_path << std::endl;
-        }
-    }
-
-    // ===> PROBLEM AREA LIKELY HERE <===
-    // Build the TreeEntry vector for the tree object *at this level*
-    std::vector<TreeEntry> current_level_tree_entries;
-
-    // Add entries for the files directly in this directory
-    for (const auto& pair : files_in_level) {
-        current_level_tree_entries.push_back(pair.second);
-        std::cout << "DEBUG_BUILD_TREE: Added file entry to current level: " << pair.second.name << std::endl;
-    }
-
-    // Recursively build subdirectories and add entries for them
-    for (auto const& [dir_name, subdir_entries] : dirs_in_level) { // Use structured binding (C++17)
-         if (subdir_entries.empty()){
-             std::cerr << "Warning: Directory map has empty entry list for " << dir_name << " - skipping." << std::endl;
-             continue;
-         }
-        std::cout << "DEBUG_BUILD_TREE: Recursing into directory: " << dir_name << " with " << subdir_entries.size() << " sub-entries." << std::endl;
-        std::string sub_tree_sha = build_tree_recursive(subdir_entries); // Recursive call
-        if (sub_tree_sha.empty()){
-             std::cerr << "Warning: Recursive call for directory " << dir_name << " returned empty SHA - skipping." << std::endl;
-             continue;
-        }
-        // Add entry for the SUBDIRECTORY itself
-        current_level_tree_entries.push_back({"40000", dir_name, sub_tree_sha});
-         std::cout << "DEBUG_BUILD_TREE: Added directory entry to current level: " << dir_name << " -> " << sub_tree_sha.substr(0,7) << std::endl;
-    }
-    // ===> END PROBLEM AREA LIKELY HERE <===
-
-     // Debug: How many entries are we passing to format?
-     std::cout << "DEBUG_BUILD_TREE: Passing " << current_level_tree_entries.size() << " entries to format_tree_content." << std::endl;
-
-    // Format, hash, and write the tree for this level
-    std::string tree_content = format_tree_content(current_level_tree_entries); // Use the simplified version for now
-    std::cout << "DEBUG_BUILD_TREE: Level content size=" << tree_content.size() << std::endl;
-
-    std::string result_sha = hash_and_write_object("tree", tree_content);
-    std::cout << "DEBUG_BUILD_TREE: hash_and_write_object returned SHA = " << result_sha << std::endl;
-    return result_sha;
-}
-
 // --- write-tree ---
 int handle_write_tree() {
-    IndexMap index = read_index();
+    Index index = read_index();
     if (index.empty()) {
         // Git allows writing an empty tree, useful for initial commits
         // std::cerr << "Error: Index is empty. Nothing to write." << std::endl;
@@ -403,30 +477,20 @@ int handle_write_tree() {
     }
 
     // Check for unmerged entries (conflicts)
-    std::vector<IndexEntry> root_entries;
-    for (const auto& path_pair : index) {
-        bool conflicted = false;
-        for (const auto& stage_pair : path_pair.second) {
-            if (stage_pair.first > 0) {
-                conflicted = true;
-                break;
-            }
-        }
-        if (conflicted) {
-             std::cerr << "error: Path '" << path_pair.first << "' is unmerged." << std::endl;
+    for (const IndexRecord& rec : index) {
+        if (rec.stage > 0) {
+             std::cerr << "error: Path '" << rec.path() << "' is unmerged." << std::endl;
              std::cerr << "fatal: Cannot write tree with unmerged paths." << std::endl;
              return 1;
         }
-        // Add stage 0 entry if present
-        auto stage0_it = path_pair.second.find(0);
-        if (stage0_it != path_pair.second.end()) {
-             root_entries.push_back(stage0_it->second);
-        }
     }
 
     try {
-        // Start recursive build from the root
-        std::string root_tree_sha = build_tree_recursive(root_entries);
+        // Only directories changed since the last write-tree are rebuilt;
+        // the refreshed cache is saved with the index.
+        bool cache_updated = false;
+        ObjectId root_tree_sha = index.write_tree(&cache_updated);
+        if (cache_updated) write_index(index);
         std::cout << root_tree_sha << std::endl; // Output the ROOT tree SHA
         return 0;
     } catch (const std::exception& e) {
@@ -439,147 +503,62 @@ int handle_write_tree() {
 // --- read-tree ---
 int handle_read_tree(const std::string& tree_sha_prefix, bool update_workdir, bool merge_mode) {
     // 1. Resolve tree SHA
-    std::optional<std::string> tree_sha_opt = resolve_ref(tree_sha_prefix);
+    std::optional<ObjectId> tree_sha_opt = resolve_ref_id(tree_sha_prefix);
     if (!tree_sha_opt) { std::cerr << "fatal: Not a valid tree object name: " << tree_sha_prefix << std::endl; return 1; }
-    std::string tree_sha = *tree_sha_opt;
-
-    // 2. Get target tree contents (recursively)
-    // Stores { "full/path": "sha1" }
-    std::map<std::string, std::string> target_tree_contents;
-    // We also need mode info for checkout, so let's modify read_tree_contents or use a different approach
-    // For simplicity now, let's re-parse the tree during checkout logic.
-    // We still need the flat list for comparison.
-     try {
-         // Ensure it's actually a tree first
-         ParsedObject root_obj = read_object(tree_sha);
-         if(root_obj.type != "tree") {
-              std::cerr << "fatal: Object " << tree_sha << " is not a tree." << std::endl;
-              return 1;
-         }
-        target_tree_contents = read_tree_contents(tree_sha); // Get flat list for comparison/index update
-     } catch (const std::exception& e) {
-         std::cerr << "fatal: Failed to read target tree " << tree_sha << ": " << e.what() << std::endl;
-         return 1;
-     }
-
-
-    // 3. Read current index (needed for comparison if updating workdir)
-    IndexMap old_index_map = read_index(); // Read before modifying
-    IndexMap new_index_map; // Build the new index state
-
-    // 4. Populate the new index map based on target tree
-    // This requires reading the tree structure again to get modes.
-    // Could optimize by having read_tree_contents return mode info too.
-    std::function<void(const std::string&, const std::string&)> populate_index_recursive =
-        [&](const std::string& current_tree_sha, const std::string& path_prefix)
-    {
-         try {
-            ParsedObject tree_obj_parsed = read_object(current_tree_sha);
-            if (tree_obj_parsed.type != "tree") return; // Skip non-trees
-            const auto& tree_data = std::get<TreeObject>(tree_obj_parsed.data);
-
-            for (const auto& entry : tree_data.entries) {
-                std::string full_path = path_prefix.empty() ? entry.name : path_prefix + "/" + entry.name;
-                if (entry.mode == "40000") { // Subtree
-                    populate_index_recursive(entry.sha1, full_path);
-                } else { // Blob or Symlink
-                    IndexEntry new_entry;
-                    new_entry.mode = entry.mode;
-                    new_entry.path = full_path;
-                    new_entry.sha1 = entry.sha1;
-                    new_entry.stage = 0;
-                    add_or_update_entry(new_index_map, new_entry);
-                }
-            }
-         } catch (...) { /* Ignore errors reading subtrees */ }
-    };
-
-    populate_index_recursive(tree_sha, ""); // Populate new_index_map
-
-    // 5. Update working directory if requested (-u)
-    if (update_workdir) {
-        std::cout << "Updating workdir to match tree " << tree_sha.substr(0, 7) << "..." << std::endl;
-        IndexMap old_index_map = read_index(); // Read old index ONLY if updating workdir
-        std::set<std::string> processed_paths;
-
-        // 5a. Deletions
-        std::map<std::string, IndexEntry> old_index_stage0;
-         for(const auto& pair : old_index_map) {
-              if(pair.second.count(0)) old_index_stage0[pair.first] = pair.second.at(0);
-         }
-        for (const auto& old_pair : old_index_stage0) {
-            const std::string& path = old_pair.first;
-            if (new_index_map.find(path) == new_index_map.end()) {
-                try {
-                   if (file_exists(path)) {
-                       std::cout << "  Deleting " << path << std::endl;
-                       fs::remove(path);
-                       processed_paths.insert(path);
-                   }
-                } catch (...) { /* Warning */ }
-            }
+    ObjectId tree_sha = *tree_sha_opt;
+
+    // 2. Build the new index from the target tree. Directories whose tree is
+    //    unchanged from the current index's cached tree are copied over
+    //    without being read, so only the paths that differ are listed.
+    Index old_index = read_index(); // Read before modifying
+    Index new_index;
+    std::vector<std::string> changed_paths;
+    try {
+        // Ensure it's actually a tree first
+        if (read_object_header(tree_sha).type != "tree") {
+            std::cerr << "fatal: Object " << tree_sha << " is not a tree." << std::endl;
+            return 1;
         }
+        // With a sparse index, directories outside the cone are not read.
+        std::optional<SparseCone> cone = load_sparse_cone();
+        std::function<bool(std::string_view)> collapse;
+        if (cone && sparse_index_enabled()) collapse = [&](std::string_view dir) { return !cone->reaches(dir); };
+        new_index = Index::from_tree(tree_sha, &old_index, &changed_paths, collapse);
+        apply_sparse_cone(new_index, cone ? &*cone : nullptr);
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: Failed to read target tree " << tree_sha << ": " << e.what() << std::endl;
+        return 1;
+    }
 
-        // 5b. Additions/Updates
-        for (const auto& new_pair : new_index_map) {
-            const std::string& path = new_pair.first;
-            const IndexEntry& new_entry = new_pair.second.at(0);
-            processed_paths.insert(path);
-            bool needs_update = false;
-            if (!file_exists(path)) { needs_update = true; }
-            else { /* Check SHA and mode */
-                try {
-                     std::string current_sha = get_workdir_sha(path); // Use helper
-                     if (current_sha.empty() || current_sha != new_entry.sha1) {
-                          needs_update = true;
-                     } else {
-                          mode_t current_mode_raw = get_file_mode(path);
-                          std::stringstream ss; ss << std::oct << current_mode_raw;
-                          std::string current_mode_str = ss.str();
-                          if (current_mode_str != new_entry.mode && current_mode_raw != 0) {
-                               needs_update = true;
-                               std::cout << "  Updating mode for " << path << std::endl;
-                          }
-                     }
-                } catch (...) { needs_update = true; }
-            }
-
-            if (needs_update) {
-                try {
-                     std::cout << "  Checking out " << path << std::endl;
-                     ensure_parent_directory_exists(path);
-                     ParsedObject blob_obj = read_object(new_entry.sha1);
-                     if (blob_obj.type != "blob") { /* Warning */ continue; }
-                     const std::string& content = std::get<BlobObject>(blob_obj.data).content;
-                     write_file(path, content);
-                     set_file_executable(path, new_entry.mode == "100755");
-                } catch (const std::exception& e) { /* Error */ /* Maybe return 1 here? */ }
-            }
+    // 3. Update working directory if requested (-u)
+    bool workdir_ok = true;
+    if (update_workdir) {
+        std::cout << "Updating workdir to match tree " << tree_sha.short_hex() << "..." << std::endl;
+        try {
+            workdir_ok = checkout_index(old_index, new_index, &changed_paths);
+        } catch (const std::exception& e) {
+            std::cerr << "Error updating working directory: " << e.what() << std::endl;
+            return 1;
         }
-        // Workdir update logic finished.
-
-        // *** Since workdir update IS implemented now, we only return 1 on actual error. ***
-        // *** Comment out or remove the explicit return 1 for unimplemented feature ***
-        // std::cerr << "Warning: read-tree working directory update (-u) is not fully robust yet." << std::endl;
-        // return 1; // Remove this line if the basic implementation above is considered done
-
-    } 
+    }
 
 
-    // 6. Write the final index (reflecting the target tree)
+    // 4. Write the final index (reflecting the target tree)
     try {
         // If merging, this logic needs to be different (3-way merge)
         if (merge_mode) {
              std::cerr << "Error: read-tree merge update logic not fully implemented." << std::endl;
              return 1; // Don't write index in merge mode yet
         }
-        write_index(new_index_map); // Write the index reflecting the target tree
+        write_index(new_index); // Write the index reflecting the target tree
     } catch (const std::exception& e) {
         std::cerr << "Error writing final index: " << e.what() << std::endl;
         return 1;
     }
 
-    return 0; // Success
+    // Paths that could not be checked out were reported; the index still
+    // describes the target tree, so status shows them as modified.
+    return workdir_ok ? 0 : 1;
 }
 
 // --- status ---
@@ -700,6 +679,224 @@ std::string read_current_branch_or_commit() {
     return "(unknown)";
 }
 
+// --- diff ---
+namespace {
+
+// Line width --stat fits its output to, as Git does when not on a terminal.
+const size_t STAT_WIDTH = 80;
+// Bytes looked at for a NUL when deciding a file is binary, as in Git.
+const size_t BINARY_CHECK_SIZE = 8000;
+
+// The tree of a commit, tag or tree name; nullopt (after an error message)
+// if it names none.
+std::optional<ObjectId> resolve_diff_tree(const std::string& name) {
+    std::optional<ObjectId> id = resolve_ref_id(name);
+    if (!id) {
+        std::cerr << "fatal: bad revision '" << name << "'" << std::endl;
+        return std::nullopt;
+    }
+    try {
+        for (;;) {
+            ParsedObject obj = read_object(*id);
+            if (obj.type == "tree") return id;
+            if (obj.type == "commit") id = std::get<CommitObject>(obj.data).tree_sha1;
+            else if (obj.type == "tag") id = std::get<TagObject>(obj.data).object_sha1;
+            else break;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return std::nullopt;
+    }
+    std::cerr << "fatal: '" << name << "' does not name a commit or tree" << std::endl;
+    return std::nullopt;
+}
+
+// One side's content for --stat: the blob, or the working tree file when
+// that side is the working tree.
+std::string diff_side_content(const ObjectId& oid, uint32_t mode, const std::string& workdir_path) {
+    if (mode == 0 || mode == 0160000) return ""; // Missing, or a submodule
+    if (!workdir_path.empty()) {
+        if (mode == 0120000) return fs::read_symlink(workdir_path).generic_string();
+        return read_file(workdir_path);
+    }
+    RawObject blob = read_raw_object(oid);
+    return std::move(blob.content);
+}
+
+bool is_binary_content(std::string_view content) {
+    return content.substr(0, BINARY_CHECK_SIZE).find('\0') != std::string_view::npos;
+}
+
+// Git's scaling of a --stat graph segment to `width` columns.
+size_t scale_graph(size_t count, size_t width, size_t max_change) {
+    return count == 0 ? 0 : 1 + count * (width - 1) / max_change;
+}
+
+size_t decimal_width(size_t n) {
+    return std::to_string(n).size();
+}
+
+void print_diff_stat(const std::vector<DiffEntry>& entries, bool new_in_workdir) {
+    struct StatLine {
+        std::string path;
+        bool binary = false;
+        bool unmerged = false;
+        size_t added = 0;
+        size_t deleted = 0;
+        size_t old_size = 0;
+        size_t new_size = 0;
+    };
+    std::vector<StatLine> lines;
+    size_t total_added = 0;
+    size_t total_deleted = 0;
+    for (const DiffEntry& entry : entries) {
+        StatLine line;
+        line.path = entry.path;
+        if (entry.status == 'U') {
+            line.unmerged = true;
+        } else {
+            std::string old_content = diff_side_content(entry.old_sha1, entry.old_mode, "");
+            std::string new_content = diff_side_content(entry.new_sha1, entry.new_mode, new_in_workdir ? entry.path : "");
+            line.binary = is_binary_content(old_content) || is_binary_content(new_content);
+            line.old_size = old_content.size();
+            line.new_size = new_content.size();
+            if (!line.binary) count_line_changes(old_content, new_content, line.added, line.deleted);
+            total_added += line.added;
+            total_deleted += line.deleted;
+        }
+        lines.push_back(std::move(line));
+    }
+    if (lines.empty()) return;
+
+    // Column widths as Git works them out: the graph gets what the longest
+    // name leaves, but at least 3/8 of the line, and is scaled to fit.
+    size_t name_width = 0;
+    size_t max_change = 0;
+    size_t number_width = 0;
+    size_t bin_width = 0;
+    for (const StatLine& line : lines) {
+        name_width = std::max(name_width, line.path.size());
+        if (line.binary) {
+            bin_width = std::max(bin_width, 14 + decimal_width(line.old_size) + decimal_width(line.new_size));
+            number_width = 3;
+        }
+        max_change = std::max(max_change, line.added + line.deleted);
+    }
+    number_width = std::max(number_width, decimal_width(max_change));
+    size_t width = std::max(STAT_WIDTH, 16 + 6 + number_width);
+    size_t graph_width = max_change + 4 > bin_width ? max_change : bin_width - 4;
+    if (name_width + number_width + 6 + graph_width > width) {
+        if (graph_width + number_width + 6 > width * 3 / 8) {
+            graph_width = width * 3 / 8 > number_width + 6 + 6 ? width * 3 / 8 - number_width - 6 : 6;
+        }
+        if (name_width > width - number_width - 6 - graph_width) name_width = width - number_width - 6 - graph_width;
+        else graph_width = width - number_width - 6 - name_width;
+    }
+
+    for (const StatLine& line : lines) {
+        // Names that do not fit lose their start, up to a slash.
+        std::string name = line.path;
+        if (name.size() > name_width) {
+            name = name.substr(name.size() - (name_width > 3 ? name_width - 3 : 0));
+            size_t slash = name.find('/');
+            if (slash != std::string::npos) name.erase(0, slash);
+            name = "..." + name;
+        }
+        std::cout << " " << name << std::string(name_width > name.size() ? name_width - name.size() : 0, ' ') << " | ";
+        if (line.unmerged) {
+            std::cout << "Unmerged" << std::endl;
+            continue;
+        }
+        if (line.binary) {
+            std::cout << "Bin " << line.old_size << " -> " << line.new_size << " bytes" << std::endl;
+            continue;
+        }
+        std::string count = std::to_string(line.added + line.deleted);
+        size_t added = line.added;
+        size_t deleted = line.deleted;
+        if (graph_width <= max_change) {
+            size_t total = scale_graph(added + deleted, graph_width, max_change);
+            if (total < 2 && added && deleted) total = 2;
+            if (added < deleted) {
+                added = scale_graph(added, graph_width, max_change);
+                deleted = total - added;
+            } else {
+                deleted = scale_graph(deleted, graph_width, max_change);
+                added = total - deleted;
+            }
+        }
+        std::cout << std::string(number_width - count.size(), ' ') << count;
+        if (added + deleted > 0) std::cout << " " << std::string(added, '+') << std::string(deleted, '-');
+        std::cout << std::endl;
+    }
+    std::cout << " " << lines.size() << (lines.size() == 1 ? " file changed" : " files changed");
+    if (total_added > 0 || total_deleted == 0) {
+        std::cout << ", " << total_added << (total_added == 1 ? " insertion(+)" : " insertions(+)");
+    }
+    if (total_deleted > 0 || total_added == 0) {
+        std::cout << ", " << total_deleted << (total_deleted == 1 ? " deletion(-)" : " deletions(-)");
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int handle_diff(const std::vector<std::string>& args) {
+    bool cached = false;
+    bool stat = false;
+    bool bad_option = false;
+    std::vector<std::string> revisions;
+    for (const std::string& arg : args) {
+        if (arg == "--cached" || arg == "--staged") cached = true;
+        else if (arg == "--stat") stat = true;
+        else if (arg == "--name-status") stat = false;
+        else if (arg.empty() || arg[0] == '-') bad_option = true;
+        else revisions.push_back(arg);
+    }
+    if (bad_option || revisions.size() > 2 || (cached && revisions.size() > 1) || (!cached && revisions.size() == 1)) {
+        std::cerr << "Usage: mygit diff [--name-status | --stat] [--cached [<commit>] | <commit> <commit>]" << std::endl;
+        return 1;
+    }
+
+    std::vector<DiffEntry> entries;
+    auto collect = [&](const DiffEntry& entry) { entries.push_back(entry); };
+    bool new_in_workdir = false;
+    try {
+        if (revisions.size() == 2) {
+            std::optional<ObjectId> old_tree = resolve_diff_tree(revisions[0]);
+            std::optional<ObjectId> new_tree = old_tree ? resolve_diff_tree(revisions[1]) : std::nullopt;
+            if (!new_tree) return 128;
+            diff_trees(*old_tree, *new_tree, collect);
+        } else if (cached) {
+            // Against HEAD by default; before the first commit, everything is new.
+            ObjectId tree;
+            if (!revisions.empty()) {
+                std::optional<ObjectId> resolved = resolve_diff_tree(revisions[0]);
+                if (!resolved) return 128;
+                tree = *resolved;
+            } else if (resolve_ref_id("HEAD")) {
+                std::optional<ObjectId> resolved = resolve_diff_tree("HEAD");
+                if (!resolved) return 128;
+                tree = *resolved;
+            }
+            diff_tree_to_index(tree, read_index(), collect);
+        } else {
+            diff_index_to_workdir(read_index(), collect);
+            new_in_workdir = true;
+        }
+
+        if (stat) {
+            print_diff_stat(entries, new_in_workdir);
+        } else {
+            for (const DiffEntry& entry : entries) std::cout << entry.status << '\t' << entry.path << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 // --- log ---
 int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name_opt) {
     std::string ref_to_resolve = "HEAD";
@@ -708,7 +905,7 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
     }
 
     // Resolve the starting reference to a commit SHA
-    std::optional<std::string> start_sha_opt = resolve_ref(ref_to_resolve);
+    std::optional<ObjectId> start_sha_opt = resolve_ref_id(ref_to_resolve);
     if (!start_sha_opt) {
         // Give a more specific error message depending on whether a ref was provided
         if (start_ref_name_opt) {
@@ -720,35 +917,35 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
         return 1;
     }
 
-    std::string start_sha = *start_sha_opt;
-    std::set<std::string> visited; // Prevent infinite loops and re-processing
-    std::queue<std::string> q;     // Use queue for breadth-first-like traversal
-    std::map<std::string, std::vector<std::string>> adj; // For graph edges: child -> {parents}
-    std::map<std::string, std::string> node_labels; // For graph node labels
+    ObjectId start_sha = *start_sha_opt;
+    std::unordered_set<ObjectId> visited; // Prevent infinite loops and re-processing
+    std::map<ObjectId, std::vector<ObjectId>> adj; // For graph edges: child -> {parents}
+    std::map<ObjectId, std::string> node_labels; // For graph node labels
     // Store commits in order for non-graph mode (BFS might mess order)
-    std::vector<std::pair<std::string, CommitObject>> commit_log_order;
-    std::set<std::string> added_to_log_order; // Ensure unique entries in log order
+    std::vector<std::pair<ObjectId, std::shared_ptr<const ParsedObject>>> commit_log_order;
+    std::unordered_set<ObjectId> added_to_log_order; // Ensure unique entries in log order
 
 
     // --- Use a modified traversal that respects parent order for non-graph mode ---
-    std::vector<std::string> commit_stack; // Use a stack for DFS-like traversal for chronological order
+    std::vector<ObjectId> commit_stack; // Use a stack for DFS-like traversal for chronological order
     commit_stack.push_back(start_sha);
     visited.insert(start_sha); // Mark as visited *before* processing
 
 
     // --- Collect all reachable commits first (for graph mode and ordering) ---
-    std::queue<std::string> bfs_q;
-    std::set<std::string> reachable_commits;
+    std::queue<ObjectId> bfs_q;
+    std::unordered_set<ObjectId> reachable_commits;
     bfs_q.push(start_sha);
     reachable_commits.insert(start_sha);
 
     while(!bfs_q.empty()){
-        std::string current_sha_bfs = bfs_q.front();
+        ObjectId current_sha_bfs = bfs_q.front();
         bfs_q.pop();
         try {
-            ParsedObject parsed_obj = read_object(current_sha_bfs);
-             if (parsed_obj.type == "commit") {
-                  const auto& commit = std::get<CommitObject>(parsed_obj.data);
+            // Goes through the object cache, so the display pass below re-reads nothing.
+            std::shared_ptr<const ParsedObject> parsed_obj = read_object_cached(current_sha_bfs);
+             if (parsed_obj->type == "commit") {
+                  const auto& commit = std::get<CommitObject>(parsed_obj->data);
                   for(const auto& p : commit.parent_sha1s) {
                       if(reachable_commits.find(p) == reachable_commits.end()) {
                            reachable_commits.insert(p);
@@ -763,27 +960,27 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
 
     // --- Process commits using DFS stack for chronological display ---
     while (!commit_stack.empty()) {
-        std::string current_sha = commit_stack.back(); // Peek
+        ObjectId current_sha = commit_stack.back(); // Peek
         // If not visited for processing yet, process it
         if (added_to_log_order.find(current_sha) == added_to_log_order.end()) {
             try {
-                ParsedObject parsed_obj = read_object(current_sha);
-                if (parsed_obj.type != "commit") {
-                    std::cerr << "Warning: Expected commit object, got " << parsed_obj.type << " for SHA " << current_sha << std::endl;
+                std::shared_ptr<const ParsedObject> parsed_obj = read_object_cached(current_sha);
+                if (parsed_obj->type != "commit") {
+                    std::cerr << "Warning: Expected commit object, got " << parsed_obj->type << " for SHA " << current_sha << std::endl;
                     commit_stack.pop_back(); // Remove non-commit from stack
                     continue;
                 }
-                const auto& commit = std::get<CommitObject>(parsed_obj.data);
+                const auto& commit = std::get<CommitObject>(parsed_obj->data);
 
                 // Add to log order list
-                commit_log_order.push_back({current_sha, commit});
+                commit_log_order.push_back({current_sha, parsed_obj});
                 added_to_log_order.insert(current_sha);
 
 
                  // --- Graph Mode Data Collection (still needed regardless of display order) ---
                 if (graph_mode) {
                     std::ostringstream label_ss;
-                    label_ss << current_sha.substr(0, 7) << "\\n"
+                    label_ss << find_unique_abbrev(current_sha) << "\\n"
                              << commit.author_info.substr(0, commit.author_info.find('<')) << "\\n" // Just name
                              << commit.message.substr(0, commit.message.find('\n')); // First line of message
                     node_labels[current_sha] = label_ss.str();
@@ -833,14 +1030,14 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
      // --- Regular Log Output (Iterate through collected log order) ---
      if (!graph_mode) {
          for (const auto& log_entry : commit_log_order) {
-             const std::string& current_sha = log_entry.first;
-             const CommitObject& commit = log_entry.second;
+             const ObjectId& current_sha = log_entry.first;
+             const CommitObject& commit = std::get<CommitObject>(log_entry.second->data);
 
              std::cout << "\033[33mcommit " << current_sha << "\033[0m" << std::endl; // Yellow SHA
              if (commit.parent_sha1s.size() > 1) {
                  std::cout << "Merge:";
                  for(size_t i = 0; i < commit.parent_sha1s.size(); ++i) {
-                      std::cout << " " << commit.parent_sha1s[i].substr(0, 7);
+                      std::cout << " " << find_unique_abbrev(commit.parent_sha1s[i]);
                  }
                  std::cout << std::endl;
              }
@@ -874,10 +1071,10 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
 
          // Print edges
          for (const auto& pair : adj) {
-             const std::string& child = pair.first;
+             const ObjectId& child = pair.first;
               // Ensure the child node was actually created (it should be if in adj)
               if (node_labels.count(child)) {
-                 for (const std::string& parent : pair.second) {
+                 for (const ObjectId& parent : pair.second) {
                       // Ensure the parent node was also created before drawing edge
                       if (node_labels.count(parent)) {
                           std::cout << "  \"" << child << "\" -> \"" << parent << "\";" << std::endl;
@@ -887,16 +1084,16 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
          }
 
          // Add branch pointers
-         std::map<std::string, std::vector<std::string>> commits_to_branches;
+         std::map<ObjectId, std::vector<std::string>> commits_to_branches;
          for (const std::string& branch : list_branches()) {
-             std::optional<std::string> branch_sha = resolve_ref(branch);
+             std::optional<ObjectId> branch_sha = resolve_ref_id(branch);
              // Only point if commit was visited *and is part of the requested history*
              if (branch_sha && node_labels.count(*branch_sha)) {
                  commits_to_branches[*branch_sha].push_back(branch);
              }
          }
          for(const auto& pair : commits_to_branches) {
-              std::string sha = pair.first;
+              std::string sha = pair.first.hex();
               std::string combined_label;
               for(size_t i=0; i < pair.second.size(); ++i) {
                    combined_label += (i > 0 ? ", " : "") + pair.second[i];
@@ -908,15 +1105,15 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
 
 
          // Add tag pointers (simplified)
-         std::map<std::string, std::vector<std::string>> commits_to_tags;
+         std::map<ObjectId, std::vector<std::string>> commits_to_tags;
          for (const std::string& tag : list_tags()) {
-             std::optional<std::string> tag_sha = resolve_ref(tag); // resolve_ref handles dereferencing
+             std::optional<ObjectId> tag_sha = resolve_ref_id(tag); // resolve_ref handles dereferencing
              if (tag_sha && node_labels.count(*tag_sha)) {
                   commits_to_tags[*tag_sha].push_back(tag);
              }
          }
          for(const auto& pair : commits_to_tags) {
-              std::string sha = pair.first;
+              std::string sha = pair.first.hex();
               std::string combined_label;
               for(size_t i=0; i < pair.second.size(); ++i) {
                    combined_label += (i > 0 ? ", " : "") + pair.second[i];
@@ -929,7 +1126,7 @@ int handle_log(bool graph_mode, const std::optional<std::string>& start_ref_name
 
          // Add HEAD pointer
          std::string head_content = read_head();
-         std::optional<std::string> head_target_sha = resolve_ref("HEAD");
+         std::optional<ObjectId> head_target_sha = resolve_ref_id("HEAD");
          if (head_target_sha && node_labels.count(*head_target_sha)) {
              std::string head_label = "HEAD";
              if (head_content.rfind("ref: refs/heads/", 0) == 0) {
@@ -1009,8 +1206,7 @@ int handle_branch(const std::vector<std::string>& args) {
 
       // Ensure the resolved start_sha points to a commit object (optional but good practice)
       try {
-          ParsedObject obj = read_object(start_sha);
-          if (obj.type != "commit") {
+          if (read_object_header(start_sha).type != "commit") {
                std::cerr << "fatal: '" << start_point << "' (which resolved to " << start_sha.substr(0,7)
                          << ") is not a commit object." << std::endl;
                return 1;
@@ -1105,21 +1301,20 @@ int handle_tag(const std::vector<std::string>& args) {
      }
 
      // Resolve object reference
-     std::optional<std::string> object_sha_opt = resolve_ref(object_ref);
+     std::optional<ObjectId> object_sha_opt = resolve_ref_id(object_ref);
      if (!object_sha_opt) {
           std::cerr << "fatal: Not a valid object name: '" << object_ref << "'" << std::endl;
           return 1;
      }
-      std::string object_sha = *object_sha_opt;
+      ObjectId object_sha = *object_sha_opt;
 
 
      // Determine type of the target object
      std::string object_type;
       try {
-           ParsedObject target_obj = read_object(object_sha);
-           object_type = target_obj.type;
+           object_type = read_object_header(object_sha).type;
       } catch (const std::exception& e) {
-            std::cerr << "fatal: Failed to read target object '" << object_ref << "' (" << object_sha.substr(0,7) << "): " << e.what() << std::endl;
+            std::cerr << "fatal: Failed to read target object '" << object_ref << "' (" << object_sha.short_hex() << "): " << e.what() << std::endl;
             return 1;
       }
 
@@ -1130,13 +1325,13 @@ int handle_tag(const std::vector<std::string>& args) {
               // Create annotated tag object
               std::string tagger = get_user_info() + " " + get_current_timestamp_and_zone();
               std::string tag_content = format_tag_content(object_sha, object_type, tag_name, tagger, message);
-              std::string tag_object_sha = hash_and_write_object("tag", tag_content);
+              std::string tag_object_sha = hash_and_write_object("tag", tag_content).hex();
               // Create ref pointing to the tag *object*
               update_ref(get_tag_ref(tag_name), tag_object_sha);
 
           } else {
               // Create lightweight tag (ref points directly to the target object)
-              update_ref(get_tag_ref(tag_name), object_sha);
+              update_ref(get_tag_ref(tag_name), object_sha.hex());
           }
       } catch (const std::exception& e) {
           std::cerr << "Error creating tag '" << tag_name << "': " << e.what() << std::endl;
@@ -1147,12 +1342,10 @@ int handle_tag(const std::vector<std::string>& args) {
     return 0;
 }
 
-std::set<std::string> get_commit_ancestors(const std::string& start_sha, int limit = 1000) {
-    std::set<std::string> ancestors;
-    std::queue<std::string> q;
-    std::set<std::string> visited; // Track visited within this traversal
-
-    if (start_sha.empty()) return ancestors;
+std::unordered_set<ObjectId> get_commit_ancestors(const ObjectId& start_sha, int limit = 1000) {
+    std::unordered_set<ObjectId> ancestors;
+    std::queue<ObjectId> q;
+    std::unordered_set<ObjectId> visited; // Track visited within this traversal
 
     q.push(start_sha);
     visited.insert(start_sha);
@@ -1160,12 +1353,12 @@ std::set<std::string> get_commit_ancestors(const std::string& start_sha, int lim
 
     int count = 0;
     while (!q.empty() && count++ < limit) {
-        std::string current = q.front();
+        ObjectId current = q.front();
         q.pop();
         try {
-            ParsedObject obj = read_object(current); // read_object handles prefix resolution
-            if (obj.type == "commit") {
-                const auto& commit = std::get<CommitObject>(obj.data);
+            std::shared_ptr<const ParsedObject> obj = read_object_cached(current);
+            if (obj->type == "commit") {
+                const auto& commit = std::get<CommitObject>(obj->data);
                 for (const auto& p : commit.parent_sha1s) {
                     if (visited.find(p) == visited.end()) {
                         visited.insert(p);
@@ -1180,49 +1373,47 @@ std::set<std::string> get_commit_ancestors(const std::string& start_sha, int lim
 }
 
 // Revised merge base finder
-std::optional<std::string> find_merge_base(const std::string& sha1_a, const std::string& sha1_b) {
-    // ... (edge cases) ...
-    if (sha1_a.empty() || sha1_b.empty()) return std::nullopt;
+std::optional<ObjectId> find_merge_base(const ObjectId& sha1_a, const ObjectId& sha1_b) {
     if (sha1_a == sha1_b) return sha1_a;
 
-    std::set<std::string> ancestors_a = get_commit_ancestors(sha1_a);
+    std::unordered_set<ObjectId> ancestors_a = get_commit_ancestors(sha1_a);
     if (ancestors_a.empty()) return std::nullopt;
 
     // Check if B is an ancestor of A
     if (ancestors_a.count(sha1_b)) {
-        std::cout << "DEBUG_BASE: B (" << sha1_b.substr(0,7) << ") is ancestor of A (" << sha1_a.substr(0,7) << "). Base is B." << std::endl;
+        std::cout << "DEBUG_BASE: B (" << sha1_b.short_hex() << ") is ancestor of A (" << sha1_a.short_hex() << "). Base is B." << std::endl;
         return sha1_b;
     }
 
-    std::set<std::string> ancestors_b = get_commit_ancestors(sha1_b);
+    std::unordered_set<ObjectId> ancestors_b = get_commit_ancestors(sha1_b);
     if (ancestors_b.empty()) return std::nullopt;
 
     // Check if A is an ancestor of B
     if (ancestors_b.count(sha1_a)) {
-        std::cout << "DEBUG_BASE: A (" << sha1_a.substr(0,7) << ") is ancestor of B (" << sha1_b.substr(0,7) << "). Base is A." << std::endl;
+        std::cout << "DEBUG_BASE: A (" << sha1_a.short_hex() << ") is ancestor of B (" << sha1_b.short_hex() << "). Base is A." << std::endl;
         return sha1_a;
     }
 
     // Find common ancestor by walking back from B
-    std::queue<std::string> q_b;
-    std::set<std::string> visited_b;
+    std::queue<ObjectId> q_b;
+    std::unordered_set<ObjectId> visited_b;
     q_b.push(sha1_b);
     visited_b.insert(sha1_b);
     int count = 0;
     const int limit = 1000;
 
     while(!q_b.empty() && count++ < limit) {
-        std::string current = q_b.front();
+        ObjectId current = q_b.front();
         q_b.pop();
         if (ancestors_a.count(current)) {
-            std::cout << "DEBUG_BASE: Found common ancestor by walking from B: " << current.substr(0,7) << std::endl;
+            std::cout << "DEBUG_BASE: Found common ancestor by walking from B: " << current.short_hex() << std::endl;
             return current; // Found first common ancestor
         }
         // Add parents
         try {
-            ParsedObject obj = read_object(current);
-            if (obj.type == "commit") {
-                for (const auto& p : std::get<CommitObject>(obj.data).parent_sha1s) {
+            std::shared_ptr<const ParsedObject> obj = read_object_cached(current);
+            if (obj->type == "commit") {
+                for (const auto& p : std::get<CommitObject>(obj->data).parent_sha1s) {
                      if (visited_b.find(p) == visited_b.end()) {
                         visited_b.insert(p); q_b.push(p);
                     }
@@ -1263,35 +1454,35 @@ int handle_merge(const std::string& branch_to_merge_name) {
 
 
     // 2. Get commit SHAs
-    std::optional<std::string> head_sha_opt = resolve_ref("HEAD");
-    std::optional<std::string> theirs_sha_opt = resolve_ref(branch_to_merge_name);
+    std::optional<ObjectId> head_sha_opt = resolve_ref_id("HEAD");
+    std::optional<ObjectId> theirs_sha_opt = resolve_ref_id(branch_to_merge_name);
     if (!head_sha_opt) { std::cerr << "Error: Cannot merge, HEAD is unborn." << std::endl; return 1; }
     if (!theirs_sha_opt) { std::cerr << "fatal: '" << branch_to_merge_name << "' does not point to a commit" << std::endl; return 1; }
-    std::string head_sha = *head_sha_opt;   // "Ours"
-    std::string theirs_sha = *theirs_sha_opt; // "Theirs"
+    ObjectId head_sha = *head_sha_opt;   // "Ours"
+    ObjectId theirs_sha = *theirs_sha_opt; // "Theirs"
 
     if (head_sha == theirs_sha) { std::cout << "Already up to date." << std::endl; return 0; }
 
     // 3. Find merge base
-    std::optional<std::string> base_sha_opt = find_merge_base(head_sha, theirs_sha);
+    std::optional<ObjectId> base_sha_opt = find_merge_base(head_sha, theirs_sha);
     if (!base_sha_opt) { std::cerr << "fatal: Could not find a common ancestor." << std::endl; return 1; }
-    std::string base_sha = *base_sha_opt;
-    std::cout << "Merge base is " << base_sha.substr(0, 7) << std::endl;
+    ObjectId base_sha = *base_sha_opt;
+    std::cout << "Merge base is " << base_sha.short_hex() << std::endl;
 
     // 4. Handle easy cases (Already up-to-date or Fast-forward)
     if (base_sha == theirs_sha) { std::cout << "Already up to date." << std::endl; return 0; }
     if (base_sha == head_sha) {
         // --- Fast-forward merge ---
-        std::cout << "Updating " << head_sha.substr(0, 7) << ".." << theirs_sha.substr(0, 7) << std::endl;
+        std::cout << "Updating " << head_sha.short_hex() << ".." << theirs_sha.short_hex() << std::endl;
         std::cout << "Fast-forward" << std::endl;
-        std::string theirs_tree_sha;
+        ObjectId theirs_tree_sha;
         try {
             ParsedObject theirs_commit = read_object(theirs_sha); // Assumes commit object exists
             theirs_tree_sha = std::get<CommitObject>(theirs_commit.data).tree_sha1;
         } catch (const std::exception& e) { std::cerr << "Error reading target commit " << theirs_sha << ": " << e.what() << std::endl; return 1; }
 
         // Update index and workdir using read-tree -u
-        int read_tree_ret = handle_read_tree(theirs_tree_sha, true, false);
+        int read_tree_ret = handle_read_tree(theirs_tree_sha.hex(), true, false);
         if (read_tree_ret != 0) {
             std::cerr << "Error updating index/workdir during fast-forward. Merge aborted." << std::endl;
             // State might be inconsistent here!
@@ -1300,8 +1491,8 @@ int handle_merge(const std::string& branch_to_merge_name) {
 
         // Update HEAD reference
         std::string head_ref = read_head();
-        if (head_ref.rfind("ref: ", 0) == 0) { update_ref(head_ref.substr(5), theirs_sha); }
-        else { update_head(theirs_sha); }
+        if (head_ref.rfind("ref: ", 0) == 0) { update_ref(head_ref.substr(5), theirs_sha.hex()); }
+        else { update_head(theirs_sha.hex()); }
         std::cout << "Merge successful (fast-forward)." << std::endl;
         return 0;
     }
@@ -1314,9 +1505,9 @@ int handle_merge(const std::string& branch_to_merge_name) {
     std::map<std::string, TreeEntry> ours_tree;
     std::map<std::string, TreeEntry> theirs_tree;
     try {
-        std::string base_tree_sha = std::get<CommitObject>(read_object(base_sha).data).tree_sha1;
-        std::string ours_tree_sha = std::get<CommitObject>(read_object(head_sha).data).tree_sha1;
-        std::string theirs_tree_sha = std::get<CommitObject>(read_object(theirs_sha).data).tree_sha1;
+        ObjectId base_tree_sha = std::get<CommitObject>(read_object_cached(base_sha)->data).tree_sha1;
+        ObjectId ours_tree_sha = std::get<CommitObject>(read_object_cached(head_sha)->data).tree_sha1;
+        ObjectId theirs_tree_sha = std::get<CommitObject>(read_object_cached(theirs_sha)->data).tree_sha1;
 
         base_tree = read_tree_full(base_tree_sha);
         ours_tree = read_tree_full(ours_tree_sha);
@@ -1351,10 +1542,10 @@ int handle_merge(const std::string& branch_to_merge_name) {
         if(in_theirs) result.theirs_entry = theirs_it->second;
 
         // --- Diff Logic ---
-        // Get SHAs (empty string if not present)
-        std::string base_sha = in_base ? base_it->second.sha1 : "";
-        std::string ours_sha = in_ours ? ours_it->second.sha1 : "";
-        std::string theirs_sha_path = in_theirs ? theirs_it->second.sha1 : ""; // Renamed to avoid scope clash
+        // Get SHAs (null if not present)
+        ObjectId base_sha = in_base ? base_it->second.sha1 : ObjectId();
+        ObjectId ours_sha = in_ours ? ours_it->second.sha1 : ObjectId();
+        ObjectId theirs_sha_path = in_theirs ? theirs_it->second.sha1 : ObjectId(); // Renamed to avoid scope clash
 
         // Check for trivial cases first
         if (in_ours && in_theirs && ours_sha == theirs_sha_path) { // Identical in ours and theirs
@@ -1425,7 +1616,7 @@ int handle_merge(const std::string& branch_to_merge_name) {
 
 
     // 5c. Update Index and Working Directory based on merge_results
-    IndexMap new_index;
+    Index new_index;
     bool update_errors = false;
 
     for(const auto& pair : merge_results) {
@@ -1436,7 +1627,7 @@ int handle_merge(const std::string& branch_to_merge_name) {
             switch (result.status) {
                 case MergeStatus::Unmodified:
                     if (result.base_entry) // Keep base entry if unmodified
-                        add_or_update_entry(new_index, {result.base_entry->mode, result.base_entry->sha1, 0, path});
+                        new_index.add_or_update({result.base_entry->mode, result.base_entry->sha1, 0, path, IndexStat()});
                     // No workdir change needed
                     break;
 
@@ -1444,7 +1635,7 @@ int handle_merge(const std::string& branch_to_merge_name) {
                 case MergeStatus::Modified:
                      if (result.merged_entry) {
                          // Add to index (Stage 0)
-                         add_or_update_entry(new_index, {result.merged_entry->mode, result.merged_entry->sha1, 0, path});
+                         new_index.add_or_update({result.merged_entry->mode, result.merged_entry->sha1, 0, path, IndexStat()});
                          // Update workdir
                          ensure_parent_directory_exists(path);
                          std::string content = std::get<BlobObject>(read_object(result.merged_entry->sha1).data).content;
@@ -1463,9 +1654,9 @@ int handle_merge(const std::string& branch_to_merge_name) {
 
                 case MergeStatus::Conflict:
                     // Add all three stages to index
-                    if(result.base_entry) add_or_update_entry(new_index, {result.base_entry->mode, result.base_entry->sha1, 1, path});
-                    if(result.ours_entry) add_or_update_entry(new_index, {result.ours_entry->mode, result.ours_entry->sha1, 2, path});
-                    if(result.theirs_entry) add_or_update_entry(new_index, {result.theirs_entry->mode, result.theirs_entry->sha1, 3, path});
+                    if(result.base_entry) new_index.add_or_update({result.base_entry->mode, result.base_entry->sha1, 1, path, IndexStat()});
+                    if(result.ours_entry) new_index.add_or_update({result.ours_entry->mode, result.ours_entry->sha1, 2, path, IndexStat()});
+                    if(result.theirs_entry) new_index.add_or_update({result.theirs_entry->mode, result.theirs_entry->sha1, 3, path, IndexStat()});
 
                     // Write conflict markers to workdir
                     { // Scope for content strings
@@ -1504,7 +1695,7 @@ int handle_merge(const std::string& branch_to_merge_name) {
     // 5e. Write MERGE_HEAD
     if (conflicts_found || update_errors) { // Write MERGE_HEAD only if merge isn't clean
         try {
-            write_file(GIT_DIR + "/MERGE_HEAD", theirs_sha + "\n");
+            write_file(GIT_DIR + "/MERGE_HEAD", theirs_sha.hex() + "\n");
         } catch (const std::exception& e) {
             std::cerr << "FATAL: Failed to write MERGE_HEAD: " << e.what() << std::endl;
             return 1;
@@ -1533,6 +1724,7 @@ int handle_commit(const std::string& message) {
     // --- Determine if merge is finishing ---
     bool merge_in_progress = false;
     std::string merge_head_sha;
+    ObjectId merge_head_id;
     std::string merge_head_path = GIT_DIR + "/MERGE_HEAD";
     if (file_exists(merge_head_path)) {
         merge_in_progress = true;
@@ -1542,7 +1734,7 @@ int handle_commit(const std::string& message) {
             merge_head_sha.pop_back();
         }
         // Validate MERGE_HEAD SHA
-        if (merge_head_sha.length() != 40 || merge_head_sha.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        if (!ObjectId::try_from_hex(merge_head_sha, merge_head_id)) {
              std::cerr << "Error: Invalid SHA-1 found in MERGE_HEAD: " << merge_head_sha << std::endl;
              // Don't proceed with faulty MERGE_HEAD
              return 1;
@@ -1552,18 +1744,8 @@ int handle_commit(const std::string& message) {
 
 
     // 2. Check for UNRESOLVED merge conflicts in index
-    IndexMap current_index = read_index();
-    bool has_conflicts = false;
-     for (const auto& path_pair : current_index) {
-         for (const auto& stage_pair : path_pair.second) {
-             if (stage_pair.first > 0) {
-                  has_conflicts = true;
-                  break; // Found a conflict stage
-             }
-         }
-          if (has_conflicts) break;
-     }
-     if (has_conflicts) {
+    Index current_index = read_index();
+     if (current_index.has_conflicts()) {
           std::cerr << "error: Committing is not possible because you have unmerged files." << std::endl;
           std::cerr << "hint: Fix them up in the work tree, and then use 'mygit add <file>' to mark resolution." << std::endl;
           std::cerr << "fatal: Exiting because of unmerged files." << std::endl;
@@ -1572,27 +1754,26 @@ int handle_commit(const std::string& message) {
 
 
     // 3. Write index to a tree object
-    std::string tree_sha1;
-    std::vector<IndexEntry> root_entries;
-    try { /* ... build tree logic using build_tree_recursive ... */
-       for (const auto& path_pair : current_index) {
-           auto stage0_it = path_pair.second.find(0);
-           if (stage0_it != path_pair.second.end()) { root_entries.push_back(stage0_it->second); }
-       }
-        if (root_entries.empty()) { tree_sha1 = "da39a3ee5e6b4b0d3255bfef95601890afd80709"; } // Handle empty commit
-        else { tree_sha1 = build_tree_recursive(root_entries); }
-        if (tree_sha1.empty()) throw std::runtime_error("Tree building returned empty SHA"); // Should not happen
+    ObjectId tree_sha1;
+    try { /* ... build tree from the index, reusing cached subtrees ... */
+        if (current_index.empty()) { tree_sha1 = ObjectId::from_hex("da39a3ee5e6b4b0d3255bfef95601890afd80709"); } // Handle empty commit
+        else {
+            bool cache_updated = false;
+            tree_sha1 = current_index.write_tree(&cache_updated);
+            if (cache_updated) write_index(current_index);
+        }
+        if (tree_sha1.is_null()) throw std::runtime_error("Tree building returned empty SHA"); // Should not happen
     } catch (...) { /* Error creating tree */ return 1; }
 
 
     // 4. Determine parent commit(s)
-    std::vector<std::string> parent_sha1s;
-    std::optional<std::string> head_parent_sha = resolve_ref("HEAD");
+    std::vector<ObjectId> parent_sha1s;
+    std::optional<ObjectId> head_parent_sha = resolve_ref_id("HEAD");
 
     // Check if tree hasn't changed (only if NOT a merge commit conclusion)
     if (head_parent_sha && !merge_in_progress) {
         bool tree_changed = true;
-        std::string parent_tree_sha = "";
+        ObjectId parent_tree_sha;
         try { /* Get parent_tree_sha */
             ParsedObject parent_commit_obj = read_object(*head_parent_sha);
             if (parent_commit_obj.type == "commit") {
@@ -1610,8 +1791,8 @@ int handle_commit(const std::string& message) {
     }
     if (merge_in_progress) {
         // Add MERGE_HEAD as the second parent
-        if (std::find(parent_sha1s.begin(), parent_sha1s.end(), merge_head_sha) == parent_sha1s.end()) {
-             parent_sha1s.push_back(merge_head_sha);
+        if (std::find(parent_sha1s.begin(), parent_sha1s.end(), merge_head_id) == parent_sha1s.end()) {
+             parent_sha1s.push_back(merge_head_id);
         } else {
              std::cerr << "Warning: HEAD and MERGE_HEAD point to the same commit? Proceeding..." << std::endl;
         }
@@ -1624,7 +1805,7 @@ int handle_commit(const std::string& message) {
 
     // 6. Format and write commit object
     std::string commit_content = format_commit_content(tree_sha1, parent_sha1s, author, committer, message);
-    std::string commit_sha1 = hash_and_write_object("commit", commit_content);
+    std::string commit_sha1 = hash_and_write_object("commit", commit_content).hex();
 
 
     // 7. Update HEAD reference
@@ -1731,7 +1912,8 @@ int handle_checkout(const std::string& target_ref) {
                        << ") is not a commit object." << std::endl;
              return 1;
         }
-        target_tree_sha = std::get<CommitObject>(target_commit_obj.data).tree_sha1;
+        const ObjectId& target_tree_id = std::get<CommitObject>(target_commit_obj.data).tree_sha1;
+        if (!target_tree_id.is_null()) target_tree_sha = target_tree_id.hex();
          if (target_tree_sha.empty()){
              // Handle commit with no tree (e.g. corrupt repo?)
              std::cerr << "Warning: Target commit " << target_sha.substr(0,7) << " has no associated tree." << std::endl;
@@ -1802,33 +1984,17 @@ int handle_cat_file(const std::string& operation, const std::string& sha1_prefix
     try {
         // Resolve prefix first using find_object from objects.cpp/h
         std::string full_sha = find_object(sha1_prefix); // Reuse the finder
-        ParsedObject object = read_object(full_sha); // Use the already-parsing read_object
 
-        if (operation == "-t") {
-            std::cout << object.type << std::endl;
-        } else if (operation == "-s") {
-            // Need to get size from the *original* header, not parsed content size
-            // Let's modify read_object slightly OR re-read/decompress just for size?
-            // Easier: get size from the parsed object if possible (for blobs),
-            // or recalculate for trees/commits if needed?
-            // Git cat-file -s gives the size from the header "type <size>\0..."
-            // Let's modify ParsedObject to store this original size.
-
-            // --> Requires modification in objects.h/cpp: Add original_size to ParsedObject struct
-            // --> And populate it in read_object() in objects.cpp before parsing content.
-            // Assuming ParsedObject has original_size:
-             std::cerr << "Warning: cat-file -s requires ParsedObject.original_size to be implemented." << std::endl;
-             // For now, use the parsed content size as an approximation
-             if (object.type == "blob") std::cout << std::get<BlobObject>(object.data).content.size() << std::endl;
-             else if (object.type == "tree") std::cout << std::get<TreeObject>(object.data).entries.size() << " entries (approx size)" << std::endl; // Not quite right
-             else if (object.type == "commit") std::cout << std::get<CommitObject>(object.data).message.size() << " msg size (approx)" << std::endl; // Not right
-             else if (object.type == "tag") std::cout << std::get<TagObject>(object.data).message.size() << " msg size (approx)" << std::endl; // Not right
-             // Fallback:
-             // std::cout << object.size << std::endl; // Use the size field parsed initially? YES.
-
-             std::cout << object.size << std::endl; // Use the parsed size field
-
-        } else if (operation == "-p") {
+        if (operation == "-t" || operation == "-s") {
+            // Type and size come from the object header; the content is never inflated.
+            ObjectHeader header = read_object_header(ObjectId::from_hex(full_sha));
+            if (operation == "-t") std::cout << header.type << std::endl;
+            else std::cout << header.size << std::endl;
+            return 0;
+        }
+
+        ParsedObject object = read_object(full_sha); // Use the already-parsing read_object
+        if (operation == "-p") {
             // Pretty-print based on type
             if (object.type == "blob") {
                  std::cout << std::get<BlobObject>(object.data).content;
@@ -1841,7 +2007,7 @@ int handle_cat_file(const std::string& operation, const std::string& sha1_prefix
                  for(const auto& entry : tree.entries) {
                      std::string type_str = (entry.mode == "40000") ? "tree" : "blob"; // Simple guess
                      // Need to read object type properly if needed
-                     printf("%6s %s %s\t%s\n", entry.mode.c_str(), type_str.c_str(), entry.sha1.c_str(), entry.name.c_str());
+                     printf("%6s %s %s\t%s\n", entry.mode.c_str(), type_str.c_str(), entry.sha1.hex().c_str(), entry.name.c_str());
                  }
             } else if (object.type == "commit") {
                  // Re-format roughly like git cat-file -p commit
@@ -1874,6 +2040,128 @@ int handle_cat_file(const std::string& operation, const std::string& sha1_prefix
 }
 
 // --- hash-object --- (Based on previous version)
+namespace {
+
+// Buffered stdin/stdout for cat-file --batch. Output is written out only when
+// the next read from stdin could block (or the buffer gets large), so a
+// caller feeding one name at a time sees each answer immediately while a
+// piped list of names is answered in large writes.
+class BatchIo {
+public:
+    ~BatchIo() { flush(); }
+
+    bool read_line(std::string& line) {
+        while (true) {
+            size_t nl = in_.find('\n', in_pos_);
+            if (nl != std::string::npos) {
+                line.assign(in_, in_pos_, nl - in_pos_);
+                in_pos_ = nl + 1;
+                return true;
+            }
+            if (eof_) {
+                if (in_pos_ >= in_.size()) return false;
+                line.assign(in_, in_pos_, std::string::npos); // Last line without a newline
+                in_pos_ = in_.size();
+                return true;
+            }
+            in_.erase(0, in_pos_);
+            in_pos_ = 0;
+
+            struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, 1, 0) <= 0) flush();
+
+            char buf[65536];
+            ssize_t n = ::read(STDIN_FILENO, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) eof_ = true;
+            else in_.append(buf, static_cast<size_t>(n));
+        }
+    }
+
+    void write(const std::string& data) {
+        out_ += data;
+        if (out_.size() >= (1u << 20)) flush();
+    }
+
+    void flush() {
+        size_t done = 0;
+        while (done < out_.size()) {
+            ssize_t n = ::write(STDOUT_FILENO, out_.data() + done, out_.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Failed to write to stdout");
+            done += static_cast<size_t>(n);
+        }
+        out_.clear();
+    }
+
+private:
+    std::string in_;
+    size_t in_pos_ = 0;
+    bool eof_ = false;
+    std::string out_;
+};
+
+// Names an object for batch mode: a (possibly abbreviated) object name, or
+// a ref resolved the same way as everywhere else. Sets `status` to "missing"
+// or "ambiguous" when it cannot.
+std::optional<ObjectId> resolve_batch_name(const std::string& name, std::string& status) {
+    status = "missing";
+    if (name.size() >= 4 && name.size() <= ObjectId::HEX_SIZE &&
+        name.find_first_not_of("0123456789abcdef") == std::string::npos) {
+        ObjectId id;
+        if (ObjectId::try_from_hex(name, id)) {
+            if (has_object(id)) return id;
+        } else {
+            std::vector<ObjectId> matches = find_objects_by_prefix(name);
+            if (matches.size() == 1) return matches[0];
+            if (matches.size() > 1) {
+                status = "ambiguous";
+                return std::nullopt;
+            }
+        }
+    }
+    std::optional<ObjectId> id = resolve_ref_id(name);
+    if (id && has_object(*id)) return id;
+    return std::nullopt;
+}
+
+} // namespace
+
+int handle_cat_file_batch(bool with_content) {
+    BatchIo io;
+    std::string line;
+    try {
+        while (io.read_line(line)) {
+            if (line.empty()) continue;
+            std::string status;
+            std::optional<ObjectId> id = resolve_batch_name(line, status);
+            if (!id) {
+                io.write(line + " " + status + "\n");
+                continue;
+            }
+            try {
+                if (with_content) {
+                    RawObject raw = read_raw_object(*id);
+                    io.write(id->hex() + " " + raw.type + " " + std::to_string(raw.content.size()) + "\n");
+                    io.write(raw.content);
+                    io.write("\n");
+                } else {
+                    ObjectHeader header = read_object_header(*id);
+                    io.write(id->hex() + " " + header.type + " " + std::to_string(header.size) + "\n");
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: Failed to read object " << *id << ": " << e.what() << std::endl;
+                io.write(line + " missing\n");
+            }
+        }
+        io.flush();
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 int handle_hash_object(const std::string& filename, const std::string& type, bool write_mode) {
     // Validate type (simple check)
     if (type != "blob" && type != "commit" && type != "tree" && type != "tag") {
@@ -1882,24 +2170,7 @@ int handle_hash_object(const std::string& filename, const std::string& type, boo
     }
 
     try {
-        std::string content = read_file(filename);
-        // Use hash_and_write_object which handles writing if write_mode is true
-        // AND returns the correct content SHA.
-        // We need to adapt hash_and_write_object based on write_mode.
-        // OR, calculate SHA first, then call write logic if needed.
-
-        std::string content_sha = compute_sha1(content);
-
-        if (write_mode) {
-             // Construct object data and write it
-             std::string object_data = type + " " + std::to_string(content.size()) + '\0' + content;
-             std::string path = get_object_path(content_sha); // Path uses content sha
-              if (!file_exists(path)) {
-                  std::vector<unsigned char> compressed = compress_data(object_data);
-                  ensure_object_directory_exists(content_sha);
-                  write_file(path, compressed);
-              }
-        }
+        ObjectId content_sha = hash_file_object(filename, type, write_mode);
         // Always print the content SHA
         std::cout << content_sha << std::endl;
         return 0; // Success
@@ -1930,16 +2201,13 @@ int handle_rev_parse(const std::vector<std::string>& args) {
     }
 }
 
-void list_tree_recursive(const std::string& tree_sha, bool recursive, const std::string& path_prefix) {
-    if (tree_sha.empty()) {
-        std::cerr << "Warning: Attempted to list empty tree SHA." << std::endl;
-        return;
-    }
-
+// abbrev == 0 prints full object names, otherwise the shortest unique prefix of at least that length.
+void list_tree_recursive(const ObjectId& tree_sha, bool recursive, const std::string& path_prefix, size_t abbrev) {
     try {
-        ParsedObject parsed_obj = read_object(tree_sha);
+        std::shared_ptr<const ParsedObject> cached_obj = read_object_cached(tree_sha);
+        const ParsedObject& parsed_obj = *cached_obj;
         if (parsed_obj.type != "tree") {
-            std::cerr << "Error: Object " << tree_sha.substr(0, 7) << " is not a tree." << std::endl;
+            std::cerr << "Error: Object " << tree_sha.short_hex() << " is not a tree." << std::endl;
             // Should this throw or just return? Let's return to allow partial listing if called recursively.
             return;
         }
@@ -1966,16 +2234,18 @@ void list_tree_recursive(const std::string& tree_sha, bool recursive, const std:
             std::string full_path = path_prefix.empty() ? entry.name : path_prefix + "/" + entry.name;
 
             // Print the formatted line
-            std::cout << entry.mode << " " << type_str << " " << entry.sha1 << "\t" << full_path << std::endl;
+            std::cout << entry.mode << " " << type_str << " ";
+            if (abbrev) std::cout << find_unique_abbrev(entry.sha1, abbrev); else std::cout << entry.sha1;
+            std::cout << "\t" << full_path << std::endl;
 
             // Recurse if requested and if it's a subtree
             if (recursive && type_str == "tree") {
-                list_tree_recursive(entry.sha1, true, full_path); // Pass recursive=true and updated prefix
+                list_tree_recursive(entry.sha1, true, full_path, abbrev); // Pass recursive=true and updated prefix
             }
         }
 
     } catch (const std::exception& e) {
-        std::cerr << "Error reading or processing tree object " << tree_sha.substr(0, 7) << ": " << e.what() << std::endl;
+        std::cerr << "Error reading or processing tree object " << tree_sha.short_hex() << ": " << e.what() << std::endl;
         // Decide whether to continue or abort the whole command? Let's continue.
     }
 }
@@ -1984,56 +2254,60 @@ void list_tree_recursive(const std::string& tree_sha, bool recursive, const std:
 // --- ls-tree ---
 int handle_ls_tree(const std::vector<std::string>& args) {
     bool recursive = false;
+    size_t abbrev = 0;
     std::string tree_ish_arg;
 
-    // Basic argument parsing
-    if (args.empty()) {
-        std::cerr << "Usage: mygit ls-tree [-r] <tree-ish>" << std::endl;
-        return 1;
-    }
-
-    size_t tree_arg_index = 0;
-    if (args[0] == "-r") {
-        recursive = true;
-        tree_arg_index = 1;
-    }
-
-    if (args.size() <= tree_arg_index) {
-         std::cerr << "Usage: mygit ls-tree [-r] <tree-ish>" << std::endl;
-        return 1;
+    // Basic argument parsing: options, then exactly one <tree-ish>
+    for (const std::string& arg : args) {
+        if (arg == "-r") {
+            recursive = true;
+        } else if (arg == "--abbrev") {
+            abbrev = 7;
+        } else if (arg.rfind("--abbrev=", 0) == 0) {
+            std::string value = arg.substr(9);
+            if (value.empty() || value.size() > 2 || value.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "fatal: invalid --abbrev value '" << value << "'" << std::endl;
+                return 1;
+            }
+            abbrev = std::min<size_t>(std::max<size_t>(std::stoul(value), 4), ObjectId::HEX_SIZE);
+        } else if (tree_ish_arg.empty()) {
+            tree_ish_arg = arg;
+        } else {
+            tree_ish_arg.clear(); // Extra argument
+            break;
+        }
     }
-    tree_ish_arg = args[tree_arg_index];
 
-    if (args.size() > tree_arg_index + 1) { // Check for extra arguments
-         std::cerr << "Usage: mygit ls-tree [-r] <tree-ish>" << std::endl;
+    if (tree_ish_arg.empty()) {
+         std::cerr << "Usage: mygit ls-tree [-r] [--abbrev[=<n>]] <tree-ish>" << std::endl;
         return 1;
     }
 
     // Resolve the <tree-ish> argument
-    std::optional<std::string> resolved_sha_opt = resolve_ref(tree_ish_arg);
+    std::optional<ObjectId> resolved_sha_opt = resolve_ref_id(tree_ish_arg);
     if (!resolved_sha_opt) {
          std::cerr << "fatal: Not a valid object name: '" << tree_ish_arg << "'" << std::endl;
          return 128;
     }
-    std::string resolved_sha = *resolved_sha_opt;
+    ObjectId resolved_sha = *resolved_sha_opt;
 
     // Determine the final tree SHA to list
-    std::string target_tree_sha;
+    ObjectId target_tree_sha;
     try {
         ParsedObject obj = read_object(resolved_sha);
         if (obj.type == "commit") {
             target_tree_sha = std::get<CommitObject>(obj.data).tree_sha1;
-            if (target_tree_sha.empty()) {
-                 std::cerr << "fatal: Commit " << resolved_sha.substr(0,7) << " does not have a tree." << std::endl;
+            if (target_tree_sha.is_null()) {
+                 std::cerr << "fatal: Commit " << resolved_sha.short_hex() << " does not have a tree." << std::endl;
                  return 1;
             }
         } else if (obj.type == "tag") { // Annotated tag
-            std::string tagged_object_sha = std::get<TagObject>(obj.data).object_sha1;
+            ObjectId tagged_object_sha = std::get<TagObject>(obj.data).object_sha1;
              std::string tagged_object_type = std::get<TagObject>(obj.data).type;
-             // Need to resolve the tagged object recursively until we hit commit/tree
-             std::optional<std::string> final_target_sha = resolve_ref(tagged_object_sha); // Reuse resolve_ref
+             std::optional<ObjectId> final_target_sha;
+             if (has_object(tagged_object_sha)) final_target_sha = tagged_object_sha;
               if (!final_target_sha) {
-                  std::cerr << "fatal: Tag " << tree_ish_arg << " points to missing object " << tagged_object_sha.substr(0,7) << std::endl;
+                  std::cerr << "fatal: Tag " << tree_ish_arg << " points to missing object " << tagged_object_sha.short_hex() << std::endl;
                   return 1;
               }
               ParsedObject final_target_obj = read_object(*final_target_sha);
@@ -2048,21 +2322,321 @@ int handle_ls_tree(const std::vector<std::string>& args) {
         } else if (obj.type == "tree") {
             target_tree_sha = resolved_sha; // It's already a tree SHA
         } else { // Blob or other?
-             std::cerr << "fatal: Object " << resolved_sha.substr(0,7) << " is not a commit or tree." << std::endl;
+             std::cerr << "fatal: Object " << resolved_sha.short_hex() << " is not a commit or tree." << std::endl;
              return 128;
         }
     } catch (const std::exception& e) {
-         std::cerr << "fatal: Failed to read object '" << resolved_sha.substr(0,7) << "': " << e.what() << std::endl;
+         std::cerr << "fatal: Failed to read object '" << resolved_sha.short_hex() << "': " << e.what() << std::endl;
          return 1;
     }
 
     // Call the recursive listing function
     try {
-         list_tree_recursive(target_tree_sha, recursive, "");
+         list_tree_recursive(target_tree_sha, recursive, "", abbrev);
     } catch (const std::exception& e) {
-         std::cerr << "Error during listing tree " << target_tree_sha.substr(0,7) << ": " << e.what() << std::endl;
+         std::cerr << "Error during listing tree " << target_tree_sha.short_hex() << ": " << e.what() << std::endl;
          return 1; // Indicate failure
     }
 
     return 0; // Success
-}
\ No newline at end of file
+}
+
+// --- pack-objects ---
+// Reads object names (one per line) from stdin and writes them into a new pack.
+// Handles --window=<n> and --depth=<n>; returns false for any other argument.
+bool parse_pack_option(const std::string& arg, PackOptions& options) {
+    int* target = nullptr;
+    size_t prefix_len = 0;
+    if (arg.rfind("--window=", 0) == 0) { target = &options.window; prefix_len = 9; }
+    else if (arg.rfind("--depth=", 0) == 0) { target = &options.depth; prefix_len = 8; }
+    else return false;
+
+    std::string value = arg.substr(prefix_len);
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 6) {
+        throw std::invalid_argument("Invalid number in '" + arg + "'");
+    }
+    *target = std::stoi(value);
+    return true;
+}
+
+int handle_pack_objects(const std::vector<std::string>& args) {
+    PackOptions options;
+    for (const auto& arg : args) {
+        try {
+            if (!parse_pack_option(arg, options)) {
+                std::cerr << "Usage: mygit pack-objects [--window=<n>] [--depth=<n>] < <object-list>" << std::endl;
+                return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "fatal: " << e.what() << std::endl;
+            return 128;
+        }
+    }
+
+    // Each line is "<object> [<path>]"; the path only guides delta base selection.
+    std::vector<PackInput> objects;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        size_t space = line.find(' ');
+        std::string name = line.substr(0, space);
+        if (name.empty()) continue;
+        try {
+            PackInput input;
+            input.sha1 = ObjectId::from_hex(find_object(name));
+            if (space != std::string::npos) input.path = line.substr(space + 1);
+            objects.push_back(std::move(input));
+        } catch (const std::exception& e) {
+            std::cerr << "fatal: " << e.what() << std::endl;
+            return 128;
+        }
+    }
+
+    try {
+        PackStats stats;
+        std::string pack_checksum = write_pack(objects, options, &stats);
+        std::cerr << "Total " << stats.total << " (delta " << stats.deltas << ")" << std::endl;
+        std::cout << pack_checksum << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error writing pack: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Parses a prune expiry: "now", "never" or "<n>.<unit>.ago" (seconds .. weeks).
+// Returns false for "never".
+bool parse_prune_expiry(const std::string& spec, std::time_t now, std::time_t& expire) {
+    if (spec == "never") return false;
+    if (spec == "now" || spec == "all") {
+        expire = now;
+        return true;
+    }
+    std::vector<std::string> parts = split_string(spec, '.');
+    if (parts.size() == 3 && parts[2] == "ago" && !parts[0].empty() && parts[0].size() < 10 &&
+        parts[0].find_first_not_of("0123456789") == std::string::npos) {
+        std::string unit = parts[1];
+        if (unit.size() > 1 && unit.back() == 's') unit.pop_back();
+        static const std::map<std::string, std::time_t> unit_seconds = {
+            {"second", 1}, {"minute", 60}, {"hour", 3600}, {"day", 86400}, {"week", 7 * 86400}};
+        auto it = unit_seconds.find(unit);
+        if (it != unit_seconds.end()) {
+            expire = now - static_cast<std::time_t>(std::stol(parts[0])) * it->second;
+            return true;
+        }
+    }
+    throw std::invalid_argument("Invalid prune expiry '" + spec + "' (expected now, never or <n>.<unit>.ago)");
+}
+
+void print_repack_summary(const RepackResult& result) {
+    if (!result.pack_checksum.empty()) {
+        std::cerr << "Total " << result.stats.total << " (delta " << result.stats.deltas << ")" << std::endl;
+        std::cout << "Packed " << result.stats.total << " objects into pack-" << result.pack_checksum << std::endl;
+    }
+    std::cout << "Removed " << result.loose_removed << " loose objects and " << result.packs_removed << " old packs";
+    if (result.loosened > 0) std::cout << ", loosened " << result.loosened << " unreachable objects";
+    std::cout << std::endl;
+}
+
+int handle_repack(const std::vector<std::string>& args) {
+    PackOptions options;
+    for (const auto& arg : args) {
+        try {
+            if (!parse_pack_option(arg, options)) {
+                std::cerr << "Usage: mygit repack [--window=<n>] [--depth=<n>]" << std::endl;
+                return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "fatal: " << e.what() << std::endl;
+            return 128;
+        }
+    }
+
+    try {
+        print_repack_summary(repack_objects(collect_reachable_objects(), options));
+    } catch (const std::exception& e) {
+        std::cerr << "Error during repack: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int handle_gc(const std::vector<std::string>& args) {
+    PackOptions options;
+    std::string prune_spec = "2.weeks.ago";
+    for (const auto& arg : args) {
+        if (arg.rfind("--prune=", 0) == 0) {
+            prune_spec = arg.substr(8);
+        } else if (arg == "--no-prune") {
+            prune_spec = "never";
+        } else if (arg == "--aggressive") {
+            options.window = 250;
+        } else {
+            std::cerr << "Usage: mygit gc [--prune=<expiry> | --no-prune] [--aggressive]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::time_t expire = 0;
+    bool prune = false;
+    try {
+        prune = parse_prune_expiry(prune_spec, std::time(nullptr), expire);
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return 128;
+    }
+
+    try {
+        std::vector<PackInput> reachable = collect_reachable_objects();
+        print_repack_summary(repack_objects(reachable, options));
+        if (prune) {
+            std::cout << "Pruned " << prune_loose_objects(reachable, expire) << " unreachable objects" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error during gc: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int handle_fsmonitor(const std::vector<std::string>& args) {
+    std::string action = args.size() == 1 ? args[0] : "";
+    if (action == "start" || action == "run") {
+        return run_fsmonitor_daemon(action == "start");
+    } else if (action == "stop") {
+        if (!stop_fsmonitor_daemon()) {
+            std::cerr << "fsmonitor is not running" << std::endl;
+            return 1;
+        }
+        std::cout << "fsmonitor stopped" << std::endl;
+        return 0;
+    } else if (action == "status") {
+        long pid = fsmonitor_daemon_pid();
+        if (pid < 0) {
+            std::cout << "fsmonitor is not running" << std::endl;
+            return 1;
+        }
+        std::cout << "fsmonitor is running (pid " << pid << ")" << std::endl;
+        return 0;
+    }
+    std::cerr << "Usage: mygit fsmonitor (start | run | stop | status)" << std::endl;
+    return 1;
+}
+
+// --- sparse-checkout ---
+namespace {
+
+// Sets the skip-worktree bits for `cone` (clears them all without one) and
+// updates the working tree to match. Files with local changes are left in
+// place, and their entries outside the cone, as Git does.
+int update_sparse_checkout(const SparseCone* cone) {
+    Index old_index = read_index();
+    if (old_index.has_conflicts()) {
+        std::cerr << "error: You have unmerged paths; cannot update the sparse checkout." << std::endl;
+        return 1;
+    }
+    Index new_index = read_index();
+    bool sparse_index = cone && sparse_index_enabled();
+    if (sparse_index) expand_into_cone(new_index, cone);
+    else new_index.ensure_full();
+    std::vector<std::string> changed_paths;
+    for (size_t i = 0; i < new_index.size(); ++i) {
+        const IndexRecord& rec = new_index[i];
+        if (rec.stage != 0) continue;
+        bool skip = cone && !cone->includes(rec.path());
+        if (skip == rec.skip_worktree) continue;
+        std::string path(rec.path());
+        if (skip) {
+            IndexStat file_stat;
+            if (stat_workdir_file(path, file_stat) && !new_index.up_to_date(i, file_stat)) {
+                std::optional<ObjectId> current = get_workdir_sha(path);
+                if (!current || *current != rec.sha1 || file_stat.mode != rec.mode) {
+                    std::cerr << "Warning: Not removing '" << path << "': it has local changes" << std::endl;
+                    continue;
+                }
+            }
+        } else {
+            changed_paths.push_back(path);
+        }
+        new_index.set_skip_worktree(i, skip);
+    }
+
+    bool workdir_ok = checkout_index(old_index, new_index, &changed_paths);
+    if (sparse_index) {
+        new_index.write_tree(); // Collapsing needs the cached trees
+        new_index.collapse_sparse_directories();
+    }
+    write_index(new_index);
+    return workdir_ok ? 0 : 1;
+}
+
+} // namespace
+
+int handle_sparse_checkout(const std::vector<std::string>& args) {
+    std::string action = args.empty() ? "" : args[0];
+    std::vector<std::string> dirs(args.empty() ? args.end() : args.begin() + 1, args.end());
+    std::optional<bool> sparse_index;
+    for (auto it = dirs.begin(); it != dirs.end();) {
+        if (*it != "--sparse-index" && *it != "--no-sparse-index") {
+            ++it;
+            continue;
+        }
+        sparse_index = *it == "--sparse-index";
+        it = dirs.erase(it);
+    }
+    const char* usage = "Usage: mygit sparse-checkout (init | list | reapply | disable | set <dir>... | add <dir>...)"
+                        " [--[no-]sparse-index]";
+    if (sparse_index && ((action != "init" && action != "set" && action != "reapply") || (action == "set" && dirs.empty()))) {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+    try {
+        if (sparse_index) set_config_value("index.sparse", *sparse_index ? "true" : "false");
+        if (action == "list" && dirs.empty()) {
+            std::optional<SparseCone> cone = load_sparse_cone();
+            if (!cone) {
+                std::cerr << "fatal: this worktree is not sparse" << std::endl;
+                return 1;
+            }
+            for (const std::string& dir : cone->dirs()) std::cout << dir << std::endl;
+            return 0;
+        }
+        if (action == "disable" && dirs.empty()) {
+            set_config_value("core.sparseCheckout", "false");
+            return update_sparse_checkout(nullptr);
+        }
+        if (action == "reapply" && dirs.empty()) {
+            std::optional<SparseCone> cone = load_sparse_cone();
+            if (!cone) {
+                std::cerr << "fatal: must be in a sparse-checkout to reapply sparsity patterns" << std::endl;
+                return 1;
+            }
+            return update_sparse_checkout(&*cone);
+        }
+
+        SparseCone cone;
+        if (action == "init" && dirs.empty()) {
+            set_config_value("core.sparseCheckout", "true");
+            if (std::optional<SparseCone> existing = load_sparse_cone()) cone = *existing;
+        } else if (action == "set" && !dirs.empty()) {
+            cone = SparseCone(dirs);
+        } else if (action == "add" && !dirs.empty()) {
+            std::optional<SparseCone> existing = load_sparse_cone();
+            if (!existing) {
+                std::cerr << "fatal: no sparse-checkout to add to" << std::endl;
+                return 1;
+            }
+            dirs.insert(dirs.end(), existing->dirs().begin(), existing->dirs().end());
+            cone = SparseCone(dirs);
+        } else {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        write_sparse_cone(cone);
+        set_config_value("core.sparseCheckout", "true");
+        set_config_value("core.sparseCheckoutCone", "true");
+        return update_sparse_checkout(&cone);
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,141 @@
+#include "headers/config.h"
+#include "headers/utils.h"
+
+#include <map>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+std::string trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(start, end - start + 1);
+}
+
+// Flat "section.key" -> value map. Subsections ([remote "origin"]) and quoting
+// are not needed by anything that reads the config yet.
+std::map<std::string, std::string>& loaded_config() {
+    static std::map<std::string, std::string> values;
+    return values;
+}
+
+const std::map<std::string, std::string>& load_config() {
+    std::map<std::string, std::string>& values = loaded_config();
+    static bool loaded = false;
+    if (loaded) return values;
+    loaded = true;
+
+    std::ifstream file(GIT_DIR + "/config");
+    if (!file) return values;
+
+    std::string section;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+        if (line.front() == '[') {
+            size_t close = line.find(']');
+            section = (close == std::string::npos) ? "" : to_lower(trim(line.substr(1, close - 1)));
+            continue;
+        }
+        size_t eq = line.find('=');
+        std::string key = to_lower(trim(line.substr(0, eq)));
+        std::string value = (eq == std::string::npos) ? "true" : trim(line.substr(eq + 1));
+        if (!section.empty() && !key.empty()) values[section + "." + key] = value;
+    }
+    return values;
+}
+
+} // namespace
+
+std::optional<std::string> get_config_value(const std::string& name) {
+    const auto& values = load_config();
+    auto it = values.find(to_lower(name));
+    if (it == values.end()) return std::nullopt;
+    return it->second;
+}
+
+void set_config_value(const std::string& name, const std::string& value) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || dot == 0 || dot + 1 == name.size()) {
+        throw std::runtime_error("Invalid config key '" + name + "'");
+    }
+    std::string section = to_lower(name.substr(0, dot));
+    std::string key = to_lower(name.substr(dot + 1));
+    load_config(); // So the cached values stay complete
+
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(GIT_DIR + "/config");
+        std::string line;
+        while (std::getline(file, line)) lines.push_back(line);
+    }
+    // Last assignment of the key and last line of its section, if any.
+    size_t assignment = std::string::npos;
+    size_t section_end = std::string::npos;
+    std::string current;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::string line = trim(lines[i]);
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+        if (line.front() == '[') {
+            size_t close = line.find(']');
+            current = (close == std::string::npos) ? "" : to_lower(trim(line.substr(1, close - 1)));
+            if (current == section) section_end = i;
+            continue;
+        }
+        if (current != section) continue;
+        section_end = i;
+        if (to_lower(trim(line.substr(0, line.find('=')))) == key) assignment = i;
+    }
+    std::string entry = "\t" + name.substr(dot + 1) + " = " + value;
+    if (assignment != std::string::npos) {
+        lines[assignment] = entry;
+    } else if (section_end != std::string::npos) {
+        lines.insert(lines.begin() + static_cast<std::ptrdiff_t>(section_end) + 1, entry);
+    } else {
+        lines.push_back("[" + name.substr(0, dot) + "]");
+        lines.push_back(entry);
+    }
+
+    std::string temp_path = GIT_DIR + "/config.tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        for (const std::string& line : lines) out << line << '\n';
+        if (!out) throw std::runtime_error("Failed to write " + temp_path);
+    }
+    fs::rename(temp_path, GIT_DIR + "/config");
+    loaded_config()[section + "." + key] = value;
+}
+
+uint64_t parse_size_value(const std::string& value) {
+    std::string digits = value;
+    uint64_t multiplier = 1;
+    if (!digits.empty()) {
+        switch (std::tolower(static_cast<unsigned char>(digits.back()))) {
+            case 'k': multiplier = 1024ull; digits.pop_back(); break;
+            case 'm': multiplier = 1024ull * 1024; digits.pop_back(); break;
+            case 'g': multiplier = 1024ull * 1024 * 1024; digits.pop_back(); break;
+        }
+    }
+    if (digits.empty() || digits.size() > 12 || digits.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::invalid_argument("Invalid size value '" + value + "'");
+    }
+    return std::stoull(digits) * multiplier;
+}
+
+bool parse_bool_value(const std::string& value) {
+    std::string v = to_lower(value);
+    if (v == "true" || v == "yes" || v == "on" || v == "1") return true;
+    if (v == "false" || v == "no" || v == "off" || v == "0" || v.empty()) return false;
+    throw std::invalid_argument("Invalid boolean value '" + value + "'");
+}
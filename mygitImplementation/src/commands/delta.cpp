@@ -0,0 +1,216 @@
+#include "headers/delta.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+// Matches shorter than one block are not worth a copy instruction.
+const size_t BLOCK_SIZE = 16;
+const int MAX_CHAIN = 64;
+const size_t MAX_COPY = 0x10000;
+const size_t MAX_INSERT = 0x7f;
+const uint32_t HASH_MULT = 0x01000193u;
+
+uint32_t block_hash(const unsigned char* p) {
+    uint32_t h = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) h = h * HASH_MULT + p[i];
+    return h;
+}
+
+// HASH_MULT^(BLOCK_SIZE - 1), used to drop the outgoing byte when rolling.
+uint32_t outgoing_factor() {
+    uint32_t f = 1;
+    for (size_t i = 0; i + 1 < BLOCK_SIZE; ++i) f *= HASH_MULT;
+    return f;
+}
+
+uint32_t bucket_of(uint32_t h, uint32_t mask) {
+    return ((h ^ (h >> 15)) * 2654435761u >> 7) & mask;
+}
+
+void put_varint(std::string& out, size_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+size_t get_varint(const unsigned char*& p, const unsigned char* end) {
+    size_t v = 0;
+    int shift = 0;
+    unsigned char c;
+    do {
+        if (p >= end || shift > 63) throw std::runtime_error("Truncated delta header");
+        c = *p++;
+        v |= size_t(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return v;
+}
+
+void flush_literals(std::string& out, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        size_t n = std::min(len, MAX_INSERT);
+        out.push_back(static_cast<char>(n));
+        out.append(reinterpret_cast<const char*>(data), n);
+        data += n;
+        len -= n;
+    }
+}
+
+void emit_copy(std::string& out, size_t offset, size_t size) {
+    while (size > 0) {
+        size_t n = std::min(size, MAX_COPY);
+        size_t op_pos = out.size();
+        unsigned char op = 0x80;
+        out.push_back(0);
+        for (int i = 0; i < 4; ++i) {
+            unsigned char b = static_cast<unsigned char>(offset >> (8 * i));
+            if (b) { op |= static_cast<unsigned char>(1 << i); out.push_back(static_cast<char>(b)); }
+        }
+        size_t encoded = (n == MAX_COPY) ? 0 : n;
+        for (int i = 0; i < 3; ++i) {
+            unsigned char b = static_cast<unsigned char>(encoded >> (8 * i));
+            if (b) { op |= static_cast<unsigned char>(0x10 << i); out.push_back(static_cast<char>(b)); }
+        }
+        out[op_pos] = static_cast<char>(op);
+        offset += n;
+        size -= n;
+    }
+}
+
+} // namespace
+
+DeltaIndex create_delta_index(const std::string& source) {
+    DeltaIndex index;
+    index.source = &source;
+    size_t blocks = source.size() / BLOCK_SIZE;
+    if (blocks == 0) return index;
+    if (source.size() > 0xffffffffu) return index; // Copy offsets are limited to 32 bits
+
+    uint32_t table_size = 1;
+    while (table_size < blocks) table_size <<= 1;
+    index.hash_mask = table_size - 1;
+    index.buckets.assign(table_size, -1);
+    index.chain.assign(blocks, -1);
+    std::vector<uint8_t> chain_len(table_size, 0);
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(source.data());
+    // Insert back to front so each chain starts at the earliest occurrence.
+    for (size_t b = blocks; b-- > 0;) {
+        uint32_t bucket = bucket_of(block_hash(data + b * BLOCK_SIZE), index.hash_mask);
+        if (chain_len[bucket] >= MAX_CHAIN) continue;
+        chain_len[bucket]++;
+        index.chain[b] = index.buckets[bucket];
+        index.buckets[bucket] = static_cast<int32_t>(b);
+    }
+    return index;
+}
+
+bool create_delta(const DeltaIndex& index, const std::string& target, size_t max_delta_size, std::string& delta_out) {
+    const std::string& source = *index.source;
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(source.data());
+    const unsigned char* tgt = reinterpret_cast<const unsigned char*>(target.data());
+    size_t src_size = source.size();
+    size_t tgt_size = target.size();
+
+    std::string out;
+    put_varint(out, src_size);
+    put_varint(out, tgt_size);
+
+    size_t literal_start = 0; // Target bytes [literal_start, pos) are still pending as literals
+    size_t pos = 0;
+    if (!index.buckets.empty() && tgt_size >= BLOCK_SIZE) {
+        const uint32_t out_factor = outgoing_factor();
+        uint32_t h = block_hash(tgt);
+        while (pos + BLOCK_SIZE <= tgt_size) {
+            size_t best_len = 0;
+            size_t best_off = 0;
+            for (int32_t b = index.buckets[bucket_of(h, index.hash_mask)]; b >= 0; b = index.chain[b]) {
+                size_t off = size_t(b) * BLOCK_SIZE;
+                if (std::memcmp(src + off, tgt + pos, BLOCK_SIZE) != 0) continue;
+                size_t len = BLOCK_SIZE;
+                size_t limit = std::min(src_size - off, tgt_size - pos);
+                while (len < limit && src[off + len] == tgt[pos + len]) ++len;
+                if (len > best_len) { best_len = len; best_off = off; }
+            }
+
+            if (best_len >= BLOCK_SIZE) {
+                // Pull the match backwards over bytes we were about to insert literally.
+                while (pos > literal_start && best_off > 0 && src[best_off - 1] == tgt[pos - 1]) {
+                    --pos; --best_off; ++best_len;
+                }
+                flush_literals(out, tgt + literal_start, pos - literal_start);
+                emit_copy(out, best_off, best_len);
+                pos += best_len;
+                literal_start = pos;
+                if (out.size() > max_delta_size) return false;
+                if (pos + BLOCK_SIZE <= tgt_size) h = block_hash(tgt + pos);
+            } else {
+                if (pos + BLOCK_SIZE < tgt_size) {
+                    h = (h - tgt[pos] * out_factor) * HASH_MULT + tgt[pos + BLOCK_SIZE];
+                }
+                ++pos;
+                if (out.size() + (pos - literal_start) > max_delta_size) return false;
+            }
+        }
+    }
+    flush_literals(out, tgt + literal_start, tgt_size - literal_start);
+    if (out.size() > max_delta_size) return false;
+    delta_out.swap(out);
+    return true;
+}
+
+std::string apply_delta(const std::string& base, const unsigned char* delta, size_t delta_size) {
+    const unsigned char* p = delta;
+    const unsigned char* end = delta + delta_size;
+
+    size_t src_size = get_varint(p, end);
+    if (src_size != base.size()) {
+        throw std::runtime_error("Delta base size mismatch: expected " + std::to_string(src_size)
+                                 + ", base is " + std::to_string(base.size()));
+    }
+    size_t tgt_size = get_varint(p, end);
+
+    std::string result;
+    result.reserve(tgt_size);
+    while (p < end) {
+        unsigned char op = *p++;
+        if (op & 0x80) {
+            size_t offset = 0, size = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (op & (1 << i)) {
+                    if (p >= end) throw std::runtime_error("Truncated delta copy instruction");
+                    offset |= size_t(*p++) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (op & (0x10 << i)) {
+                    if (p >= end) throw std::runtime_error("Truncated delta copy instruction");
+                    size |= size_t(*p++) << (8 * i);
+                }
+            }
+            if (size == 0) size = MAX_COPY;
+            if (offset + size > base.size() || result.size() + size > tgt_size) {
+                throw std::runtime_error("Delta copy instruction out of bounds");
+            }
+            result.append(base, offset, size);
+        } else if (op) {
+            if (size_t(end - p) < op || result.size() + op > tgt_size) {
+                throw std::runtime_error("Delta insert instruction out of bounds");
+            }
+            result.append(reinterpret_cast<const char*>(p), op);
+            p += op;
+        } else {
+            throw std::runtime_error("Invalid delta opcode 0");
+        }
+    }
+    if (result.size() != tgt_size) {
+        throw std::runtime_error("Delta result size mismatch: expected " + std::to_string(tgt_size)
+                                 + ", got " + std::to_string(result.size()));
+    }
+    return result;
+}
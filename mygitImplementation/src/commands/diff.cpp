@@ -3,251 +3,801 @@
 #include "headers/objects.h"
 #include "headers/utils.h"
 #include "headers/index.h"
+#include "headers/hash.h"
+#include "headers/config.h"
+#include "headers/parallel.h"
+#include "headers/fsmonitor.h"
+#include "headers/ignore.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <cstdlib>
 #include <iostream>
-#include <set>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
-std::string get_workdir_sha(const std::string& path) {
+#include <dirent.h>
+#include <sys/stat.h>
+
+std::optional<ObjectId> get_workdir_sha(const std::string& path) {
     try {
-        std::string content = read_file(path);
-        // If read_file returns empty for non-existent file, compute_sha1 handles it.
-        // If read_file throws, we catch it below.
-        return compute_sha1(content);
+        return hash_file_object(path, "blob", false);
     } catch (const std::exception& e) {
         std::cerr << "Warning: Cannot read/hash workdir file " << path << ": " << e.what() << std::endl;
-        return ""; // Return empty on error
+        return std::nullopt;
+    }
+}
+
+namespace {
+
+// Files up to this size are read and hashed in groups; larger ones are
+// streamed one at a time.
+const uint64_t BATCH_HASH_MAX_FILE = 64 * 1024;
+const size_t BATCH_HASH_MAX_BYTES = 4 * 1024 * 1024;
+
+} // namespace
+
+std::vector<std::optional<ObjectId>> get_workdir_shas(const std::vector<std::string>& paths) {
+    std::vector<std::optional<ObjectId>> result(paths.size());
+    std::vector<size_t> group;
+    std::vector<std::string> contents;
+    size_t group_bytes = 0;
+
+    auto hash_group = [&]() {
+        if (group.empty()) return;
+        std::vector<std::string_view> views(contents.begin(), contents.end());
+        std::vector<ObjectId> ids(group.size());
+        sha1_batch(views.data(), views.size(), ids.data());
+        for (size_t i = 0; i < group.size(); ++i) result[group[i]] = ids[i];
+        group.clear();
+        contents.clear();
+        group_bytes = 0;
+    };
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        try {
+            std::error_code ec;
+            uintmax_t size = fs::file_size(paths[i], ec);
+            if (ec || size > BATCH_HASH_MAX_FILE) {
+                result[i] = hash_file_object(paths[i], "blob", false);
+                continue;
+            }
+            contents.push_back(read_file(paths[i]));
+            group.push_back(i);
+            group_bytes += contents.back().size();
+            if (group_bytes >= BATCH_HASH_MAX_BYTES) hash_group();
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Cannot read/hash workdir file " << paths[i] << ": " << e.what() << std::endl;
+        }
     }
+    hash_group();
+    return result;
 }
 
 // --- Tree Reading ---
 
 // Recursive helper for read_tree_contents
-void read_tree_recursive(const std::string& tree_sha1, const std::string& current_path_prefix, std::map<std::string, std::string>& contents) {
-    if (tree_sha1.empty()) return;
-
+void read_tree_recursive(const ObjectId& tree_sha1, const std::string& current_path_prefix, std::map<std::string, ObjectId>& contents) {
     try {
-        // Read the tree object itself
-        // NOTE: Using read_object here which parses fully. Could optimize by just getting content.
-        ParsedObject parsed_obj = read_object(tree_sha1);
-        if (parsed_obj.type != "tree") {
+        // Trees are shared between commits (and read again by merge/status), so use the object cache.
+        std::shared_ptr<const ParsedObject> parsed_obj = read_object_cached(tree_sha1);
+        if (parsed_obj->type != "tree") {
             // This could happen if a commit points to a non-tree object
-            std::cerr << "Warning: Expected tree object, got " << parsed_obj.type << " for SHA " << tree_sha1 << std::endl;
+            std::cerr << "Warning: Expected tree object, got " << parsed_obj->type << " for SHA " << tree_sha1 << std::endl;
             return;
         }
-        const auto& tree_obj = std::get<TreeObject>(parsed_obj.data); // Get the parsed TreeObject
+        const auto& tree_obj = std::get<TreeObject>(parsed_obj->data); // Get the parsed TreeObject
 
         // Iterate through entries in *this* tree
         for (const auto& entry : tree_obj.entries) {
             // Construct full path relative to the root
-            std::string full_path = current_path_prefix.empty() ? entry.name : current_path_prefix + "/" + entry.name;
+            std::string full_path = current_path_prefix;
+            if (!full_path.empty()) full_path += '/';
+            full_path += entry.name;
 
             if (entry.mode == "40000") { // It's a subdirectory (subtree)
-                // Recurse into the subtree
                 read_tree_recursive(entry.sha1, full_path, contents);
             } else { // It's a blob (file) or symlink
-                // Store the blob/symlink SHA associated with the full path
-                contents[full_path] = entry.sha1;
-                // If mode was needed: contents[full_path] = {entry.sha1, entry.mode};
+                contents[std::move(full_path)] = entry.sha1;
             }
         }
     } catch (const std::exception& e) {
         // If tree object doesn't exist or is corrupt, stop recursion for this path
-        std::cerr << "Warning: Failed to read or parse tree object " << tree_sha1.substr(0, 7) << ": " << e.what() << std::endl;
+        std::cerr << "Warning: Failed to read or parse tree object " << tree_sha1.short_hex() << ": " << e.what() << std::endl;
     }
 }
 
 // Public function to get flattened tree contents
-std::map<std::string, std::string> read_tree_contents(const std::string& tree_sha1) {
-    std::map<std::string, std::string> contents;
+std::map<std::string, ObjectId> read_tree_contents(const ObjectId& tree_sha1) {
+    std::map<std::string, ObjectId> contents;
     read_tree_recursive(tree_sha1, "", contents); // Start recursion with empty prefix
     return contents;
 }
 
-void read_tree_full_recursive(const std::string& tree_sha1, const std::string& current_path_prefix, std::map<std::string, TreeEntry>& contents) {
-    if (tree_sha1.empty()) return;
+void read_tree_full_recursive(const ObjectId& tree_sha1, const std::string& current_path_prefix, std::map<std::string, TreeEntry>& contents) {
     try {
-        ParsedObject parsed_obj = read_object(tree_sha1);
-        if (parsed_obj.type != "tree") {
-            std::cerr << "Warning: Expected tree object, got " << parsed_obj.type << " for SHA " << tree_sha1 << std::endl;
+        std::shared_ptr<const ParsedObject> parsed_obj = read_object_cached(tree_sha1);
+        if (parsed_obj->type != "tree") {
+            std::cerr << "Warning: Expected tree object, got " << parsed_obj->type << " for SHA " << tree_sha1 << std::endl;
             return;
         }
-        const auto& tree_obj = std::get<TreeObject>(parsed_obj.data);
+        const auto& tree_obj = std::get<TreeObject>(parsed_obj->data);
 
         for (const auto& entry : tree_obj.entries) {
-            std::string full_path = current_path_prefix.empty() ? entry.name : current_path_prefix + "/" + entry.name;
+            std::string full_path = current_path_prefix;
+            if (!full_path.empty()) full_path += '/';
+            full_path += entry.name;
             if (entry.mode == "40000") { // Subdirectory
                 // Recursively read the subtree
                 read_tree_full_recursive(entry.sha1, full_path, contents);
             } else { // Blob or Symlink
-                // Store the full TreeEntry associated with the full path
-                TreeEntry full_path_entry = entry; // Copy entry data
-                full_path_entry.name = full_path; // Use the full path as the effective name/key
-                contents[full_path] = full_path_entry;
+                // The full path doubles as the effective name/key
+                TreeEntry& full_path_entry = contents[full_path];
+                full_path_entry.mode = entry.mode;
+                full_path_entry.sha1 = entry.sha1;
+                full_path_entry.name = std::move(full_path);
             }
         }
     } catch (const std::exception& e) {
-        std::cerr << "Warning: Failed to read or parse tree object " << tree_sha1.substr(0, 7) << " for full read: " << e.what() << std::endl;
+        std::cerr << "Warning: Failed to read or parse tree object " << tree_sha1.short_hex() << " for full read: " << e.what() << std::endl;
     }
 }
 
 // *** NEW: Public function for full tree map ***
-std::map<std::string, TreeEntry> read_tree_full(const std::string& tree_sha1) {
+std::map<std::string, TreeEntry> read_tree_full(const ObjectId& tree_sha1) {
     std::map<std::string, TreeEntry> contents;
     read_tree_full_recursive(tree_sha1, "", contents);
     return contents;
 }
 
-std::map<std::string, StatusEntry> get_repository_status() {
-    std::map<std::string, StatusEntry> status_map;
-    std::set<std::string> all_paths;
-
-    // 1. Get HEAD commit's tree contents {path: sha1}
-    std::map<std::string, std::string> head_tree_contents;
-    std::optional<std::string> head_commit_sha = resolve_ref("HEAD");
-    std::cout << "DEBUG_STATUS: Resolving HEAD commit..." << std::endl; // Keep this
-    if (head_commit_sha) {
-        std::cout << "DEBUG_STATUS: HEAD commit SHA = " << *head_commit_sha << std::endl; // Keep this
-        try {
-            ParsedObject commit_obj = read_object(*head_commit_sha);
-            if (commit_obj.type == "commit") {
-                std::string tree_sha = std::get<CommitObject>(commit_obj.data).tree_sha1;
-                 std::cout << "DEBUG_STATUS: HEAD tree SHA = " << tree_sha << std::endl; // Keep this
-                if (!tree_sha.empty()) {
-                    head_tree_contents = read_tree_contents(tree_sha); // Call recursive read
-                    // *** ADD THIS DEBUG BLOCK ***
-                    std::cout << "DEBUG_STATUS: Read HEAD tree contents. Size = " << head_tree_contents.size() << std::endl;
-                    for (const auto& pair : head_tree_contents) {
-                         std::cout << "DEBUG_STATUS:   HEAD Tree Entry: " << pair.first << " -> " << pair.second.substr(0,7) << std::endl;
-                    }
-                    // *** END ADDED DEBUG BLOCK ***
-                    for (const auto& pair : head_tree_contents) {
-                        all_paths.insert(pair.first);
-                    }
-                } else {
-                     std::cout << "DEBUG_STATUS: HEAD commit has empty tree SHA!" << std::endl;
-                }
-            } else {
-                 std::cout << "DEBUG_STATUS: HEAD resolved object is not a commit (" << commit_obj.type << ")" << std::endl;
+// --- Tree diff ---
+
+namespace {
+
+uint32_t tree_entry_mode(std::string_view mode) {
+    uint32_t value = 0;
+    for (char c : mode) value = value * 8 + static_cast<uint32_t>(c - '0');
+    return value;
+}
+
+// 'M' unless the path changed between file, symlink and submodule.
+char change_status(uint32_t old_mode, uint32_t new_mode) {
+    return (old_mode & 0170000) == (new_mode & 0170000) ? 'M' : 'T';
+}
+
+// The entries of one tree, read as the walk goes. A null id reads as an
+// empty tree. Entries come in tree order, which is the order of key():
+// the name, with a slash after a directory's.
+class TreeCursor {
+public:
+    explicit TreeCursor(const ObjectId& tree) {
+        if (tree.is_null()) return;
+        raw_ = read_raw_object(tree);
+        if (raw_.type != "tree") throw std::runtime_error("object " + tree.hex() + " is a " + raw_.type + ", not a tree");
+        reader_.emplace(raw_.content);
+        advance();
+    }
+    TreeCursor(const TreeCursor&) = delete; // The reader points into raw_
+    TreeCursor& operator=(const TreeCursor&) = delete;
+
+    bool done() const { return done_; }
+    const std::string& key() const { return key_; }
+    const ObjectId& sha1() const { return entry_.sha1; }
+    uint32_t mode() const { return mode_; }
+    bool is_tree() const { return mode_ == 040000; }
+
+    void advance() {
+        done_ = !reader_ || !reader_->next(entry_);
+        if (done_) return;
+        mode_ = tree_entry_mode(entry_.mode);
+        key_.assign(entry_.name);
+        if (is_tree()) key_.push_back('/');
+    }
+
+private:
+    RawObject raw_;
+    std::optional<TreeReader> reader_;
+    TreeEntryView entry_;
+    uint32_t mode_ = 0;
+    std::string key_;
+    bool done_ = true;
+};
+
+void diff_trees_at(const ObjectId& old_tree, const ObjectId& new_tree, std::string& prefix, const DiffCallback& emit);
+
+// Reports the cursor's entry, at `path`, as deleted (or added), with
+// everything below it for a directory.
+void emit_one_side(const TreeCursor& cursor, std::string& path, bool deleted, const DiffCallback& emit) {
+    if (cursor.is_tree()) {
+        diff_trees_at(deleted ? cursor.sha1() : ObjectId(), deleted ? ObjectId() : cursor.sha1(), path, emit);
+        return;
+    }
+    DiffEntry entry;
+    entry.status = deleted ? 'D' : 'A';
+    entry.path = path;
+    (deleted ? entry.old_mode : entry.new_mode) = cursor.mode();
+    (deleted ? entry.old_sha1 : entry.new_sha1) = cursor.sha1();
+    emit(entry);
+}
+
+// `prefix` is "" or the directory's path with a trailing slash.
+void diff_trees_at(const ObjectId& old_tree, const ObjectId& new_tree, std::string& prefix, const DiffCallback& emit) {
+    if (old_tree == new_tree) return;
+    TreeCursor a(old_tree);
+    TreeCursor b(new_tree);
+    size_t prefix_size = prefix.size();
+    while (!a.done() || !b.done()) {
+        int cmp = a.done() ? 1 : b.done() ? -1 : a.key().compare(b.key());
+        TreeCursor& first = cmp <= 0 ? a : b;
+        prefix.append(first.key());
+        if (cmp != 0) {
+            emit_one_side(first, prefix, cmp < 0, emit);
+            first.advance();
+        } else {
+            if (a.is_tree()) {
+                diff_trees_at(a.sha1(), b.sha1(), prefix, emit); // Returns at once if unchanged
+            } else if (a.sha1() != b.sha1() || a.mode() != b.mode()) {
+                emit(DiffEntry{change_status(a.mode(), b.mode()), prefix, a.mode(), b.mode(), a.sha1(), b.sha1()});
             }
-        } catch (const std::exception& e) {
-            std::cerr << "DEBUG_STATUS: Exception reading HEAD commit/tree: " << e.what() << std::endl;
-         }
-    } else {
-         std::cout << "DEBUG_STATUS: HEAD could not be resolved to a commit." << std::endl;
-    }
-
-
-    // 2. Read the index {path: {stage: IndexEntry}}
-    // ... (Index reading logic as before, populating index_stage0 and all_paths) ...
-    IndexMap index = read_index();
-    std::map<std::string, IndexEntry> index_stage0;
-    bool has_conflicts = false;
-    for (const auto& path_pair : index) {
-        all_paths.insert(path_pair.first);
-        bool path_conflicted = false;
-        for (const auto& stage_pair : path_pair.second) {
-            if (stage_pair.first > 0) {
-                has_conflicts = true;
-                path_conflicted = true;
+            a.advance();
+            b.advance();
+        }
+        prefix.resize(prefix_size);
+    }
+}
+
+// Reports index records [begin, end) as added: 'U' once for a conflicted
+// path, and the files of a sparse directory entry's tree.
+void emit_index_added(const Index& index, size_t begin, size_t end, const DiffCallback& emit) {
+    for (size_t i = begin; i < end;) {
+        const IndexRecord& rec = index[i];
+        size_t last = i + 1;
+        while (last < end && index[last].path() == rec.path()) ++last;
+        std::string path(rec.path());
+        if (index[last - 1].stage > 0) {
+            emit(DiffEntry{'U', path, 0, 0, ObjectId(), ObjectId()});
+        } else if (rec.is_sparse_directory()) {
+            diff_trees_at(ObjectId(), rec.sha1, path, emit);
+        } else {
+            emit(DiffEntry{'A', path, 0, rec.mode, ObjectId(), rec.sha1});
+        }
+        i = last;
+    }
+}
+
+// Walks `tree` against index records [begin, end), which are all below
+// `prefix`; `node` is their cached tree, if any.
+void diff_tree_index_at(const ObjectId& tree, const Index& index, size_t begin, size_t end, const CacheTreeNode* node,
+                        std::string& prefix, const DiffCallback& emit) {
+    TreeCursor cursor(tree);
+    size_t prefix_size = prefix.size();
+    size_t i = begin;
+    while (!cursor.done() || i < end) {
+        // The index's next group: all stages of one path, or everything
+        // below one directory. Its key compares like a tree entry's.
+        std::string_view key;
+        size_t group_end = i;
+        bool dir = false;
+        if (i < end) {
+            std::string_view rest = index[i].path().substr(prefix_size);
+            size_t slash = rest.find('/');
+            if (slash == std::string_view::npos) {
+                key = rest;
+                while (group_end < end && index[group_end].path() == index[i].path()) ++group_end;
+            } else {
+                dir = true;
+                key = rest.substr(0, slash + 1);
+                std::string dir_end(index[i].path().substr(0, prefix_size + slash));
+                dir_end.push_back('0'); // Everything under "<dir>/" sorts before "<dir>0"
+                group_end = std::min(end, index.lower_bound(dir_end));
             }
         }
-        auto stage0_it = path_pair.second.find(0);
-        if (stage0_it != path_pair.second.end()) {
-            index_stage0[path_pair.first] = stage0_it->second;
-            if (path_conflicted) {
-                 status_map[path_pair.first].index_status = FileStatus::Conflicted;
+        int cmp = i >= end ? -1 : cursor.done() ? 1 : cursor.key().compare(key);
+        if (cmp < 0) {
+            prefix.append(cursor.key());
+            emit_one_side(cursor, prefix, true, emit);
+            prefix.resize(prefix_size);
+            cursor.advance();
+            continue;
+        }
+        if (cmp > 0) {
+            emit_index_added(index, i, group_end, emit);
+            i = group_end;
+            continue;
+        }
+
+        prefix.append(key);
+        if (!dir) {
+            const IndexRecord& rec = index[i];
+            if (index[group_end - 1].stage > 0) {
+                emit(DiffEntry{'U', prefix, 0, 0, ObjectId(), ObjectId()});
+            } else if (rec.sha1 != cursor.sha1() || rec.mode != cursor.mode()) {
+                emit(DiffEntry{change_status(cursor.mode(), rec.mode), prefix, cursor.mode(), rec.mode, cursor.sha1(), rec.sha1});
             }
-        } else if (path_conflicted) {
-             status_map[path_pair.first].index_status = FileStatus::Conflicted;
+        } else if (index[i].is_sparse_directory() && group_end == i + 1) {
+            diff_trees_at(cursor.sha1(), index[i].sha1, prefix, emit);
+        } else {
+            const CacheTreeNode* child = node ? node->find(key.substr(0, key.size() - 1)) : nullptr;
+            bool same = child && child->entry_count >= 0 && static_cast<size_t>(child->entry_count) == group_end - i &&
+                        child->oid == cursor.sha1();
+            if (!same) diff_tree_index_at(cursor.sha1(), index, i, group_end, child, prefix, emit);
         }
+        prefix.resize(prefix_size);
+        cursor.advance();
+        i = group_end;
     }
+}
 
+} // namespace
 
-    // 3. Scan Working Directory for *existing* files and add their paths
-    // ... (Workdir scanning logic as before, populating workdir_existing_paths and all_paths) ...
-    std::set<std::string> workdir_existing_paths;
-    try {
-        // ... (recursive_directory_iterator loop as before) ...
-         if (!fs::exists(".")) { throw std::runtime_error("CWD does not exist."); }
-        for (auto it = fs::recursive_directory_iterator("."), end = fs::recursive_directory_iterator(); it != end; ++it) {
-            // ... (path calculation, ignore logic) ...
-             fs::path current_path_fs = it->path();
-            std::string generic_rel_path;
-            try {
-                fs::path repo_root = fs::current_path();
-                fs::path rel_path = fs::relative(current_path_fs, repo_root);
-                generic_rel_path = rel_path.generic_string();
-                if (generic_rel_path.empty() || generic_rel_path == ".") continue;
-            } catch (...) { continue; }
-             bool ignored = false;
-            if (generic_rel_path == GIT_DIR || generic_rel_path.rfind(GIT_DIR + "/", 0) == 0) ignored = true;
-            if (ignored) { if (it->is_directory()) it.disable_recursion_pending(); continue; }
-
-            if (it->is_regular_file() || it->is_symlink()) {
-                all_paths.insert(generic_rel_path);
-                workdir_existing_paths.insert(generic_rel_path);
+void diff_trees(const ObjectId& old_tree, const ObjectId& new_tree, const DiffCallback& emit) {
+    std::string prefix;
+    diff_trees_at(old_tree, new_tree, prefix, emit);
+}
+
+void diff_tree_to_index(const ObjectId& tree, const Index& index, const DiffCallback& emit) {
+    const CacheTreeNode* root = index.cache_tree();
+    if (root && root->entry_count >= 0 && static_cast<size_t>(root->entry_count) == index.size() && root->oid == tree) return;
+    std::string prefix;
+    diff_tree_index_at(tree, index, 0, index.size(), root, prefix, emit);
+}
+
+void diff_index_to_workdir(const Index& index, const DiffCallback& emit) {
+    // Stat everything first; files whose stat data changed are hashed
+    // together afterwards.
+    std::vector<DiffEntry> entries;
+    std::vector<std::string> paths_to_hash;
+    std::vector<size_t> slots_to_hash;
+    for (size_t i = 0; i < index.size();) {
+        const IndexRecord& rec = index[i];
+        size_t last = i + 1;
+        while (last < index.size() && index[last].path() == rec.path()) ++last;
+        std::string path(rec.path());
+        if (index[last - 1].stage > 0) {
+            entries.push_back(DiffEntry{'U', path, 0, 0, ObjectId(), ObjectId()});
+        } else if (!rec.skip_worktree) {
+            IndexStat file_stat;
+            if (!stat_workdir_file(path, file_stat)) {
+                entries.push_back(DiffEntry{'D', path, rec.mode, 0, rec.sha1, ObjectId()});
+            } else if (!index.up_to_date(i, file_stat)) {
+                entries.push_back(DiffEntry{change_status(rec.mode, file_stat.mode), path, rec.mode, file_stat.mode, rec.sha1, ObjectId()});
+                paths_to_hash.push_back(std::move(path));
+                slots_to_hash.push_back(entries.size() - 1);
             }
         }
-    } catch (const fs::filesystem_error& e) { /* ... */ }
-
-
-    // 4. Iterate through all unique paths and determine status
-    // ... (Status determination logic using head_tree_contents, index_stage0, workdir_existing_paths as finalized in previous step) ...
-    for (const std::string& path : all_paths) {
-        bool in_head = (head_tree_contents.count(path) > 0);
-        bool in_index0 = (index_stage0.count(path) > 0);
-        bool in_workdir = (workdir_existing_paths.count(path) > 0);
-
-        std::cout << "DEBUG_STATUS: Checking path='" << path
-                  << "' | in_head=" << in_head
-                  << " | in_index0=" << in_index0
-                  << " | in_workdir=" << in_workdir << std::endl;
-
-        // Get SHAs
-        std::string head_sha = in_head ? head_tree_contents.at(path) : ""; // Use .at for clarity? No, [] is fine.
-        std::string index_sha = in_index0 ? index_stage0.at(path).sha1 : "";
-        std::string workdir_sha = ""; // Calculated later if needed
-
-        // *** Initialize status explicitly for this path ***
-        FileStatus current_index_status = FileStatus::Unmodified; // Default
-        FileStatus current_workdir_status = FileStatus::Unmodified; // Default
-
-        // Check if already marked conflicted during index read
-         bool already_conflicted = false;
-         if (status_map.count(path) && status_map[path].index_status == FileStatus::Conflicted) {
-             already_conflicted = true;
-             current_index_status = FileStatus::Conflicted; // Preserve conflict status
-         }
-
-        if (!already_conflicted) {
-            // Determine Index vs HEAD status
-            if (in_index0 && in_head) {
-                if (index_sha != head_sha) current_index_status = FileStatus::ModifiedStaged;
-            } else if (in_index0 && !in_head) {
-                current_index_status = FileStatus::AddedStaged;
-            } else if (!in_index0 && in_head) {
-                current_index_status = FileStatus::DeletedStaged;
+        i = last;
+    }
+    std::vector<std::optional<ObjectId>> hashed = get_workdir_shas(paths_to_hash);
+    for (size_t j = 0; j < slots_to_hash.size(); ++j) {
+        if (hashed[j]) entries[slots_to_hash[j]].new_sha1 = *hashed[j];
+    }
+    for (const DiffEntry& entry : entries) {
+        // Touched but unchanged files are not differences.
+        if (entry.status == 'M' && entry.new_sha1 == entry.old_sha1 && entry.new_mode == entry.old_mode) continue;
+        emit(entry);
+    }
+}
+
+void count_line_changes(std::string_view a, std::string_view b, size_t& added, size_t& deleted) {
+    auto split_lines = [](std::string_view text) {
+        std::vector<std::string_view> lines;
+        for (size_t pos = 0; pos < text.size();) {
+            size_t newline = text.find('\n', pos);
+            size_t next = newline == std::string_view::npos ? text.size() : newline + 1;
+            lines.push_back(text.substr(pos, next - pos)); // A missing final newline makes a different line
+            pos = next;
+        }
+        return lines;
+    };
+    std::vector<std::string_view> old_lines = split_lines(a);
+    std::vector<std::string_view> new_lines = split_lines(b);
+
+    // Common leading and trailing lines cost nothing in the search below.
+    size_t head = 0;
+    while (head < old_lines.size() && head < new_lines.size() && old_lines[head] == new_lines[head]) ++head;
+    size_t tail = 0;
+    while (tail < old_lines.size() - head && tail < new_lines.size() - head &&
+           old_lines[old_lines.size() - 1 - tail] == new_lines[new_lines.size() - 1 - tail]) {
+        ++tail;
+    }
+    std::unordered_map<std::string_view, int> ids;
+    auto to_ids = [&](const std::vector<std::string_view>& lines) {
+        std::vector<int> out;
+        out.reserve(lines.size() - head - tail);
+        for (size_t i = head; i < lines.size() - tail; ++i) out.push_back(ids.emplace(lines[i], static_cast<int>(ids.size())).first->second);
+        return out;
+    };
+    std::vector<int> x_lines = to_ids(old_lines);
+    std::vector<int> y_lines = to_ids(new_lines);
+
+    // Myers' greedy search for the shortest edit script; only its length
+    // is needed. v[k] is the furthest x reached on diagonal k = x - y.
+    long n = static_cast<long>(x_lines.size());
+    long m = static_cast<long>(y_lines.size());
+    long offset = n + m + 1;
+    std::vector<long> v(static_cast<size_t>(2 * offset + 1), 0);
+    long edits = n + m;
+    for (long d = 0; d <= n + m; ++d) {
+        bool found = false;
+        for (long k = -d; k <= d; k += 2) {
+            long x = (k == -d || (k != d && v[k - 1 + offset] < v[k + 1 + offset])) ? v[k + 1 + offset] : v[k - 1 + offset] + 1;
+            long y = x - k;
+            while (x < n && y < m && x_lines[x] == y_lines[y]) {
+                ++x;
+                ++y;
             }
-            std::cout << "DEBUG_STATUS:   -> IndexStatus=" << static_cast<int>(current_index_status) << std::endl;
-
-            // Determine Workdir vs Index status
-            if (in_index0) {
-                if (in_workdir) {
-                    workdir_sha = get_workdir_sha(path);
-                    if (workdir_sha.empty() || workdir_sha != index_sha) {
-                        current_workdir_status = FileStatus::ModifiedWorkdir;
-                    }
-                } else { current_workdir_status = FileStatus::DeletedWorkdir; }
-            } else { if (in_workdir) { current_workdir_status = FileStatus::AddedWorkdir; } }
-            std::cout << "DEBUG_STATUS:   -> WorkdirStatus=" << static_cast<int>(current_workdir_status) << std::endl;
+            v[k + offset] = x;
+            if (x >= n && y >= m) {
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            edits = d;
+            break;
+        }
+    }
+    deleted = static_cast<size_t>((edits + n - m) / 2);
+    added = static_cast<size_t>((edits + m - n) / 2);
+}
+
+namespace {
+
+// Index positions checked (stat, then hashed if needed) per work item.
+const size_t STATUS_SLICE_SIZE = 512;
+
+// Worker threads for status: MYGIT_STATUS_THREADS or status.threads, where 0
+// (the default) means one per core.
+unsigned status_thread_count() {
+    const char* env = std::getenv("MYGIT_STATUS_THREADS");
+    std::optional<std::string> value = env ? std::optional<std::string>(env) : get_config_value("status.threads");
+    int requested = 0;
+    if (value) {
+        if (!value->empty() && value->size() <= 4 && value->find_first_not_of("0123456789") == std::string::npos) {
+            requested = std::stoi(*value);
         } else {
-             std::cout << "DEBUG_STATUS:   -> Path was pre-marked Conflicted." << std::endl;
+            std::cerr << "Warning: Ignoring status.threads '" << *value << "'" << std::endl;
+        }
+    }
+    return resolve_thread_count(requested);
+}
+
+// core.untrackedCache: on unless set to false.
+bool untracked_cache_enabled() {
+    std::optional<std::string> value = get_config_value("core.untrackedCache");
+    if (value) {
+        try {
+            return parse_bool_value(*value);
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Ignoring core.untrackedCache: " << e.what() << std::endl;
+        }
+    }
+    return true;
+}
+
+// A directory for scan_workdir to visit ("" for the top, else ending in
+// '/'): its entry in the previous untracked cache, if any, and the entry to
+// fill in for the new one.
+struct DirectoryJob {
+    std::string dir;
+    const UntrackedCacheDir* cached = nullptr;
+    UntrackedCacheDir* result = nullptr;
+};
+
+// Directories still to be visited by scan_workdir. Workers take the most
+// recently found directory (depth first, so the queue stays small) and add
+// the subdirectories they find; the walk ends when the queue is empty and no
+// worker is still visiting a directory.
+class DirectoryQueue {
+public:
+    void push(DirectoryJob job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        ready_.notify_one();
+    }
+
+    // Blocks until a directory is available; false once the walk is over.
+    bool pop(DirectoryJob& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !jobs_.empty() || busy_ == 0; });
+        if (jobs_.empty()) return false;
+        job = std::move(jobs_.back());
+        jobs_.pop_back();
+        ++busy_;
+        return true;
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--busy_ == 0 && jobs_.empty()) ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<DirectoryJob> jobs_;
+    size_t busy_ = 0;
+};
+
+struct WorkdirScan {
+    explicit WorkdirScan(const Index& scanned) : index(scanned) {}
+
+    const Index& index;
+    IgnoreRules ignore;
+    DirectoryQueue queue;
+    uint32_t start_sec = 0;          // Wall clock second the scan started
+    const FsmonitorChanges* fsmonitor = nullptr; // Complete changes since the cache was made, if known
+    std::atomic<bool> cache_updated{false};
+};
+
+// `cached` is job's cache entry, or null if it cannot be used below job.
+void queue_subdirectory(WorkdirScan& scan, const DirectoryJob& job, const UntrackedCacheDir* cached, std::string name) {
+    auto sub = std::make_unique<UntrackedCacheDir>();
+    DirectoryJob sub_job{job.dir + name + "/", cached ? cached->find(name) : nullptr, sub.get()};
+    job.result->subdirs.emplace_back(std::move(name), std::move(sub));
+    scan.queue.push(std::move(sub_job));
+}
+
+// Appends the untracked, not ignored files and symlinks of job.dir to
+// `files` and queues its subdirectories that are not ignored. Symlinks to
+// directories are listed, not followed. Tracked files are left to the
+// caller, which stats them anyway. A directory unchanged since the cached
+// listing is not read at all; when the filesystem monitor reports nothing in
+// it, it is not even stat'ed.
+void scan_directory(WorkdirScan& scan, const DirectoryJob& job, std::vector<std::string>& files) {
+    UntrackedCacheDir& result = *job.result;
+    bool unchanged = false;
+    bool reported = true; // By the monitor, if there is one we trust
+    if (scan.fsmonitor && job.cached && job.cached->valid && !scan.fsmonitor->listing_changed(job.dir)) {
+        result.stat = job.cached->stat;
+        unchanged = true;
+        reported = false;
+    } else {
+        if (!stat_workdir_directory(job.dir.empty() ? "." : job.dir, result.stat)) return;
+        unchanged = job.cached && job.cached->valid && job.cached->stat == result.stat;
+    }
+    // Editing a .gitignore does not touch the directory. The top's rules
+    // also cover .mygit/info/exclude, which the monitor does not watch.
+    const UntrackedCacheDir* cached_below = job.cached;
+    if (job.cached && (job.dir.empty() || (reported && !job.cached->ignore_id.is_null())) &&
+        scan.ignore.rules_id(job.dir) != job.cached->ignore_id) {
+        unchanged = false;
+        cached_below = nullptr; // The rules apply to everything below too
+    }
+    if (unchanged) {
+        result.valid = true;
+        result.ignore_id = job.cached->ignore_id;
+        result.untracked = job.cached->untracked;
+        for (const std::string& name : result.untracked) files.push_back(job.dir + name);
+        for (const auto& sub : job.cached->subdirs) queue_subdirectory(scan, job, cached_below, sub.first);
+        return;
+    }
+
+    result.ignore_id = scan.ignore.rules_id(job.dir);
+
+    DIR* handle = opendir(job.dir.empty() ? "." : job.dir.c_str());
+    if (!handle) return;
+    while (struct dirent* entry = readdir(handle)) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        if (job.dir.empty() && name == GIT_DIR) continue;
+        std::string path = job.dir + name;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) continue;
+            if (S_ISDIR(st.st_mode)) type = DT_DIR;
+            else if (S_ISREG(st.st_mode)) type = DT_REG;
+            else if (S_ISLNK(st.st_mode)) type = DT_LNK;
+        }
+        if (type == DT_DIR) {
+            if (!scan.ignore.is_ignored(path, true)) queue_subdirectory(scan, job, cached_below, name);
+        } else if ((type == DT_REG || type == DT_LNK) && scan.index.find(path) == Index::npos &&
+                   !scan.ignore.is_ignored(path, false)) {
+            result.untracked.push_back(name);
+            files.push_back(std::move(path));
+        }
+    }
+    closedir(handle);
+    std::sort(result.untracked.begin(), result.untracked.end());
+    std::sort(result.subdirs.begin(), result.subdirs.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    // A change later in the second it was last modified would not show.
+    result.valid = result.stat.mtime_sec < scan.start_sec;
+    if (result.valid) scan.cache_updated = true;
+}
+
+// Sorted paths, relative to the repository root, of the files and symlinks
+// outside .mygit that have no stage 0 index entry and are not ignored. Directories are visited
+// on up to `threads` threads, each collecting its own list; the lists are
+// merged at the end. Directories unchanged since `cached` (may be null) are
+// not read. The new untracked cache goes to `result`; cache_updated is set
+// if it holds anything worth writing back.
+std::vector<std::string> scan_workdir(const Index& index, unsigned threads, const UntrackedCacheDir* cached,
+                                      const FsmonitorChanges* fsmonitor,
+                                      std::unique_ptr<UntrackedCacheDir>& result, bool& cache_updated) {
+    WorkdirScan scan(index);
+    scan.start_sec = static_cast<uint32_t>(std::time(nullptr));
+    scan.fsmonitor = fsmonitor;
+    auto root = std::make_unique<UntrackedCacheDir>();
+    scan.queue.push(DirectoryJob{"", cached, root.get()});
+
+    std::vector<std::vector<std::string>> found(std::max(1u, threads));
+    auto work = [&](size_t worker) {
+        DirectoryJob job;
+        while (scan.queue.pop(job)) {
+            scan_directory(scan, job, found[worker]);
+            scan.queue.done();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < found.size(); ++t) pool.emplace_back(work, t);
+    work(0);
+    for (auto& thread : pool) thread.join();
+
+    result = std::move(root);
+    cache_updated = scan.cache_updated;
+    std::vector<std::string> files = std::move(found[0]);
+    for (size_t t = 1; t < found.size(); ++t) {
+        files.insert(files.end(), std::make_move_iterator(found[t].begin()), std::make_move_iterator(found[t].end()));
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+} // namespace
+
+std::map<std::string, StatusEntry> get_repository_status() {
+    std::map<std::string, StatusEntry> status_map;
+    Index index = read_index();
+
+    // 1. Conflicted paths in the index are marked now and left out below.
+    for (const IndexRecord& rec : index) {
+        if (rec.stage == 0) continue;
+        StatusEntry& entry = status_map[std::string(rec.path())];
+        entry.path = std::string(rec.path());
+        entry.index_status = FileStatus::Conflicted;
+    }
+
+    // 2. Index vs HEAD: HEAD's tree is walked against the index, skipping
+    // directories whose cached tree (or sparse directory entry) matches.
+    ObjectId head_tree;
+    if (std::optional<std::string> head_commit_sha = resolve_ref("HEAD")) {
+        ParsedObject commit_obj = read_object(*head_commit_sha);
+        if (commit_obj.type != "commit") {
+            throw std::runtime_error("HEAD points to a " + commit_obj.type + ", not a commit");
         }
+        head_tree = std::get<CommitObject>(commit_obj.data).tree_sha1;
+    }
+    diff_tree_to_index(head_tree, index, [&](const DiffEntry& change) {
+        if (change.status == 'U') return; // Marked above
+        StatusEntry& entry = status_map[change.path];
+        entry.path = change.path;
+        entry.index_status = change.status == 'A'   ? FileStatus::AddedStaged
+                             : change.status == 'D' ? FileStatus::DeletedStaged
+                                                    : FileStatus::ModifiedStaged;
+    });
+
+    // 3. Scan the working directory and compare tracked files with the index.
+    if (!fs::exists(".")) { throw std::runtime_error("CWD does not exist."); }
+    unsigned threads = status_thread_count();
+
+    // With the filesystem monitor, ask what changed since the token stored
+    // with the index. Asked before looking at anything, so whatever changes
+    // while this status runs is reported next time.
+    std::optional<FsmonitorChanges> fsmonitor;
+    if (fsmonitor_configured()) fsmonitor = query_fsmonitor(index.fsmonitor_token());
+    const FsmonitorChanges* changes = fsmonitor && fsmonitor->complete ? &*fsmonitor : nullptr;
 
-        // Update the map entry for this path
-        status_map[path].path = path;
-        status_map[path].index_status = current_index_status;
-        status_map[path].workdir_status = current_workdir_status;
+    bool use_untracked_cache = untracked_cache_enabled();
+    std::unique_ptr<UntrackedCacheDir> untracked_cache;
+    bool untracked_cache_updated = false;
+    std::vector<std::string> untracked_files =
+        scan_workdir(index, threads, use_untracked_cache ? index.untracked_cache() : nullptr, changes,
+                     untracked_cache, untracked_cache_updated);
+    for (std::string& path : untracked_files) {
+        StatusEntry& entry = status_map[path];
+        entry.path = std::move(path);
+        entry.workdir_status = FileStatus::AddedWorkdir;
+    }
+
+    // Tracked files are found by stat. Those whose stat data still matches
+    // the index are taken to be unchanged without reading them; the rest are
+    // hashed, small files through the batch hasher. Both happen on the worker
+    // threads, a slice of index positions at a time; the results are merged
+    // below. Entries the monitor vouches for are not even stat'ed.
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < index.size(); ++i) {
+        if (index[i].stage == 0) positions.push_back(i);
+    }
+    std::vector<std::optional<ObjectId>> position_shas(positions.size());
+    std::vector<IndexStat> position_stats(positions.size());
+    std::vector<char> position_exists(positions.size(), 0);
+    std::vector<char> position_hashed(positions.size(), 0);
+    size_t slices = (positions.size() + STATUS_SLICE_SIZE - 1) / STATUS_SLICE_SIZE;
+    parallel_for(slices, threads, [&](size_t slice) {
+        size_t begin = slice * STATUS_SLICE_SIZE;
+        size_t end = std::min(positions.size(), begin + STATUS_SLICE_SIZE);
+        std::vector<std::string> paths_to_hash;
+        std::vector<size_t> slots_to_hash;
+        for (size_t k = begin; k < end; ++k) {
+            const IndexRecord& rec = index[positions[k]];
+            if (rec.skip_worktree) { // Outside the sparse checkout: not looked at
+                position_exists[k] = 1;
+                position_shas[k] = rec.sha1;
+                continue;
+            }
+            if (changes && rec.fsmonitor_valid && !changes->path_changed(rec.path())) {
+                position_exists[k] = 1;
+                position_shas[k] = rec.sha1;
+                continue;
+            }
+            std::string path(rec.path());
+            if (!stat_workdir_file(path, position_stats[k])) continue;
+            position_exists[k] = 1;
+            if (index.up_to_date(positions[k], position_stats[k])) {
+                position_shas[k] = rec.sha1;
+                continue;
+            }
+            paths_to_hash.push_back(std::move(path));
+            slots_to_hash.push_back(k);
+        }
+        std::vector<std::optional<ObjectId>> hashed = get_workdir_shas(paths_to_hash);
+        for (size_t j = 0; j < slots_to_hash.size(); ++j) {
+            position_shas[slots_to_hash[j]] = hashed[j];
+            position_hashed[slots_to_hash[j]] = 1;
+        }
+    });
+
+    bool index_refreshed = false;
+    std::string fsmonitor_token = fsmonitor ? fsmonitor->token : std::string();
+    bool token_changed = fsmonitor_token != index.fsmonitor_token();
+    if (token_changed) {
+        index.set_fsmonitor_token(fsmonitor_token);
+        index_refreshed = true;
+    }
+    for (size_t k = 0; k < positions.size(); ++k) {
+        const IndexRecord& rec = index[positions[k]];
+        const std::optional<ObjectId>& sha = position_shas[k];
+        // Clean as of the new token: later changes will be reported.
+        bool clean = fsmonitor && !rec.skip_worktree && position_exists[k] && sha && *sha == rec.sha1;
+        if (rec.fsmonitor_valid != clean) {
+            index.set_fsmonitor_valid(positions[k], clean);
+            index_refreshed = true;
+        }
+        if (!position_exists[k] || !sha || *sha != rec.sha1) {
+            StatusEntry& entry = status_map[std::string(rec.path())];
+            entry.path = std::string(rec.path());
+            entry.workdir_status = position_exists[k] ? FileStatus::ModifiedWorkdir : FileStatus::DeletedWorkdir;
+        }
+        if (!position_exists[k]) continue;
+        // Same content after all (touched, or stat never recorded): remember
+        // the stat so the next status can skip it.
+        const IndexStat& file_stat = position_stats[k];
+        if (position_hashed[k] && sha && *sha == rec.sha1 && !file_stat.empty() && file_stat.mode == rec.mode) {
+            index.set_stat(positions[k], file_stat);
+            index_refreshed = true;
+        }
+    }
+    // Under a new token the cache has to be current too, since directories
+    // the monitor reported before it will not be reported again.
+    if (untracked_cache_updated || (use_untracked_cache && token_changed) ||
+        (!use_untracked_cache && index.untracked_cache())) {
+        index.set_untracked_cache(use_untracked_cache ? std::move(untracked_cache) : nullptr);
+        index_refreshed = true;
+    }
+    if (index_refreshed) {
+        try {
+            write_index(index);
+        } catch (const std::exception&) {
+            // Only an optimisation; a read-only repository still gets its status.
+        }
     }
 
     return status_map;
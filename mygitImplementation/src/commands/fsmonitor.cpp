@@ -0,0 +1,475 @@
+#include "headers/fsmonitor.h"
+#include "headers/config.h"
+#include "headers/utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// Protocol: the client sends one line, "query <token>", "ping" or "quit".
+// A query is answered with "<token> <complete>\n" (complete is 0 or 1),
+// then the changed paths, each followed by a NUL. A ping is answered with
+// the daemon's process ID.
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+const int CLIENT_TIMEOUT_SEC = 10;
+
+std::string socket_path() {
+    return GIT_DIR + "/fsmonitor.sock";
+}
+
+bool make_socket_address(sockaddr_un& addr) {
+    std::string path = socket_path();
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+void set_timeouts(int fd, int seconds) {
+    timeval tv{};
+    tv.tv_sec = seconds;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, SEND_FLAGS);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Sends one request line and reads the answer up to EOF. False if no
+// daemon answered.
+bool ask_daemon(const std::string& request, std::string& answer) {
+    sockaddr_un addr;
+    if (!make_socket_address(addr)) return false;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    set_timeouts(fd, CLIENT_TIMEOUT_SEC);
+    bool ok = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && send_all(fd, request + "\n");
+    answer.clear();
+    char buf[64 * 1024];
+    while (ok) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) ok = false;
+        if (n <= 0) break;
+        answer.append(buf, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+bool FsmonitorChanges::path_changed(std::string_view path) const {
+    if (std::binary_search(paths.begin(), paths.end(), path)) return true;
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+        if (std::binary_search(paths.begin(), paths.end(), path.substr(0, slash))) return true;
+    }
+    return false;
+}
+
+bool FsmonitorChanges::listing_changed(std::string_view dir) const {
+    if (!dir.empty() && path_changed(dir.substr(0, dir.size() - 1))) return true;
+    return std::binary_search(parents.begin(), parents.end(), dir);
+}
+
+bool fsmonitor_configured() {
+    std::optional<std::string> value = get_config_value("core.fsmonitor");
+    if (!value) return false;
+    try {
+        return parse_bool_value(*value);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Ignoring core.fsmonitor: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::optional<FsmonitorChanges> query_fsmonitor(const std::string& token) {
+    std::string answer;
+    if (!ask_daemon("query " + token, answer)) return std::nullopt;
+    size_t eol = answer.find('\n');
+    size_t space = answer.rfind(' ', eol);
+    if (eol == std::string::npos || space == std::string::npos || space + 2 != eol) return std::nullopt;
+
+    FsmonitorChanges changes;
+    changes.token = answer.substr(0, space);
+    changes.complete = answer[space + 1] == '1';
+    std::set<std::string> parents;
+    size_t pos = eol + 1;
+    while (pos < answer.size()) {
+        size_t nul = answer.find('\0', pos);
+        if (nul == std::string::npos) return std::nullopt; // Cut short
+        std::string path = answer.substr(pos, nul - pos);
+        size_t slash = path.rfind('/');
+        parents.insert(slash == std::string::npos ? std::string() : path.substr(0, slash + 1));
+        changes.paths.push_back(std::move(path));
+        pos = nul + 1;
+    }
+    std::sort(changes.paths.begin(), changes.paths.end());
+    changes.parents.assign(parents.begin(), parents.end());
+    return changes;
+}
+
+long fsmonitor_daemon_pid() {
+    std::string answer;
+    if (!ask_daemon("ping", answer)) return -1;
+    try {
+        return std::stol(answer);
+    } catch (const std::exception&) {
+        return -1;
+    }
+}
+
+bool stop_fsmonitor_daemon() {
+    std::string answer;
+    return ask_daemon("quit", answer);
+}
+
+#ifdef __linux__
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_DONT_FOLLOW | IN_EXCL_UNLINK | IN_ONLYDIR;
+// Past this many journal entries the oldest are dropped; clients holding a
+// token from before then rescan.
+const size_t JOURNAL_LIMIT = 1000000;
+
+class Monitor {
+public:
+    ~Monitor() {
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+            ::unlink(socket_path().c_str());
+        }
+        if (inotify_fd_ >= 0) ::close(inotify_fd_);
+    }
+
+    // Watches the working tree, then starts listening, so no client gets
+    // a token before every directory is watched.
+    void start() {
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd_ < 0) throw std::runtime_error(std::string("inotify_init1 failed: ") + std::strerror(errno));
+        new_instance();
+        watch_tree("");
+
+        sockaddr_un addr;
+        if (!make_socket_address(addr)) throw std::runtime_error("Socket path is too long: " + socket_path());
+        ::unlink(addr.sun_path); // Left behind by a daemon that did not exit cleanly
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, 16) != 0) {
+            throw std::runtime_error("Cannot listen on " + socket_path() + ": " + std::strerror(errno));
+        }
+    }
+
+    void run() {
+        while (!quit_) {
+            pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {listen_fd_, POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+            }
+            if (fds[0].revents & POLLIN) read_events();
+            if (fds[1].revents & POLLIN) {
+                int client = ::accept(listen_fd_, nullptr, nullptr);
+                if (client >= 0) {
+                    serve(client);
+                    ::close(client);
+                }
+            }
+        }
+    }
+
+    size_t watched_directories() const { return dirs_.size(); }
+
+private:
+    // A new instance name invalidates every token handed out so far.
+    void new_instance() {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        instance_ = std::to_string(::getpid()) + "." +
+                    std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()) + "." +
+                    std::to_string(++generation_);
+        journal_.clear();
+        seq_ = 0;
+        trimmed_ = 0;
+    }
+
+    std::string token() const { return instance_ + ":" + std::to_string(seq_); }
+
+    // Adds watches for `dir` ("" or ending in '/') and every directory below it.
+    void watch_tree(const std::string& top) {
+        std::vector<std::string> pending{top};
+        while (!pending.empty()) {
+            std::string dir = std::move(pending.back());
+            pending.pop_back();
+            int wd = inotify_add_watch(inotify_fd_, dir.empty() ? "." : dir.c_str(), WATCH_MASK);
+            if (wd < 0) {
+                if (errno == ENOENT || errno == ENOTDIR) continue; // Gone again already
+                // Most likely fs.inotify.max_user_watches: changes there would go unseen.
+                std::cerr << "Warning: Cannot watch '" << dir << "': " << std::strerror(errno)
+                          << "; every query will ask for a full rescan" << std::endl;
+                degraded_ = true;
+                continue;
+            }
+            dirs_[wd] = dir;
+            DIR* handle = opendir(dir.empty() ? "." : dir.c_str());
+            if (!handle) continue;
+            while (struct dirent* entry = readdir(handle)) {
+                const char* name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+                if (dir.empty() && name == GIT_DIR) continue;
+                std::string path = dir + name;
+                bool is_dir = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_UNKNOWN) {
+                    struct stat st;
+                    is_dir = ::lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+                }
+                if (is_dir) pending.push_back(path + "/");
+            }
+            closedir(handle);
+        }
+    }
+
+    // A directory moved away keeps its watches, which would report under
+    // the old name; drop them (it is watched again where it lands).
+    void unwatch_tree(const std::string& dir) {
+        for (auto it = dirs_.begin(); it != dirs_.end();) {
+            if (it->second.compare(0, dir.size(), dir) == 0) {
+                inotify_rm_watch(inotify_fd_, it->first);
+                it = dirs_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void record(std::string path) {
+        if (!journal_.empty() && journal_.back().second == path) { // Repeated writes to one file
+            journal_.back().first = ++seq_;
+            return;
+        }
+        journal_.emplace_back(++seq_, std::move(path));
+        if (journal_.size() > JOURNAL_LIMIT) {
+            trimmed_ = journal_.front().first;
+            journal_.pop_front();
+        }
+    }
+
+    // Takes in every queued event. Called before answering a query, so a
+    // change the client made before asking is always included.
+    void read_events() {
+        alignas(struct inotify_event) char buf[64 * 1024];
+        for (;;) {
+            ssize_t n = ::read(inotify_fd_, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            for (char* p = buf; p < buf + n;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                handle_event(*event);
+            }
+        }
+    }
+
+    void handle_event(const inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) { // Events were lost
+            new_instance();
+            return;
+        }
+        auto it = dirs_.find(event.wd);
+        if (it == dirs_.end()) return;
+        if (event.mask & IN_IGNORED) {
+            dirs_.erase(it);
+            return;
+        }
+        std::string dir = it->second;
+        if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            if (dir.empty()) quit_ = true; // The working tree itself is gone
+            return;                        // Otherwise the parent reports it
+        }
+        if (event.len == 0) return;
+        std::string name(event.name);
+        if (dir.empty() && name == GIT_DIR) return;
+        std::string path = dir + name;
+        if (event.mask & IN_ISDIR) {
+            if (event.mask & IN_MOVED_FROM) unwatch_tree(path + "/");
+            if (event.mask & (IN_CREATE | IN_MOVED_TO)) watch_tree(path + "/");
+        }
+        record(std::move(path));
+    }
+
+    void serve(int client) {
+        set_timeouts(client, 5);
+        std::string request;
+        char c;
+        while (request.size() < 4096) {
+            ssize_t n = ::recv(client, &c, 1, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0 || c == '\n') break;
+            request.push_back(c);
+        }
+
+        if (request == "ping") {
+            send_all(client, std::to_string(::getpid()) + "\n");
+        } else if (request == "quit") {
+            // Stop listening before answering, so the socket is gone once
+            // "fsmonitor stop" returns.
+            ::close(listen_fd_);
+            ::unlink(socket_path().c_str());
+            listen_fd_ = -1;
+            send_all(client, "bye\n");
+            quit_ = true;
+        } else if (request.rfind("query ", 0) == 0) {
+            read_events();
+            send_all(client, answer_query(request.substr(6)));
+        }
+    }
+
+    std::string answer_query(const std::string& since_token) {
+        uint64_t since = 0;
+        bool complete = !degraded_;
+        size_t colon = since_token.rfind(':');
+        if (colon == std::string::npos || since_token.compare(0, colon, instance_) != 0 || colon != instance_.size()) {
+            complete = false;
+        } else {
+            try {
+                since = std::stoull(since_token.substr(colon + 1));
+            } catch (const std::exception&) {
+                complete = false;
+            }
+            if (since < trimmed_ || since > seq_) complete = false;
+        }
+
+        std::string answer = token() + (complete ? " 1\n" : " 0\n");
+        if (!complete) return answer;
+        auto first = std::upper_bound(journal_.begin(), journal_.end(), since,
+                                      [](uint64_t s, const auto& entry) { return s < entry.first; });
+        std::set<std::string_view> changed;
+        for (auto it = first; it != journal_.end(); ++it) changed.insert(it->second);
+        for (std::string_view path : changed) {
+            answer.append(path.data(), path.size());
+            answer.push_back('\0');
+        }
+        return answer;
+    }
+
+    int inotify_fd_ = -1;
+    int listen_fd_ = -1;
+    std::unordered_map<int, std::string> dirs_; // Watch descriptor -> directory
+    std::deque<std::pair<uint64_t, std::string>> journal_;
+    uint64_t seq_ = 0;
+    uint64_t trimmed_ = 0; // Changes up to this number are no longer listed
+    std::string instance_;
+    unsigned generation_ = 0;
+    bool degraded_ = false;
+    bool quit_ = false;
+};
+
+} // namespace
+
+int run_fsmonitor_daemon(bool detach) {
+    long running = fsmonitor_daemon_pid();
+    if (running > 0) {
+        std::cerr << "fatal: fsmonitor is already running (pid " << running << ")" << std::endl;
+        return 1;
+    }
+
+    if (detach) {
+        pid_t child = ::fork();
+        if (child < 0) {
+            std::cerr << "fatal: fork failed: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        if (child > 0) {
+            // Wait until the daemon answers (or gives up while watching).
+            for (;;) {
+                int status = 0;
+                if (::waitpid(child, &status, WNOHANG) == child) {
+                    std::cerr << "fatal: fsmonitor failed to start" << std::endl;
+                    return 1;
+                }
+                if (fsmonitor_daemon_pid() == child) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            std::cout << "fsmonitor started (pid " << child << ")" << std::endl;
+            return 0;
+        }
+        ::setsid();
+    }
+
+    Monitor monitor;
+    try {
+        monitor.start();
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return 1;
+    }
+    if (detach) {
+        int null_fd = ::open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            ::dup2(null_fd, STDIN_FILENO);
+            ::dup2(null_fd, STDOUT_FILENO);
+            ::dup2(null_fd, STDERR_FILENO);
+            if (null_fd > STDERR_FILENO) ::close(null_fd);
+        }
+    } else {
+        std::cout << "fsmonitor watching " << monitor.watched_directories() << " directories" << std::endl;
+    }
+    try {
+        monitor.run();
+    } catch (const std::exception& e) {
+        std::cerr << "fatal: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+int run_fsmonitor_daemon(bool) {
+    std::cerr << "fatal: fsmonitor needs inotify, which is only available on Linux" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include "headers/gc.h"
+#include "headers/objects.h"
+#include "headers/index.h"
+#include "headers/refs.h"
+#include "headers/utils.h"
+#include "headers/oid_table.h"
+
+#include <stdexcept>
+#include <unordered_set>
+
+#include <sys/stat.h>
+
+namespace {
+
+std::string trim_newline(std::string s) {
+    while (!s.empty() && (s.back() == '\n' || s.back() == '\r')) s.pop_back();
+    return s;
+}
+
+void collect_roots(std::vector<PackInput>& roots) {
+    fs::path refs_root(REFS_DIR);
+    if (fs::is_directory(refs_root)) {
+        for (const auto& entry : fs::recursive_directory_iterator(refs_root)) {
+            if (!entry.is_regular_file() || entry.path().extension() == ".lock") continue;
+            ObjectId id;
+            if (ObjectId::try_from_hex(trim_newline(read_file(entry.path().string())), id)) roots.push_back({id, ""});
+            // Symbolic refs point at another ref, which the scan visits anyway.
+        }
+    }
+
+    ObjectId id;
+    if (ObjectId::try_from_hex(read_head(), id)) roots.push_back({id, ""}); // Detached HEAD
+
+    std::string merge_head_path = GIT_DIR + "/MERGE_HEAD";
+    if (file_exists(merge_head_path)) {
+        if (ObjectId::try_from_hex(trim_newline(read_file(merge_head_path)), id)) roots.push_back({id, ""});
+    }
+
+    // Staged blobs are not reachable from any commit yet but must survive.
+    for (const IndexRecord& rec : read_index()) {
+        roots.push_back({rec.sha1, std::string(rec.path())});
+    }
+}
+
+time_t file_mtime(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return st.st_mtime;
+}
+
+void remove_if_empty(const fs::path& dir) {
+    std::error_code ec;
+    if (fs::is_directory(dir, ec) && fs::is_empty(dir, ec)) fs::remove(dir, ec);
+}
+
+} // namespace
+
+std::vector<PackInput> collect_reachable_objects() {
+    std::vector<PackInput> pending;
+    collect_roots(pending);
+
+    std::vector<PackInput> reachable;
+    std::unordered_set<ObjectId> seen;
+    while (!pending.empty()) {
+        PackInput current = std::move(pending.back());
+        pending.pop_back();
+        if (!seen.insert(current.sha1).second) continue;
+
+        RawObject raw;
+        try {
+            // Blobs link to nothing: checking the header is enough, which
+            // keeps large files from being inflated just to be skipped.
+            if (read_object_header(current.sha1).type == "blob") {
+                reachable.push_back(std::move(current));
+                continue;
+            }
+            raw = read_raw_object(current.sha1);
+        } catch (const std::exception& e) {
+            // Its children would go unmarked and be pruned, so give up before
+            // anything is packed or removed.
+            throw std::runtime_error("Cannot read reachable object " + current.sha1.hex() + ": " + e.what());
+        }
+
+        if (raw.type == "commit") {
+            CommitView commit = parse_commit_view(raw.content);
+            pending.push_back({commit.tree_sha1, ""});
+            for (const ObjectId& parent : commit.parent_sha1s) pending.push_back({parent, ""});
+        } else if (raw.type == "tag") {
+            pending.push_back({parse_tag_content(raw.content).object_sha1, ""});
+        } else if (raw.type == "tree") {
+            TreeReader reader(raw.content);
+            TreeEntryView entry;
+            while (reader.next(entry)) {
+                if (entry.mode == "160000") continue; // Submodule commits live in another repository
+                std::string path = current.path;
+                if (!path.empty()) path += '/';
+                path += entry.name;
+                pending.push_back({entry.sha1, std::move(path)});
+            }
+        }
+        reachable.push_back(std::move(current));
+    }
+    return reachable;
+}
+
+RepackResult repack_objects(const std::vector<PackInput>& reachable, const PackOptions& options) {
+    RepackResult result;
+
+    struct OldPack {
+        std::string pack_path;
+        std::string idx_path;
+        std::string checksum_hex;
+        std::vector<ObjectId> objects;
+    };
+    std::vector<OldPack> old_packs;
+    for (const auto& pack : get_packs()) {
+        old_packs.push_back({pack.pack_path, pack.idx_path, pack.checksum_hex, list_packed_objects(pack)});
+    }
+
+    if (!reachable.empty()) {
+        result.pack_checksum = write_pack(reachable, options, &result.stats);
+    }
+
+    std::unordered_set<ObjectId> packed;
+    for (const auto& object : reachable) packed.insert(object.sha1);
+
+    for (const auto& old : old_packs) {
+        if (old.checksum_hex == result.pack_checksum) continue; // Identical pack was rewritten in place
+
+        auto pack_time = fs::last_write_time(old.pack_path);
+        for (const auto& id : old.objects) {
+            std::string path = get_object_path(id);
+            if (packed.count(id) || file_exists(path)) continue;
+            RawObject raw = read_raw_object(id);
+            std::string object_data = raw.type + " " + std::to_string(raw.content.size()) + '\0' + raw.content;
+            ensure_object_directory_exists(id.hex());
+            write_file(path, compress_data(object_data));
+            fs::last_write_time(path, pack_time);
+            result.loosened++;
+        }
+        // Dropping the .idx first makes the pack invisible before its data goes.
+        fs::remove(old.idx_path);
+        fs::remove(old.pack_path);
+        result.packs_removed++;
+    }
+    reload_packs();
+
+    for (const auto& id : list_loose_objects()) {
+        if (!packed.count(id)) continue;
+        std::string path = get_object_path(id);
+        if (fs::remove(path)) result.loose_removed++;
+        remove_if_empty(fs::path(path).parent_path());
+    }
+    return result;
+}
+
+size_t prune_loose_objects(const std::vector<PackInput>& reachable, std::time_t expire) {
+    std::unordered_set<ObjectId> keep;
+    for (const auto& object : reachable) keep.insert(object.sha1);
+
+    size_t pruned = 0;
+    for (const auto& id : list_loose_objects()) {
+        if (keep.count(id)) continue;
+        std::string path = get_object_path(id);
+        if (file_mtime(path) > expire) continue;
+        if (fs::remove(path)) pruned++;
+        remove_if_empty(fs::path(path).parent_path());
+    }
+
+    if (pruned) reset_oid_table();
+
+    // Leftovers from interrupted pack and loose object writes.
+    std::vector<fs::path> tmp_dirs;
+    if (fs::is_directory(PACK_DIR)) tmp_dirs.push_back(PACK_DIR);
+    if (fs::is_directory(OBJECTS_DIR)) {
+        tmp_dirs.push_back(OBJECTS_DIR); // Large objects are streamed here before their name is known
+        for (const auto& dir : fs::directory_iterator(OBJECTS_DIR)) {
+            if (dir.is_directory() && dir.path().filename().string().size() == 2) tmp_dirs.push_back(dir.path());
+        }
+    }
+    for (const auto& dir : tmp_dirs) {
+        for (const auto& entry : fs::directory_iterator(dir)) {
+            if (entry.path().filename().string().rfind("tmp_", 0) != 0) continue;
+            if (file_mtime(entry.path().string()) <= expire) fs::remove(entry.path());
+        }
+    }
+    return pruned;
+}
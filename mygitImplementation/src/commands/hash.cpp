@@ -0,0 +1,269 @@
+#include "headers/hash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MYGIT_HAVE_AVX2_SHA1 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Fetched once; EVP_sha1() and the one-shot SHA1() look the algorithm up by
+// name on every use in OpenSSL 3.
+const EVP_MD* sha1_md() {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static const EVP_MD* md = EVP_MD_fetch(nullptr, "SHA1", nullptr);
+#else
+    static const EVP_MD* md = EVP_sha1();
+#endif
+    if (!md) throw std::runtime_error("SHA-1 is not available from OpenSSL");
+    return md;
+}
+
+void init_context(EVP_MD_CTX* ctx) {
+    if (EVP_DigestInit_ex(ctx, sha1_md(), nullptr) != 1) {
+        throw std::runtime_error("Failed to initialise SHA-1 context");
+    }
+}
+
+#ifdef MYGIT_HAVE_AVX2_SHA1
+
+const size_t LANES = 8;
+
+// One message prepared for the kernel: whole blocks are read in place, the
+// last one or two (with the 0x80 byte and bit length) from `tail`.
+struct LaneMessage {
+    const unsigned char* data = nullptr;
+    size_t full_blocks = 0;
+    size_t total_blocks = 0;
+    unsigned char tail[128];
+
+    void prepare(std::string_view msg) {
+        data = reinterpret_cast<const unsigned char*>(msg.data());
+        full_blocks = msg.size() / 64;
+        size_t rest = msg.size() % 64;
+        size_t tail_len = rest + 9 <= 64 ? 64 : 128;
+        std::memset(tail, 0, tail_len);
+        std::memcpy(tail, data + full_blocks * 64, rest);
+        tail[rest] = 0x80;
+        uint64_t bits = uint64_t(msg.size()) * 8;
+        for (int i = 0; i < 8; ++i) tail[tail_len - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+        total_blocks = full_blocks + tail_len / 64;
+    }
+
+    const unsigned char* block(size_t i) const {
+        return i < full_blocks ? data + i * 64 : tail + (i - full_blocks) * 64;
+    }
+};
+
+__attribute__((target("avx2"), always_inline)) inline __m256i rol(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+// Twenty rounds of one block; `Stage` picks the round function and constant.
+template <int Stage>
+__attribute__((target("avx2"), always_inline)) inline void sha1_x8_rounds(__m256i* W, __m256i& a, __m256i& b,
+                                                                         __m256i& c, __m256i& d, __m256i& e) {
+    const __m256i k = _mm256_set1_epi32(static_cast<int>(Stage == 0 ? 0x5A827999u : Stage == 1 ? 0x6ED9EBA1u
+                                                         : Stage == 2 ? 0x8F1BBCDCu : 0xCA62C1D6u));
+    for (int i = 0; i < 20; ++i) {
+        const int t = Stage * 20 + i;
+        __m256i w;
+        if (t < 16) {
+            w = W[t];
+        } else {
+            w = rol(_mm256_xor_si256(_mm256_xor_si256(W[(t - 3) & 15], W[(t - 8) & 15]),
+                                     _mm256_xor_si256(W[(t - 14) & 15], W[t & 15])), 1);
+            W[t & 15] = w;
+        }
+        __m256i f;
+        if (Stage == 0) {
+            f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+        } else if (Stage == 2) {
+            f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+        } else {
+            f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+        }
+        __m256i temp = _mm256_add_epi32(_mm256_add_epi32(rol(a, 5), f), _mm256_add_epi32(_mm256_add_epi32(e, k), w));
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = temp;
+    }
+}
+
+// Hashes up to eight messages side by side, one per 32-bit lane. Lanes whose
+// message has fewer blocks keep their state once they run out.
+__attribute__((target("avx2"))) void sha1_x8(const LaneMessage* const* lanes, size_t count, ObjectId* const* out) {
+    static const unsigned char ZERO_BLOCK[64] = {};
+    alignas(32) uint32_t words[16][LANES];
+    alignas(32) uint32_t block_counts[LANES] = {};
+    size_t max_blocks = 0;
+    for (size_t l = 0; l < count; ++l) {
+        block_counts[l] = static_cast<uint32_t>(lanes[l]->total_blocks);
+        max_blocks = std::max(max_blocks, lanes[l]->total_blocks);
+    }
+    const __m256i counts = _mm256_load_si256(reinterpret_cast<const __m256i*>(block_counts));
+
+    __m256i h0 = _mm256_set1_epi32(0x67452301);
+    __m256i h1 = _mm256_set1_epi32(static_cast<int>(0xEFCDAB89));
+    __m256i h2 = _mm256_set1_epi32(static_cast<int>(0x98BADCFE));
+    __m256i h3 = _mm256_set1_epi32(0x10325476);
+    __m256i h4 = _mm256_set1_epi32(static_cast<int>(0xC3D2E1F0));
+
+    for (size_t b = 0; b < max_blocks; ++b) {
+        for (size_t l = 0; l < LANES; ++l) {
+            const unsigned char* p = (l < count && b < lanes[l]->total_blocks) ? lanes[l]->block(b) : ZERO_BLOCK;
+            for (int w = 0; w < 16; ++w) {
+                uint32_t v;
+                std::memcpy(&v, p + 4 * w, 4);
+                words[w][l] = __builtin_bswap32(v);
+            }
+        }
+
+        __m256i W[16];
+        for (int w = 0; w < 16; ++w) W[w] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[w]));
+
+        __m256i a = h0, bb = h1, c = h2, d = h3, e = h4;
+        sha1_x8_rounds<0>(W, a, bb, c, d, e);
+        sha1_x8_rounds<1>(W, a, bb, c, d, e);
+        sha1_x8_rounds<2>(W, a, bb, c, d, e);
+        sha1_x8_rounds<3>(W, a, bb, c, d, e);
+
+        __m256i active = _mm256_cmpgt_epi32(counts, _mm256_set1_epi32(static_cast<int>(b)));
+        h0 = _mm256_blendv_epi8(h0, _mm256_add_epi32(h0, a), active);
+        h1 = _mm256_blendv_epi8(h1, _mm256_add_epi32(h1, bb), active);
+        h2 = _mm256_blendv_epi8(h2, _mm256_add_epi32(h2, c), active);
+        h3 = _mm256_blendv_epi8(h3, _mm256_add_epi32(h3, d), active);
+        h4 = _mm256_blendv_epi8(h4, _mm256_add_epi32(h4, e), active);
+    }
+
+    alignas(32) uint32_t state[5][LANES];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[0]), h0);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[1]), h1);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[2]), h2);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[3]), h3);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(state[4]), h4);
+    for (size_t l = 0; l < count; ++l) {
+        for (int i = 0; i < 5; ++i) {
+            uint32_t v = state[i][l];
+            out[l]->bytes[4 * i] = static_cast<unsigned char>(v >> 24);
+            out[l]->bytes[4 * i + 1] = static_cast<unsigned char>(v >> 16);
+            out[l]->bytes[4 * i + 2] = static_cast<unsigned char>(v >> 8);
+            out[l]->bytes[4 * i + 3] = static_cast<unsigned char>(v);
+        }
+    }
+}
+
+// Messages are grouped by length so the eight lanes of a group need about
+// the same number of blocks.
+void sha1_batch_avx2(const std::string_view* inputs, size_t count, ObjectId* out) {
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t x, size_t y) { return inputs[x].size() < inputs[y].size(); });
+
+    LaneMessage messages[LANES];
+    const LaneMessage* lanes[LANES];
+    ObjectId* results[LANES];
+    for (size_t start = 0; start < count; start += LANES) {
+        size_t n = std::min(LANES, count - start);
+        for (size_t l = 0; l < n; ++l) {
+            messages[l].prepare(inputs[order[start + l]]);
+            lanes[l] = &messages[l];
+            results[l] = &out[order[start + l]];
+        }
+        sha1_x8(lanes, n, results);
+    }
+}
+
+bool cpu_has_avx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+bool cpu_has_sha_ni() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & (1u << 29)) != 0;
+}
+
+#endif // MYGIT_HAVE_AVX2_SHA1
+
+enum class BatchImpl { OpenSSL, Avx2 };
+
+BatchImpl choose_batch_impl() {
+#ifdef MYGIT_HAVE_AVX2_SHA1
+    if (!cpu_has_avx2()) return BatchImpl::OpenSSL;
+    const char* forced = std::getenv("MYGIT_SHA1_IMPL");
+    if (forced && std::strcmp(forced, "avx2") == 0) return BatchImpl::Avx2;
+    if (forced && std::strcmp(forced, "openssl") == 0) return BatchImpl::OpenSSL;
+    // With SHA-NI a single stream in OpenSSL beats eight AVX2 lanes.
+    return cpu_has_sha_ni() ? BatchImpl::OpenSSL : BatchImpl::Avx2;
+#else
+    return BatchImpl::OpenSSL;
+#endif
+}
+
+BatchImpl batch_impl() {
+    static const BatchImpl impl = choose_batch_impl();
+    return impl;
+}
+
+} // namespace
+
+Sha1Context::Sha1Context() : ctx_(EVP_MD_CTX_new()) {
+    if (!ctx_) throw std::runtime_error("Failed to allocate SHA-1 context");
+    try {
+        init_context(ctx_);
+    } catch (...) {
+        EVP_MD_CTX_free(ctx_);
+        throw;
+    }
+}
+
+Sha1Context::~Sha1Context() {
+    EVP_MD_CTX_free(ctx_);
+}
+
+void Sha1Context::update(const void* data, size_t len) {
+    if (EVP_DigestUpdate(ctx_, data, len) != 1) throw std::runtime_error("SHA-1 update failed");
+}
+
+ObjectId Sha1Context::finish() {
+    ObjectId id;
+    unsigned int len = 0;
+    if (EVP_DigestFinal_ex(ctx_, id.bytes.data(), &len) != 1) throw std::runtime_error("SHA-1 finalisation failed");
+    init_context(ctx_);
+    return id;
+}
+
+ObjectId sha1_of(std::string_view data) {
+    thread_local Sha1Context ctx;
+    ctx.update(data);
+    return ctx.finish();
+}
+
+void sha1_batch(const std::string_view* inputs, size_t count, ObjectId* out) {
+#ifdef MYGIT_HAVE_AVX2_SHA1
+    if (batch_impl() == BatchImpl::Avx2 && count > 1) {
+        sha1_batch_avx2(inputs, count, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; ++i) out[i] = sha1_of(inputs[i]);
+}
+
+const char* sha1_batch_implementation() {
+    return batch_impl() == BatchImpl::Avx2 ? "avx2-multibuffer" : "openssl";
+}
@@ -0,0 +1,277 @@
+#include "headers/ignore.h"
+#include "headers/config.h"
+#include "headers/hash.h"
+#include "headers/utils.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+bool has_wildcard(std::string_view text) {
+    return text.find_first_of("*?[\\") != std::string_view::npos;
+}
+
+// Matches the bracket expression starting at pat[p] ('[') against c and
+// moves p past it. Returns false in `well_formed` if there is no closing
+// ']', in which case the '[' is an ordinary character.
+bool match_class(std::string_view pat, size_t& p, char c, bool& well_formed) {
+    size_t q = p + 1;
+    bool negate = q < pat.size() && (pat[q] == '!' || pat[q] == '^');
+    if (negate) ++q;
+    bool matched = false;
+    bool first = true;
+    while (q < pat.size() && (pat[q] != ']' || first)) {
+        first = false;
+        char lo = pat[q];
+        if (lo == '\\' && q + 1 < pat.size()) lo = pat[++q];
+        if (q + 2 < pat.size() && pat[q + 1] == '-' && pat[q + 2] != ']') {
+            size_t hi_pos = q + 2;
+            if (pat[hi_pos] == '\\' && hi_pos + 1 < pat.size()) ++hi_pos;
+            char hi = pat[hi_pos];
+            if (c >= lo && c <= hi) matched = true;
+            q = hi_pos + 1;
+        } else {
+            if (c == lo) matched = true;
+            ++q;
+        }
+    }
+    well_formed = q < pat.size();
+    if (!well_formed) return false;
+    p = q + 1;
+    return matched != negate;
+}
+
+std::string read_optional_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return std::string();
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+bool is_regular_file(const std::string& path) {
+    std::error_code ec;
+    return fs::is_regular_file(path, ec);
+}
+
+} // namespace
+
+bool wildmatch(std::string_view pat, std::string_view text) {
+    size_t p = 0;
+    size_t t = 0;
+    while (p < pat.size()) {
+        char c = pat[p];
+        if (c == '*') {
+            size_t q = p;
+            while (q < pat.size() && pat[q] == '*') ++q;
+            if (q - p >= 2 && (p == 0 || pat[p - 1] == '/') && (q == pat.size() || pat[q] == '/')) {
+                if (q == pat.size()) return true; // Trailing "**": everything below
+                // "**/": zero or more directories
+                std::string_view rest = pat.substr(q + 1);
+                if (wildmatch(rest, text.substr(t))) return true;
+                for (size_t k = t; k < text.size(); ++k) {
+                    if (text[k] == '/' && wildmatch(rest, text.substr(k + 1))) return true;
+                }
+                return false;
+            }
+            std::string_view rest = pat.substr(q);
+            for (size_t k = t;; ++k) {
+                if (wildmatch(rest, text.substr(k))) return true;
+                if (k >= text.size() || text[k] == '/') return false;
+            }
+        }
+        if (t >= text.size()) return false;
+        if (c == '?') {
+            if (text[t] == '/') return false;
+            ++p;
+            ++t;
+            continue;
+        }
+        if (c == '[') {
+            bool well_formed = true;
+            size_t next = p;
+            bool matched = text[t] != '/' && match_class(pat, next, text[t], well_formed);
+            if (well_formed || text[t] == '/') {
+                if (!matched) return false;
+                p = next;
+                ++t;
+                continue;
+            }
+        }
+        if (c == '\\' && p + 1 < pat.size()) c = pat[++p];
+        if (text[t] != c) return false;
+        ++p;
+        ++t;
+    }
+    return t == text.size();
+}
+
+IgnoreList::IgnoreList(std::string_view content, std::string base) : base_(std::move(base)) {
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t eol = content.find('\n', pos);
+        if (eol == std::string_view::npos) eol = content.size();
+        std::string line(content.substr(pos, eol - pos));
+        pos = eol + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        // Trailing spaces are dropped unless escaped with a backslash.
+        while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\')) line.pop_back();
+
+        Pattern pattern;
+        if (line[0] == '!') {
+            pattern.negated = true;
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            pattern.dir_only = true;
+            line.pop_back();
+        }
+        if (line.find('/') != std::string::npos) {
+            pattern.anchored = true;
+            if (line[0] == '/') line.erase(0, 1);
+        }
+        if (line.empty()) continue;
+        pattern.text = std::move(line);
+        add(std::move(pattern));
+    }
+}
+
+void IgnoreList::add(Pattern pattern) {
+    int number = static_cast<int>(patterns_.size());
+    const std::string& text = pattern.text;
+    auto add_sized = [&](std::vector<SizedBucket>& buckets, std::string fixed) {
+        auto it = std::find_if(buckets.begin(), buckets.end(), [&](const SizedBucket& b) { return b.size == fixed.size(); });
+        if (it == buckets.end()) {
+            buckets.push_back(SizedBucket{fixed.size(), {}});
+            it = buckets.end() - 1;
+        }
+        it->patterns[std::move(fixed)].push_back(number);
+    };
+
+    if (pattern.anchored) {
+        if (has_wildcard(text)) globs_.push_back(number);
+        else paths_[text].push_back(number);
+    } else if (!has_wildcard(text)) {
+        names_[text].push_back(number);
+    } else if (text.size() > 1 && text.back() == '*' && !has_wildcard(std::string_view(text).substr(0, text.size() - 1))) {
+        add_sized(prefixes_, text.substr(0, text.size() - 1));
+    } else if (text.size() > 1 && text[0] == '*' && !has_wildcard(std::string_view(text).substr(1))) {
+        add_sized(suffixes_, text.substr(1));
+    } else {
+        globs_.push_back(number);
+    }
+    patterns_.push_back(std::move(pattern));
+}
+
+int IgnoreList::best_of(const std::vector<int>& candidates, bool is_dir, int best) const {
+    for (auto it = candidates.rbegin(); it != candidates.rend() && *it > best; ++it) {
+        if (!patterns_[*it].dir_only || is_dir) return *it;
+    }
+    return best;
+}
+
+IgnoreList::Match IgnoreList::match(std::string_view path, bool is_dir) const {
+    if (patterns_.empty()) return Match::None;
+    std::string_view rel = path.substr(base_.size());
+    size_t slash = rel.rfind('/');
+    std::string_view name = slash == std::string_view::npos ? rel : rel.substr(slash + 1);
+
+    int best = -1;
+    if (!names_.empty()) {
+        auto it = names_.find(std::string(name));
+        if (it != names_.end()) best = best_of(it->second, is_dir, best);
+    }
+    if (!paths_.empty()) {
+        auto it = paths_.find(std::string(rel));
+        if (it != paths_.end()) best = best_of(it->second, is_dir, best);
+    }
+    for (const SizedBucket& bucket : prefixes_) {
+        if (name.size() < bucket.size) continue;
+        auto it = bucket.patterns.find(std::string(name.substr(0, bucket.size)));
+        if (it != bucket.patterns.end()) best = best_of(it->second, is_dir, best);
+    }
+    for (const SizedBucket& bucket : suffixes_) {
+        if (name.size() < bucket.size) continue;
+        auto it = bucket.patterns.find(std::string(name.substr(name.size() - bucket.size)));
+        if (it != bucket.patterns.end()) best = best_of(it->second, is_dir, best);
+    }
+    for (auto it = globs_.rbegin(); it != globs_.rend() && *it > best; ++it) {
+        const Pattern& pattern = patterns_[*it];
+        if (pattern.dir_only && !is_dir) continue;
+        if (wildmatch(pattern.text, pattern.anchored ? rel : name)) {
+            best = *it;
+            break;
+        }
+    }
+
+    if (best < 0) return Match::None;
+    return patterns_[best].negated ? Match::Included : Match::Ignored;
+}
+
+IgnoreRules::IgnoreRules() {
+    std::string info_exclude = read_optional_file(GIT_DIR + "/info/exclude");
+    info_exclude_ = IgnoreList(info_exclude, "");
+    std::string excludes_file;
+    if (std::optional<std::string> path = get_config_value("core.excludesFile")) {
+        std::string file = *path;
+        const char* home = std::getenv("HOME");
+        if (file.rfind("~/", 0) == 0 && home) file = home + file.substr(1);
+        excludes_file = read_optional_file(file);
+    }
+    excludes_file_ = IgnoreList(excludes_file, "");
+    if (!info_exclude.empty() || !excludes_file.empty()) global_content_ = info_exclude + '\0' + excludes_file;
+}
+
+const IgnoreRules::DirRules& IgnoreRules::rules_for(const std::string& dir) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = dirs_.find(dir);
+        if (it != dirs_.end()) return *it->second;
+    }
+    auto rules = std::make_unique<DirRules>();
+    std::string path = dir + ".gitignore";
+    bool present = is_regular_file(path);
+    std::string content = present ? read_optional_file(path) : std::string();
+    rules->list = IgnoreList(content, dir);
+    if (dir.empty() && !global_content_.empty()) {
+        rules->id = sha1_of(global_content_ + '\0' + content);
+    } else if (present) {
+        rules->id = sha1_of(content);
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto inserted = dirs_.emplace(dir, std::move(rules)); // Another thread may have been first
+    return *inserted.first->second;
+}
+
+bool IgnoreRules::is_ignored(std::string_view path, bool is_dir) {
+    size_t slash = path.rfind('/');
+    std::string dir(slash == std::string_view::npos ? std::string_view() : path.substr(0, slash + 1));
+    for (;;) {
+        IgnoreList::Match match = rules_for(dir).list.match(path, is_dir);
+        if (match != IgnoreList::Match::None) return match == IgnoreList::Match::Ignored;
+        if (dir.empty()) break;
+        size_t up = dir.rfind('/', dir.size() - 2);
+        dir.resize(up == std::string::npos ? 0 : up + 1);
+    }
+    for (const IgnoreList* list : {&info_exclude_, &excludes_file_}) {
+        IgnoreList::Match match = list->match(path, is_dir);
+        if (match != IgnoreList::Match::None) return match == IgnoreList::Match::Ignored;
+    }
+    return false;
+}
+
+bool IgnoreRules::is_ignored_with_parents(std::string_view path, bool is_dir) {
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+        if (is_ignored(path.substr(0, slash), true)) return true;
+    }
+    return is_ignored(path, is_dir);
+}
+
+ObjectId IgnoreRules::rules_id(const std::string& dir) {
+    return rules_for(dir).id;
+}
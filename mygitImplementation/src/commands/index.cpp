@@ -1,26 +1,112 @@
 #include "headers/index.h"
 #include "headers/utils.h"
+#include "headers/hash.h"
+#include "headers/objects.h"
+#include "headers/config.h"
 
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <deque>
+#include <optional>
+
+#include <sys/stat.h>
 
 // const std::string INDEX_PATH = GIT_DIR + "/index";
 // const std::string LOCK_PATH = GIT_DIR + "/index.lock";
 
-IndexMap read_index() {
-    std::string index_path = GIT_DIR + "/index";
-    IndexMap index_data;
-    std::ifstream index_file(index_path);
-    if (!index_file) {
-        if (!fs::exists(index_path)) return index_data;
-        throw std::runtime_error("Failed to open index file: " + index_path);
+namespace {
+
+const char INDEX_SIGNATURE[4] = {'D', 'I', 'R', 'C'};
+const char CACHE_TREE_SIGNATURE[4] = {'T', 'R', 'E', 'E'};
+const char UNTRACKED_CACHE_SIGNATURE[4] = {'M', 'G', 'U', 'C'};
+const char FSMONITOR_SIGNATURE[4] = {'M', 'G', 'F', 'M'};
+const char SPARSE_DIRECTORY_SIGNATURE[4] = {'s', 'd', 'i', 'r'}; // Empty: the index may hold sparse directories
+const uint32_t INDEX_VERSION = 2;
+const uint32_t INDEX_VERSION_EXTENDED = 3; // Entries may carry a second flags word
+const size_t INDEX_HEADER_SIZE = 12;
+const size_t ENTRY_FIXED_SIZE = 62; // Ten stat words, object name, flags
+const uint16_t NAME_LENGTH_MASK = 0x0fff;
+const uint16_t STAGE_SHIFT = 12;
+const uint16_t EXTENDED_FLAG = 0x4000;
+const uint16_t SKIP_WORKTREE_FLAG = 0x4000; // In the extended flags
+
+struct IndexTimestamp {
+    uint32_t sec = 0;
+    uint32_t nsec = 0;
+};
+
+uint32_t get_be32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint16_t get_be16(const unsigned char* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+void store_be32(unsigned char* p, uint32_t v) {
+    p[0] = static_cast<unsigned char>(v >> 24);
+    p[1] = static_cast<unsigned char>(v >> 16);
+    p[2] = static_cast<unsigned char>(v >> 8);
+    p[3] = static_cast<unsigned char>(v);
+}
+
+#ifdef __APPLE__
+uint32_t mtime_nsec(const struct stat& st) { return static_cast<uint32_t>(st.st_mtimespec.tv_nsec); }
+uint32_t ctime_nsec(const struct stat& st) { return static_cast<uint32_t>(st.st_ctimespec.tv_nsec); }
+#else
+uint32_t mtime_nsec(const struct stat& st) { return static_cast<uint32_t>(st.st_mtim.tv_nsec); }
+uint32_t ctime_nsec(const struct stat& st) { return static_cast<uint32_t>(st.st_ctim.tv_nsec); }
+#endif
+
+IndexTimestamp file_timestamp(const std::string& path) {
+    IndexTimestamp ts;
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+        ts.sec = static_cast<uint32_t>(st.st_mtime);
+        ts.nsec = mtime_nsec(st);
     }
+    return ts;
+}
+
+bool is_racy(const IndexStat& stat, const IndexTimestamp& index_ts) {
+    if (index_ts.sec == 0) return false; // No index before: nothing to be racy against
+    if (stat.mtime_sec != index_ts.sec) return stat.mtime_sec > index_ts.sec;
+    return stat.mtime_nsec >= index_ts.nsec;
+}
+
+uint32_t parse_mode(const std::string& mode) {
+    try {
+        return static_cast<uint32_t>(std::stoul(mode, nullptr, 8));
+    } catch (const std::exception&) {
+        return 0;
+    }
+}
 
-    std::string line;
+std::string format_mode(uint32_t mode) {
+    std::ostringstream ss;
+    ss << std::oct << mode;
+    return ss.str();
+}
+
+int compare_path_stage(std::string_view a_path, uint32_t a_stage, std::string_view b_path, uint32_t b_stage) {
+    int c = a_path.compare(b_path);
+    if (c != 0) return c;
+    return a_stage < b_stage ? -1 : a_stage > b_stage ? 1 : 0;
+}
+
+// The text format used before the binary one: "<mode> <sha> <stage>\t<path>".
+void parse_text_index(std::string_view content, Index& index) {
+    size_t pos = 0;
     int line_num = 0;
-    while (std::getline(index_file, line)) {
+    while (pos < content.size()) {
+        size_t eol = content.find('\n', pos);
+        if (eol == std::string_view::npos) eol = content.size();
+        std::string line(content.substr(pos, eol - pos));
+        pos = eol + 1;
         line_num++;
         std::size_t tab_pos = line.find('\t');
         if (tab_pos == std::string::npos) {
@@ -39,7 +125,10 @@ IndexMap read_index() {
 
         IndexEntry entry;
         entry.mode = parts[0];
-        entry.sha1 = parts[1];
+        if (!ObjectId::try_from_hex(parts[1], entry.sha1)) {
+            std::cerr << "Warning: Invalid object name on line " << line_num << ": " << parts[1] << std::endl;
+            continue;
+        }
         try {
             entry.stage = std::stoi(parts[2]);
         } catch (const std::exception& e) {
@@ -48,18 +137,1189 @@ IndexMap read_index() {
         }
         entry.path = path;
 
-        index_data[entry.path][entry.stage] = entry;
+        index.add_or_update(entry);
+    }
+}
+
+// Fills `records` straight from the mapped file; paths are left pointing into
+// it. Returns the offset of the first extension (or of the checksum). The
+// entries of a split index are not in order (replacements come first), so
+// the order check is left to the caller.
+size_t parse_binary_index(const unsigned char* data, size_t size, const std::string& index_path,
+                          std::vector<IndexRecord>& records) {
+    if (size < INDEX_HEADER_SIZE + ObjectId::RAW_SIZE) {
+        throw std::runtime_error("Index file is truncated: " + index_path);
+    }
+    uint32_t version = get_be32(data + 4);
+    if (version != INDEX_VERSION && version != INDEX_VERSION_EXTENDED) {
+        throw std::runtime_error("Unsupported index version " + std::to_string(version) + ": " + index_path);
+    }
+    size_t body_size = size - ObjectId::RAW_SIZE;
+    ObjectId checksum = sha1_of(std::string_view(reinterpret_cast<const char*>(data), body_size));
+    if (std::memcmp(checksum.data(), data + body_size, ObjectId::RAW_SIZE) != 0) {
+        throw std::runtime_error("Index file checksum mismatch: " + index_path);
+    }
+
+    uint32_t count = get_be32(data + 8);
+    if (count > body_size / (ENTRY_FIXED_SIZE + 2)) {
+        throw std::runtime_error("Index entry count is larger than the file: " + index_path);
+    }
+    records.resize(count);
+    size_t pos = INDEX_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (body_size - pos < ENTRY_FIXED_SIZE + 1) {
+            throw std::runtime_error("Index entry " + std::to_string(i) + " is truncated: " + index_path);
+        }
+        const unsigned char* p = data + pos;
+        IndexRecord& rec = records[i];
+        rec.stat.ctime_sec = get_be32(p);
+        rec.stat.ctime_nsec = get_be32(p + 4);
+        rec.stat.mtime_sec = get_be32(p + 8);
+        rec.stat.mtime_nsec = get_be32(p + 12);
+        rec.stat.dev = get_be32(p + 16);
+        rec.stat.ino = get_be32(p + 20);
+        rec.stat.mode = get_be32(p + 24);
+        rec.stat.uid = get_be32(p + 28);
+        rec.stat.gid = get_be32(p + 32);
+        rec.stat.size = get_be32(p + 36);
+        rec.sha1 = ObjectId::from_raw(p + 40);
+        uint16_t flags = get_be16(p + 60);
+        size_t fixed_size = ENTRY_FIXED_SIZE;
+        if (flags & EXTENDED_FLAG) {
+            if (version < INDEX_VERSION_EXTENDED) {
+                throw std::runtime_error("Extended index entry flags are not supported in version 2: " + index_path);
+            }
+            if (body_size - pos < ENTRY_FIXED_SIZE + 3) {
+                throw std::runtime_error("Index entry " + std::to_string(i) + " is truncated: " + index_path);
+            }
+            uint16_t extended = get_be16(p + ENTRY_FIXED_SIZE);
+            if (extended & ~SKIP_WORKTREE_FLAG) {
+                throw std::runtime_error("Unsupported extended flags in index entry " + std::to_string(i) + ": " + index_path);
+            }
+            rec.skip_worktree = (extended & SKIP_WORKTREE_FLAG) != 0;
+            fixed_size += 2;
+        }
+        rec.stage = (flags >> STAGE_SHIFT) & 3;
+        rec.mode = rec.stat.mode;
+
+        const char* name = reinterpret_cast<const char*>(p + fixed_size);
+        size_t max_name = body_size - pos - fixed_size;
+        size_t name_len = flags & NAME_LENGTH_MASK;
+        if (name_len == NAME_LENGTH_MASK) {
+            const void* nul = std::memchr(name, '\0', max_name);
+            if (!nul) throw std::runtime_error("Unterminated path in index entry " + std::to_string(i));
+            name_len = static_cast<const char*>(nul) - name;
+        } else if (name_len >= max_name || name[name_len] != '\0') {
+            throw std::runtime_error("Malformed path in index entry " + std::to_string(i) + ": " + index_path);
+        }
+        rec.path_data = name;
+        rec.path_size = static_cast<uint32_t>(name_len);
+
+        // Entries are padded with 1-8 NULs to a multiple of eight bytes.
+        pos += (fixed_size + name_len + 8) & ~size_t(7);
+        if (pos > body_size) {
+            throw std::runtime_error("Index entry " + std::to_string(i) + " overruns the file: " + index_path);
+        }
+    }
+    return pos;
+}
+
+void check_index_order(const std::vector<IndexRecord>& records, const std::string& index_path) {
+    for (size_t i = 1; i < records.size(); ++i) {
+        if (compare_path_stage(records[i - 1].path(), records[i - 1].stage, records[i].path(), records[i].stage) >= 0) {
+            throw std::runtime_error("Index entries are not sorted at '" + std::string(records[i].path()) + "': " + index_path);
+        }
+    }
+}
+
+// Dir-order comparison: directory names compare as if followed by '/', the
+// order their entries have in the index.
+int compare_dir_names(std::string_view a, std::string_view b) {
+    size_t common = std::min(a.size(), b.size());
+    int c = common ? std::memcmp(a.data(), b.data(), common) : 0;
+    if (c != 0 || a.size() == b.size()) return c;
+    unsigned char next_a = a.size() > common ? static_cast<unsigned char>(a[common]) : '/';
+    unsigned char next_b = b.size() > common ? static_cast<unsigned char>(b[common]) : '/';
+    return next_a < next_b ? -1 : 1;
+}
+
+// "TREE" extension: for each directory, pre-order, "<name>\0<entry_count>
+// <subtree_count>\n" followed by the tree's object name when entry_count
+// is not -1. The root has an empty name.
+void serialize_cache_tree(const CacheTreeNode& node, std::string_view name, std::string& out) {
+    out.append(name.data(), name.size());
+    out.push_back('\0');
+    out += std::to_string(node.entry_count);
+    out.push_back(' ');
+    out += std::to_string(node.subtrees.size());
+    out.push_back('\n');
+    if (node.entry_count >= 0) out.append(reinterpret_cast<const char*>(node.oid.data()), ObjectId::RAW_SIZE);
+    for (const auto& child : node.subtrees) serialize_cache_tree(*child.second, child.first, out);
+}
+
+bool parse_cache_tree(const unsigned char*& p, const unsigned char* end, CacheTreeNode& node, std::string& name) {
+    const unsigned char* nul = static_cast<const unsigned char*>(std::memchr(p, '\0', end - p));
+    if (!nul) return false;
+    name.assign(reinterpret_cast<const char*>(p), nul - p);
+    p = nul + 1;
+    const unsigned char* eol = static_cast<const unsigned char*>(std::memchr(p, '\n', end - p));
+    if (!eol) return false;
+    std::string counts(reinterpret_cast<const char*>(p), eol - p);
+    p = eol + 1;
+    long entry_count = 0;
+    unsigned long subtree_count = 0;
+    char* rest = nullptr;
+    entry_count = std::strtol(counts.c_str(), &rest, 10);
+    if (rest == counts.c_str() || *rest != ' ') return false;
+    const char* subtree_text = rest + 1;
+    subtree_count = std::strtoul(subtree_text, &rest, 10);
+    if (rest == subtree_text || *rest != '\0' || entry_count < -1) return false;
+    node.entry_count = static_cast<int>(entry_count);
+    if (entry_count >= 0) {
+        if (static_cast<size_t>(end - p) < ObjectId::RAW_SIZE) return false;
+        node.oid = ObjectId::from_raw(p);
+        p += ObjectId::RAW_SIZE;
+    }
+    for (unsigned long i = 0; i < subtree_count; ++i) {
+        CacheTreeNode child;
+        std::string child_name;
+        if (!parse_cache_tree(p, end, child, child_name) || child_name.empty()) return false;
+        node.get_or_add(child_name) = std::move(child);
+    }
+    return true;
+}
+
+bool is_tree_file_mode(uint32_t mode) {
+    return mode == 0100644 || mode == 0100755 || mode == 0120000;
+}
+
+size_t fixed_entry_size(const IndexRecord& rec) {
+    return rec.skip_worktree ? ENTRY_FIXED_SIZE + 2 : ENTRY_FIXED_SIZE;
+}
+
+size_t padded_entry_size(const IndexRecord& rec) {
+    return (fixed_entry_size(rec) + rec.path_size + 8) & ~size_t(7);
+}
+
+char* append_entry(char* out, const IndexRecord& rec) {
+    unsigned char* p = reinterpret_cast<unsigned char*>(out);
+    const IndexStat& stat = rec.stat;
+    const uint32_t words[10] = {stat.ctime_sec, stat.ctime_nsec, stat.mtime_sec, stat.mtime_nsec, stat.dev,
+                                stat.ino, rec.mode, stat.uid, stat.gid, stat.size};
+    for (uint32_t w : words) {
+        store_be32(p, w);
+        p += 4;
+    }
+    std::memcpy(p, rec.sha1.data(), ObjectId::RAW_SIZE);
+    p += ObjectId::RAW_SIZE;
+    uint16_t name_len = static_cast<uint16_t>(std::min<size_t>(rec.path_size, NAME_LENGTH_MASK));
+    uint16_t flags = static_cast<uint16_t>(((rec.stage & 3) << STAGE_SHIFT) | name_len);
+    if (rec.skip_worktree) flags |= EXTENDED_FLAG;
+    p[0] = static_cast<unsigned char>(flags >> 8);
+    p[1] = static_cast<unsigned char>(flags);
+    p += 2;
+    if (rec.skip_worktree) {
+        p[0] = static_cast<unsigned char>(SKIP_WORKTREE_FLAG >> 8);
+        p[1] = static_cast<unsigned char>(SKIP_WORKTREE_FLAG & 0xff);
+        p += 2;
+    }
+    std::memcpy(p, rec.path_data, rec.path_size);
+    size_t padding = padded_entry_size(rec) - fixed_entry_size(rec) - rec.path_size;
+    std::memset(p + rec.path_size, 0, padding);
+    return out + padded_entry_size(rec);
+}
+
+// An entry that is racily clean against the index being replaced loses that
+// protection once the new (younger) index exists, so its file is checked now.
+// If the content no longer matches, the recorded size is zeroed so the entry
+// can never look up to date again. Same approach as Git.
+void smudge_racily_clean_entry(const IndexRecord& rec, IndexStat& stat) {
+    IndexStat current;
+    std::string path(rec.path());
+    if (!stat_workdir_file(path, current) || current != stat) return; // Stat differs anyway
+    try {
+        if (hash_file_object(path, "blob", false) == rec.sha1) return;
+    } catch (const std::exception&) {
+        // Unreadable: treat as changed
+    }
+    stat.size = 0;
+}
+
+// --- Split index ---
+//
+// With a split index, .mygit/index only holds the entries that differ from a
+// larger, rarely rewritten base in .mygit/sharedindex.<sha> (named after the
+// base file's checksum). Git's "link" extension ties them together: the
+// base's name, then two EWAH bitmaps over the base entries, one marking
+// deleted entries and one marking entries replaced by the first entries of
+// this file (in order, paths may be left empty). The remaining entries of
+// this file are additions, sorted.
+
+const char LINK_SIGNATURE[4] = {'l', 'i', 'n', 'k'};
+const std::string SHARED_INDEX_PREFIX = "sharedindex.";
+// Without core.splitIndex, indexes this large are split.
+const size_t SPLIT_INDEX_MIN_ENTRIES = 10000;
+// Git's splitIndex.maxPercentChange default: past this share of changed base
+// entries, the changes are folded into a new base.
+const unsigned DEFAULT_SPLIT_MAX_PERCENT_CHANGE = 20;
+
+// A plain bitmap, bit i in word i / 64 at position i % 64 (the EWAH layout).
+struct Bitmap {
+    std::vector<uint64_t> words;
+    size_t bit_size = 0;
+
+    explicit Bitmap(size_t bits = 0) : words((bits + 63) / 64), bit_size(bits) {}
+    void set(size_t i) { words[i / 64] |= uint64_t(1) << (i % 64); }
+    bool test(size_t i) const { return i / 64 < words.size() && (words[i / 64] >> (i % 64)) & 1; }
+};
+
+uint64_t get_be64(const unsigned char* p) {
+    return (uint64_t(get_be32(p)) << 32) | get_be32(p + 4);
+}
+
+void put_be32(std::string& out, uint32_t v) {
+    unsigned char buf[4];
+    store_be32(buf, v);
+    out.append(reinterpret_cast<const char*>(buf), 4);
+}
+
+void put_be64(std::string& out, uint64_t v) {
+    put_be32(out, static_cast<uint32_t>(v >> 32));
+    put_be32(out, static_cast<uint32_t>(v));
+}
+
+// EWAH serialisation as in Git: be32 bit count, be32 word count, the words
+// (be64), be32 position of the last marker word. Each marker word holds a
+// fill bit, a 32-bit count of fill words and a 31-bit count of the literal
+// words that follow it.
+void write_ewah(const Bitmap& bitmap, std::string& out) {
+    const uint64_t ONES = ~uint64_t(0);
+    const size_t MAX_RUN = 0xffffffffu;
+    const size_t MAX_LITERALS = 0x7fffffffu;
+    std::vector<uint64_t> encoded;
+    size_t last_marker = 0;
+    size_t i = 0;
+    const std::vector<uint64_t>& words = bitmap.words;
+    do {
+        uint64_t fill = 0;
+        size_t run = 0;
+        if (i < words.size() && (words[i] == 0 || words[i] == ONES)) {
+            fill = words[i];
+            while (i < words.size() && words[i] == fill && run < MAX_RUN) { ++run; ++i; }
+        }
+        size_t literal_start = i;
+        while (i < words.size() && words[i] != 0 && words[i] != ONES && i - literal_start < MAX_LITERALS) ++i;
+        last_marker = encoded.size();
+        encoded.push_back((fill ? 1 : 0) | (uint64_t(run) << 1) | (uint64_t(i - literal_start) << 33));
+        encoded.insert(encoded.end(), words.begin() + static_cast<std::ptrdiff_t>(literal_start),
+                       words.begin() + static_cast<std::ptrdiff_t>(i));
+    } while (i < words.size());
+
+    put_be32(out, static_cast<uint32_t>(bitmap.bit_size));
+    put_be32(out, static_cast<uint32_t>(encoded.size()));
+    for (uint64_t w : encoded) put_be64(out, w);
+    put_be32(out, static_cast<uint32_t>(last_marker));
+}
+
+bool read_ewah(const unsigned char*& p, const unsigned char* end, Bitmap& bitmap) {
+    if (end - p < 8) return false;
+    size_t bit_size = get_be32(p);
+    size_t word_count = get_be32(p + 4);
+    p += 8;
+    if (static_cast<size_t>(end - p) < word_count * 8 + 4) return false;
+    bitmap = Bitmap(bit_size);
+    size_t out = 0;
+    for (size_t i = 0; i < word_count;) {
+        uint64_t marker = get_be64(p + 8 * i++);
+        size_t run = static_cast<size_t>((marker >> 1) & 0xffffffffu);
+        size_t literals = static_cast<size_t>(marker >> 33);
+        if (run > bitmap.words.size() - out || literals > word_count - i || literals > bitmap.words.size() - out - run) {
+            return false;
+        }
+        if (marker & 1) std::fill(bitmap.words.begin() + out, bitmap.words.begin() + out + run, ~uint64_t(0));
+        out += run;
+        for (size_t k = 0; k < literals; ++k) bitmap.words[out++] = get_be64(p + 8 * i++);
+    }
+    p += word_count * 8 + 4; // The last marker position is only needed for appending
+    return true;
+}
+
+struct SplitLink {
+    ObjectId base;
+    Bitmap deleted;
+    Bitmap replaced;
+};
+
+std::string format_link_extension(const SplitLink& link) {
+    std::string data(reinterpret_cast<const char*>(link.base.data()), ObjectId::RAW_SIZE);
+    write_ewah(link.deleted, data);
+    write_ewah(link.replaced, data);
+    return data;
+}
+
+bool parse_link_extension(const unsigned char* p, const unsigned char* end, SplitLink& link) {
+    if (static_cast<size_t>(end - p) < ObjectId::RAW_SIZE) return false;
+    link.base = ObjectId::from_raw(p);
+    p += ObjectId::RAW_SIZE;
+    if (p == end) return true; // No bitmaps: nothing deleted or replaced
+    return read_ewah(p, end, link.deleted) && read_ewah(p, end, link.replaced) && p == end;
+}
+
+// "MGUC" extension (untracked cache): for each directory, pre-order,
+// "<name>\0", its ten stat words, its ignore rules' object name (all zero
+// for none), a valid flag, the untracked count and
+// names ("<name>\0" each), then the subdirectory count. All numbers are
+// 32-bit big-endian; the root has an empty name.
+void serialize_untracked_cache(const UntrackedCacheDir& dir, std::string_view name, std::string& out) {
+    out.append(name.data(), name.size());
+    out.push_back('\0');
+    const IndexStat& st = dir.stat;
+    for (uint32_t word : {st.ctime_sec, st.ctime_nsec, st.mtime_sec, st.mtime_nsec, st.dev, st.ino, st.mode, st.uid, st.gid, st.size}) {
+        put_be32(out, word);
+    }
+    out.append(reinterpret_cast<const char*>(dir.ignore_id.data()), ObjectId::RAW_SIZE);
+    put_be32(out, dir.valid ? 1 : 0);
+    put_be32(out, static_cast<uint32_t>(dir.untracked.size()));
+    for (const std::string& file : dir.untracked) {
+        out += file;
+        out.push_back('\0');
+    }
+    put_be32(out, static_cast<uint32_t>(dir.subdirs.size()));
+    for (const auto& sub : dir.subdirs) serialize_untracked_cache(*sub.second, sub.first, out);
+}
+
+bool parse_untracked_name(const unsigned char*& p, const unsigned char* end, std::string& name) {
+    const unsigned char* nul = static_cast<const unsigned char*>(std::memchr(p, '\0', end - p));
+    if (!nul) return false;
+    name.assign(reinterpret_cast<const char*>(p), nul - p);
+    p = nul + 1;
+    return true;
+}
+
+bool parse_untracked_cache(const unsigned char*& p, const unsigned char* end, UntrackedCacheDir& dir, std::string& name) {
+    if (!parse_untracked_name(p, end, name)) return false;
+    if (static_cast<size_t>(end - p) < 12 * 4 + ObjectId::RAW_SIZE) return false;
+    uint32_t words[10];
+    for (uint32_t& word : words) {
+        word = get_be32(p);
+        p += 4;
+    }
+    dir.stat = IndexStat{words[0], words[1], words[2], words[3], words[4], words[5], words[6], words[7], words[8], words[9]};
+    dir.ignore_id = ObjectId::from_raw(p);
+    p += ObjectId::RAW_SIZE;
+    dir.valid = get_be32(p) != 0;
+    uint32_t untracked_count = get_be32(p + 4);
+    p += 8;
+    if (untracked_count > static_cast<size_t>(end - p) / 2) return false;
+    dir.untracked.resize(untracked_count);
+    for (std::string& file : dir.untracked) {
+        if (!parse_untracked_name(p, end, file) || file.empty()) return false;
+    }
+    if (end - p < 4) return false;
+    uint32_t subdir_count = get_be32(p);
+    p += 4;
+    if (subdir_count > static_cast<size_t>(end - p) / (54 + ObjectId::RAW_SIZE)) return false; // Smallest possible subdirectory
+    dir.subdirs.reserve(subdir_count);
+    for (uint32_t i = 0; i < subdir_count; ++i) {
+        auto sub = std::make_unique<UntrackedCacheDir>();
+        std::string sub_name;
+        if (!parse_untracked_cache(p, end, *sub, sub_name) || sub_name.empty()) return false;
+        if (!dir.subdirs.empty() && dir.subdirs.back().first >= sub_name) return false;
+        dir.subdirs.emplace_back(std::move(sub_name), std::move(sub));
+    }
+    return true;
+}
+
+// "MGFM" extension (filesystem monitor): "<token>\0", then an EWAH bitmap
+// over the entries (the complete, merged list for a split index) marking
+// the fsmonitor_valid ones.
+std::string format_fsmonitor_extension(const std::string& token, const std::vector<const IndexRecord*>& entries) {
+    std::string data = token;
+    data.push_back('\0');
+    Bitmap valid(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i]->fsmonitor_valid) valid.set(i);
+    }
+    write_ewah(valid, data);
+    return data;
+}
+
+bool parse_fsmonitor_extension(const unsigned char* p, const unsigned char* end, std::string& token, Bitmap& valid) {
+    const unsigned char* nul = static_cast<const unsigned char*>(std::memchr(p, '\0', end - p));
+    if (!nul || nul == p) return false;
+    token.assign(reinterpret_cast<const char*>(p), nul - p);
+    p = nul + 1;
+    return read_ewah(p, end, valid) && p == end;
+}
+
+// Serialises a complete index file (entries, extensions, checksum).
+std::string format_index_file(const std::vector<const IndexRecord*>& entries,
+                              const std::vector<std::pair<const char*, std::string>>& extensions) {
+    size_t total = INDEX_HEADER_SIZE + ObjectId::RAW_SIZE;
+    bool extended = false;
+    for (const IndexRecord* rec : entries) {
+        total += padded_entry_size(*rec);
+        extended = extended || rec->skip_worktree;
+    }
+    for (const auto& ext : extensions) total += 8 + ext.second.size();
+    std::string out(total, '\0');
+    unsigned char* header = reinterpret_cast<unsigned char*>(&out[0]);
+    std::memcpy(header, INDEX_SIGNATURE, 4);
+    store_be32(header + 4, extended ? INDEX_VERSION_EXTENDED : INDEX_VERSION);
+    store_be32(header + 8, static_cast<uint32_t>(entries.size()));
+
+    char* p = &out[INDEX_HEADER_SIZE];
+    for (const IndexRecord* rec : entries) p = append_entry(p, *rec);
+    for (const auto& ext : extensions) {
+        std::memcpy(p, ext.first, 4);
+        store_be32(reinterpret_cast<unsigned char*>(p) + 4, static_cast<uint32_t>(ext.second.size()));
+        std::memcpy(p + 8, ext.second.data(), ext.second.size());
+        p += 8 + ext.second.size();
+    }
+    size_t body_size = total - ObjectId::RAW_SIZE;
+    ObjectId checksum = sha1_of(std::string_view(out.data(), body_size));
+    std::memcpy(&out[body_size], checksum.data(), ObjectId::RAW_SIZE);
+    return out;
+}
+
+// Writes through "<path>.tmp" and a rename, so readers see old or new.
+void replace_file(const std::string& path, const std::string& data) {
+    std::string temp_path = path + ".tmp";
+    std::ofstream temp_file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!temp_file) {
+        throw std::runtime_error("Failed to open temporary index file for writing: " + temp_path);
+    }
+    temp_file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    temp_file.close();
+    if (!temp_file) {
+        fs::remove(temp_path);
+        throw std::runtime_error("Failed to write temporary index file: " + temp_path);
+    }
+    fs::rename(temp_path, path);
+}
+
+// Removes shared index files other than `keep` (empty: all of them).
+void remove_stale_shared_indexes(const std::string& keep) {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(GIT_DIR, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind(SHARED_INDEX_PREFIX, 0) == 0 && name != keep) fs::remove(entry.path(), ec);
+    }
+}
+
+bool split_index_enabled(size_t entry_count) {
+    std::optional<std::string> value = get_config_value("core.splitIndex");
+    if (value) {
+        try {
+            return parse_bool_value(*value);
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Ignoring core.splitIndex: " << e.what() << std::endl;
+        }
+    }
+    return entry_count >= SPLIT_INDEX_MIN_ENTRIES;
+}
+
+unsigned split_index_max_percent_change() {
+    std::optional<std::string> value = get_config_value("splitIndex.maxPercentChange");
+    if (value) {
+        if (!value->empty() && value->size() <= 3 && value->find_first_not_of("0123456789") == std::string::npos &&
+            std::stoul(*value) <= 100) {
+            return static_cast<unsigned>(std::stoul(*value));
+        }
+        std::cerr << "Warning: Ignoring splitIndex.maxPercentChange '" << *value << "'" << std::endl;
+    }
+    return DEFAULT_SPLIT_MAX_PERCENT_CHANGE;
+}
+
+bool same_record(const IndexRecord& a, const IndexRecord& b) {
+    return a.sha1 == b.sha1 && a.mode == b.mode && a.stat == b.stat && a.skip_worktree == b.skip_worktree;
+}
+
+} // namespace
+
+size_t Index::lower_bound(std::string_view path) const {
+    auto it = std::lower_bound(records_.begin(), records_.end(), path,
+                               [](const IndexRecord& rec, std::string_view p) { return rec.path() < p; });
+    return static_cast<size_t>(it - records_.begin());
+}
+
+size_t Index::find(std::string_view path, int stage) const {
+    for (size_t i = lower_bound(path); i < records_.size() && records_[i].path() == path; ++i) {
+        if (records_[i].stage == static_cast<uint32_t>(stage)) return i;
+    }
+    return npos;
+}
+
+bool Index::contains(std::string_view path) const {
+    size_t i = lower_bound(path);
+    return i < records_.size() && records_[i].path() == path;
+}
+
+bool Index::has_conflicts() const {
+    return std::any_of(records_.begin(), records_.end(), [](const IndexRecord& rec) { return rec.stage > 0; });
+}
+
+IndexEntry Index::entry(size_t i) const {
+    const IndexRecord& rec = records_[i];
+    IndexEntry entry;
+    entry.mode = format_mode(rec.mode);
+    entry.sha1 = rec.sha1;
+    entry.stage = static_cast<int>(rec.stage);
+    entry.path.assign(rec.path_data, rec.path_size);
+    entry.stat = rec.stat;
+    return entry;
+}
+
+void Index::add_or_update(const IndexEntry& entry) {
+    expand_to(entry.path);
+    uint32_t stage = static_cast<uint32_t>(entry.stage);
+    // Entries usually arrive in order (trees, sorted file lists), so check
+    // the end before searching.
+    size_t pos;
+    if (records_.empty() || compare_path_stage(records_.back().path(), records_.back().stage, entry.path, stage) < 0) {
+        pos = records_.size();
+    } else {
+        pos = lower_bound(entry.path);
+        while (pos < records_.size() && records_[pos].path() == entry.path && records_[pos].stage < stage) ++pos;
+    }
+
+    IndexRecord rec;
+    rec.stat = entry.stat;
+    rec.sha1 = entry.sha1;
+    rec.mode = parse_mode(entry.mode);
+    rec.stage = stage;
+    if (pos < records_.size() && records_[pos].stage == stage && records_[pos].path() == entry.path) {
+        rec.path_data = records_[pos].path_data;
+        rec.path_size = records_[pos].path_size;
+        if (records_[pos].sha1 != rec.sha1 || records_[pos].mode != rec.mode) invalidate_cache_tree(entry.path);
+        rec.fsmonitor_valid = records_[pos].fsmonitor_valid && records_[pos].sha1 == rec.sha1 &&
+                              records_[pos].mode == rec.mode && records_[pos].stat == rec.stat;
+        records_[pos] = rec;
+        return;
+    }
+    invalidate_cache_tree(entry.path);
+    invalidate_untracked_cache(entry.path);
+    rec.path_data = store_path(entry.path);
+    rec.path_size = static_cast<uint32_t>(entry.path.size());
+    records_.insert(records_.begin() + static_cast<std::ptrdiff_t>(pos), rec);
+}
+
+void Index::set_skip_worktree(size_t i, bool skip) {
+    IndexRecord& rec = records_[i];
+    rec.skip_worktree = skip;
+    if (skip) {
+        rec.stat = IndexStat();
+        rec.fsmonitor_valid = false;
+    }
+}
+
+void Index::remove(std::string_view path, int stage) {
+    expand_to(path);
+    size_t first = lower_bound(path);
+    size_t last = first;
+    while (last < records_.size() && records_[last].path() == path) ++last;
+    if (first == last) return;
+    invalidate_cache_tree(path);
+    invalidate_untracked_cache(path);
+    auto begin = records_.begin() + static_cast<std::ptrdiff_t>(first);
+    auto end = records_.begin() + static_cast<std::ptrdiff_t>(last);
+    if (stage != -1) {
+        end = std::remove_if(begin, end, [&](const IndexRecord& rec) { return rec.stage == static_cast<uint32_t>(stage); });
+        records_.erase(end, records_.begin() + static_cast<std::ptrdiff_t>(last));
+    } else {
+        records_.erase(begin, end);
+    }
+}
+
+bool Index::up_to_date(size_t i, const IndexStat& current) const {
+    const IndexRecord& rec = records_[i];
+    if (rec.stat.empty() || rec.stat != current || rec.mode != current.mode) return false;
+    return !is_racy(rec.stat, IndexTimestamp{timestamp_sec_, timestamp_nsec_});
+}
+
+CacheTreeNode* CacheTreeNode::find(std::string_view name) {
+    auto it = std::lower_bound(subtrees.begin(), subtrees.end(), name,
+                               [](const auto& child, std::string_view n) { return compare_dir_names(child.first, n) < 0; });
+    return it != subtrees.end() && it->first == name ? it->second.get() : nullptr;
+}
+
+CacheTreeNode& CacheTreeNode::get_or_add(std::string_view name) {
+    auto it = std::lower_bound(subtrees.begin(), subtrees.end(), name,
+                               [](const auto& child, std::string_view n) { return compare_dir_names(child.first, n) < 0; });
+    if (it == subtrees.end() || it->first != name) {
+        it = subtrees.emplace(it, std::string(name), std::make_unique<CacheTreeNode>());
+    }
+    return *it->second;
+}
+
+void Index::invalidate_cache_tree(std::string_view path) {
+    CacheTreeNode* node = cache_tree_.get();
+    while (node) {
+        node->entry_count = -1;
+        size_t slash = path.find('/');
+        if (slash == std::string_view::npos) break;
+        node = node->find(path.substr(0, slash));
+        path.remove_prefix(slash + 1);
+    }
+}
+
+UntrackedCacheDir* UntrackedCacheDir::find(std::string_view name) {
+    auto it = std::lower_bound(subdirs.begin(), subdirs.end(), name,
+                               [](const auto& sub, std::string_view n) { return sub.first < n; });
+    return it != subdirs.end() && it->first == name ? it->second.get() : nullptr;
+}
+
+void Index::invalidate_untracked_cache(std::string_view path) {
+    UntrackedCacheDir* dir = untracked_cache_.get();
+    size_t slash;
+    while (dir && (slash = path.find('/')) != std::string_view::npos) {
+        dir = dir->find(path.substr(0, slash));
+        path.remove_prefix(slash + 1);
+    }
+    // Only the holding directory's lists are affected.
+    if (dir) dir->valid = false;
+}
+
+// Builds the tree for records [begin, end), all under the same directory
+// (prefix_size bytes long, trailing slash included). The tree format and
+// which modes are written match what write-tree has always produced.
+ObjectId Index::build_tree(CacheTreeNode& node, size_t begin, size_t end, size_t prefix_size) {
+    std::vector<TreeEntry> entries;
+    std::vector<std::pair<std::string, std::unique_ptr<CacheTreeNode>>> subtrees;
+    size_t i = begin;
+    while (i < end) {
+        const IndexRecord& rec = records_[i];
+        std::string_view rest = rec.path().substr(prefix_size);
+        size_t slash = rest.find('/');
+        if (slash == std::string_view::npos) {
+            if (is_tree_file_mode(rec.mode)) entries.push_back({format_mode(rec.mode), std::string(rest), rec.sha1});
+            ++i;
+            continue;
+        }
+        if (rec.is_sparse_directory() && slash + 1 == rest.size()) {
+            // Its tree is the one recorded; nothing below it is in the index.
+            entries.push_back({"40000", std::string(rest.substr(0, slash)), rec.sha1});
+            ++i;
+            continue;
+        }
+
+        // Everything under "<dir>/" sorts before "<dir>0" and after any other path.
+        std::string_view name = rest.substr(0, slash);
+        std::string dir_end(rec.path().substr(0, prefix_size + slash));
+        dir_end.push_back('0');
+        size_t sub_end = std::min(end, lower_bound(dir_end));
+
+        std::unique_ptr<CacheTreeNode> child;
+        if (CacheTreeNode* cached = node.find(name)) {
+            auto it = std::find_if(node.subtrees.begin(), node.subtrees.end(),
+                                   [&](const auto& sub) { return sub.second.get() == cached; });
+            child = std::move(it->second);
+        } else {
+            child = std::make_unique<CacheTreeNode>();
+        }
+        if (child->entry_count < 0 || static_cast<size_t>(child->entry_count) != sub_end - i) {
+            child->oid = build_tree(*child, i, sub_end, prefix_size + slash + 1);
+            child->entry_count = static_cast<int>(sub_end - i);
+        }
+        entries.push_back({"40000", std::string(name), child->oid});
+        subtrees.emplace_back(std::string(name), std::move(child));
+        i = sub_end;
+    }
+    // Directories that no longer have entries drop out of the cache here.
+    node.subtrees = std::move(subtrees);
+    return hash_and_write_object("tree", format_tree_content(entries));
+}
+
+ObjectId Index::write_tree(bool* cache_updated) {
+    if (cache_updated) *cache_updated = false;
+    if (!cache_tree_) cache_tree_ = std::make_unique<CacheTreeNode>();
+    if (cache_tree_->entry_count >= 0 && static_cast<size_t>(cache_tree_->entry_count) == records_.size()) {
+        return cache_tree_->oid;
     }
+    cache_tree_->oid = build_tree(*cache_tree_, 0, records_.size(), 0);
+    cache_tree_->entry_count = static_cast<int>(records_.size());
+    if (cache_updated) *cache_updated = true;
+    return cache_tree_->oid;
+}
 
-    if (index_file.bad()) {
-        throw std::runtime_error("Error reading from index file: " + index_path);
+namespace {
+
+// Fills `node` from the tree object; returns the number of index entries
+// it covers, or -1 if it holds something write_tree would not reproduce.
+int prime_cache_tree_node(CacheTreeNode& node, const ObjectId& tree) {
+    RawObject raw = read_raw_object(tree);
+    if (raw.type != "tree") return -1;
+    TreeReader reader(raw.content);
+    TreeEntryView entry;
+    int count = 0;
+    bool valid = true;
+    while (reader.next(entry)) {
+        if (entry.mode == "40000") {
+            int sub_count = prime_cache_tree_node(node.get_or_add(entry.name), entry.sha1);
+            if (sub_count < 0) valid = false;
+            else count += sub_count;
+        } else if (is_tree_file_mode(parse_mode(std::string(entry.mode)))) {
+            ++count;
+        } else {
+            valid = false;
+        }
     }
+    node.entry_count = valid ? count : -1;
+    node.oid = tree;
+    return node.entry_count;
+}
+
+} // namespace
 
-    return index_data;
+void Index::prime_cache_tree(const ObjectId& tree) {
+    auto root = std::make_unique<CacheTreeNode>();
+    try {
+        if (prime_cache_tree_node(*root, tree) != static_cast<int>(records_.size())) root->entry_count = -1;
+    } catch (const std::exception&) {
+        return; // A missing or corrupt tree just leaves nothing cached
+    }
+    cache_tree_ = std::move(root);
 }
 
-void write_index(const IndexMap& index_data) {
-    std::string index_path = GIT_DIR + "/index";       
+namespace {
+
+std::unique_ptr<CacheTreeNode> clone_cache_tree(const CacheTreeNode& node) {
+    auto copy = std::make_unique<CacheTreeNode>();
+    copy->entry_count = node.entry_count;
+    copy->oid = node.oid;
+    copy->subtrees.reserve(node.subtrees.size());
+    for (const auto& sub : node.subtrees) copy->subtrees.emplace_back(sub.first, clone_cache_tree(*sub.second));
+    return copy;
+}
+
+} // namespace
+
+Index Index::from_tree(const ObjectId& tree, const Index* base, std::vector<std::string>* changed,
+                       const std::function<bool(std::string_view)>& collapse) {
+    Index index;
+    auto root = std::make_unique<CacheTreeNode>();
+    std::string prefix;
+    int count = index.add_tree(*root, tree, prefix, base, base ? base->cache_tree() : nullptr, changed, collapse);
+    if (count != static_cast<int>(index.records_.size())) root->entry_count = -1;
+    index.cache_tree_ = std::move(root);
+    return index;
+}
+
+// Adds the entries of `tree`, whose paths start with `prefix` ("" or ending
+// in '/'), and fills `node` like prime_cache_tree_node. `base_node` is the
+// directory's cached tree in `base`, if any.
+int Index::add_tree(CacheTreeNode& node, const ObjectId& tree, std::string& prefix, const Index* base,
+                    const CacheTreeNode* base_node, std::vector<std::string>* changed,
+                    const std::function<bool(std::string_view)>& collapse) {
+    RawObject raw = read_raw_object(tree);
+    if (raw.type != "tree") throw std::runtime_error("object " + tree.hex() + " is a " + raw.type + ", not a tree");
+    TreeReader reader(raw.content);
+    TreeEntryView entry;
+    int count = 0;
+    bool valid = true;
+    size_t prefix_size = prefix.size();
+    while (reader.next(entry)) {
+        prefix.append(entry.name);
+        if (entry.mode == "40000") {
+            prefix.push_back('/');
+            if (collapse && collapse(prefix)) {
+                IndexRecord rec;
+                rec.sha1 = entry.sha1;
+                rec.mode = 040000;
+                rec.skip_worktree = true;
+                append(rec, prefix);
+                ++count;
+                prefix.resize(prefix_size);
+                continue;
+            }
+            const CacheTreeNode* base_sub = base_node ? base_node->find(entry.name) : nullptr;
+            CacheTreeNode& sub = node.get_or_add(entry.name);
+            int sub_count = -1;
+            if (base_sub && base_sub->entry_count >= 0 && base_sub->oid == entry.sha1) {
+                // Same tree as in base: its entries are there, in order.
+                size_t first = base->lower_bound(prefix);
+                size_t last = first;
+                while (last < base->records_.size() && base->records_[last].path().compare(0, prefix.size(), prefix) == 0) ++last;
+                if (last - first == static_cast<size_t>(base_sub->entry_count)) {
+                    for (size_t i = first; i < last; ++i) append(base->records_[i], base->records_[i].path());
+                    sub = std::move(*clone_cache_tree(*base_sub));
+                    sub_count = base_sub->entry_count;
+                } else {
+                    sub_count = add_tree(sub, entry.sha1, prefix, base, base_sub, changed, collapse);
+                }
+            } else {
+                sub_count = add_tree(sub, entry.sha1, prefix, base, base_sub, changed, collapse);
+            }
+            if (sub_count < 0) valid = false;
+            else count += sub_count;
+        } else {
+            IndexRecord rec;
+            rec.sha1 = entry.sha1;
+            rec.mode = parse_mode(std::string(entry.mode));
+            size_t base_pos = base ? base->find(prefix) : npos;
+            if (base_pos != npos && base->records_[base_pos].sha1 == rec.sha1 && base->records_[base_pos].mode == rec.mode) {
+                rec.stat = base->records_[base_pos].stat;
+            } else if (changed) {
+                changed->push_back(prefix);
+            }
+            append(rec, prefix);
+            if (is_tree_file_mode(rec.mode)) ++count;
+            else valid = false;
+        }
+        prefix.resize(prefix_size);
+    }
+    node.entry_count = valid ? count : -1;
+    node.oid = tree;
+    return node.entry_count;
+}
+
+// Adds a copy of `rec` at `path`; trees list entries in index order, so
+// this is normally an append.
+void Index::append(const IndexRecord& rec, std::string_view path) {
+    if (rec.is_sparse_directory()) sparse_ = true;
+    if (!records_.empty() && compare_path_stage(records_.back().path(), records_.back().stage, path, rec.stage) >= 0) {
+        IndexEntry entry;
+        entry.mode = format_mode(rec.mode);
+        entry.sha1 = rec.sha1;
+        entry.stage = static_cast<int>(rec.stage);
+        entry.path = std::string(path);
+        entry.stat = rec.stat;
+        add_or_update(entry);
+        if (rec.skip_worktree) records_[find(path, entry.stage)].skip_worktree = true;
+        return;
+    }
+    IndexRecord copy = rec;
+    copy.path_data = store_path(path);
+    copy.path_size = static_cast<uint32_t>(path.size());
+    copy.fsmonitor_valid = false;
+    records_.push_back(copy);
+}
+
+void Index::collapse_sparse_directories() {
+    if (!cache_tree_) return;
+    std::vector<IndexRecord> out;
+    out.reserve(records_.size());
+    CollapseEdits edits;
+    size_t count = collapse_tree(cache_tree_.get(), 0, records_.size(), 0, out, edits);
+    if (!edits.collapsed) return;
+    bool valid = cache_tree_->entry_count >= 0 && static_cast<size_t>(cache_tree_->entry_count) == records_.size();
+    records_ = std::move(out);
+    sparse_ = true;
+
+    cache_tree_->entry_count = valid ? static_cast<int>(count) : -1;
+    for (const auto& change : edits.counts) change.first->entry_count = change.second;
+    for (const auto& drop : edits.dropped) {
+        auto& subtrees = drop.first->subtrees;
+        subtrees.erase(std::find_if(subtrees.begin(), subtrees.end(),
+                                    [&](const auto& sub) { return sub.second.get() == drop.second; }));
+    }
+}
+
+// Copies records [begin, end), all under the directory of `node` (prefix_size
+// bytes long), to `out`, collapsing the subdirectories that can be. The new
+// counts of cached trees that were valid, and the nodes of collapsed
+// directories, go to `edits`. Returns the number of records written.
+size_t Index::collapse_tree(CacheTreeNode* node, size_t begin, size_t end, size_t prefix_size, std::vector<IndexRecord>& out,
+                            CollapseEdits& edits) {
+    size_t written = 0;
+    size_t i = begin;
+    while (i < end) {
+        const IndexRecord& rec = records_[i];
+        std::string_view rest = rec.path().substr(prefix_size);
+        size_t slash = rest.find('/');
+        if (slash == std::string_view::npos || slash + 1 == rest.size()) {
+            out.push_back(rec);
+            ++written;
+            ++i;
+            continue;
+        }
+        std::string_view name = rest.substr(0, slash);
+        std::string dir(rec.path().substr(0, prefix_size + slash + 1));
+        std::string dir_end(dir);
+        dir_end.back() = '0';
+        size_t sub_end = std::min(end, lower_bound(dir_end));
+        CacheTreeNode* child = node ? node->find(name) : nullptr;
+        bool child_valid = child && child->entry_count >= 0 && static_cast<size_t>(child->entry_count) == sub_end - i;
+        bool outside = std::all_of(records_.begin() + static_cast<std::ptrdiff_t>(i), records_.begin() + static_cast<std::ptrdiff_t>(sub_end),
+                                   [](const IndexRecord& r) { return r.stage == 0 && r.skip_worktree; });
+        if (child_valid && outside) {
+            IndexRecord collapsed;
+            collapsed.sha1 = child->oid;
+            collapsed.mode = 040000;
+            collapsed.skip_worktree = true;
+            collapsed.path_data = store_path(dir);
+            collapsed.path_size = static_cast<uint32_t>(dir.size());
+            out.push_back(collapsed);
+            ++written;
+            edits.collapsed = true;
+            edits.dropped.emplace_back(node, child);
+        } else {
+            size_t count = collapse_tree(child, i, sub_end, prefix_size + slash + 1, out, edits);
+            if (child) edits.counts.emplace_back(child, child_valid ? static_cast<int>(count) : -1);
+            written += count;
+        }
+        i = sub_end;
+    }
+    return written;
+}
+
+void Index::expand_sparse_directory(size_t i) {
+    IndexRecord dir = records_[i];
+    std::string prefix(dir.path());
+    RawObject raw = read_raw_object(dir.sha1);
+    if (raw.type != "tree") throw std::runtime_error("object " + dir.sha1.hex() + " is a " + raw.type + ", not a tree");
+
+    std::vector<IndexRecord> expanded;
+    bool valid = true;
+    TreeReader reader(raw.content);
+    TreeEntryView entry;
+    std::string path;
+    while (reader.next(entry)) {
+        IndexRecord rec;
+        rec.sha1 = entry.sha1;
+        rec.skip_worktree = true;
+        path = prefix;
+        path.append(entry.name);
+        if (entry.mode == "40000") {
+            rec.mode = 040000;
+            path.push_back('/');
+        } else {
+            rec.mode = parse_mode(std::string(entry.mode));
+            if (!is_tree_file_mode(rec.mode)) valid = false;
+        }
+        rec.path_data = store_path(path);
+        rec.path_size = static_cast<uint32_t>(path.size());
+        expanded.push_back(rec);
+    }
+    // Trees written before mygit used Git's order list a subtree "a" before
+    // a file "a-b"; index order compares it as "a/".
+    std::sort(expanded.begin(), expanded.end(),
+              [](const IndexRecord& a, const IndexRecord& b) { return a.path() < b.path(); });
+    records_.erase(records_.begin() + static_cast<std::ptrdiff_t>(i));
+    records_.insert(records_.begin() + static_cast<std::ptrdiff_t>(i), expanded.begin(), expanded.end());
+
+    // The directories holding it now have more entries; the directory
+    // itself gets the tree it was collapsed from.
+    std::string_view rest(prefix);
+    CacheTreeNode* node = cache_tree_.get();
+    while (node) {
+        if (node->entry_count >= 0) node->entry_count += static_cast<int>(expanded.size()) - 1;
+        size_t slash = rest.find('/');
+        if (slash + 1 == rest.size()) {
+            CacheTreeNode& sub = node->get_or_add(rest.substr(0, slash));
+            sub.subtrees.clear();
+            sub.entry_count = valid ? static_cast<int>(expanded.size()) : -1;
+            sub.oid = dir.sha1;
+            break;
+        }
+        node = node->find(rest.substr(0, slash));
+        rest.remove_prefix(slash + 1);
+    }
+}
+
+void Index::expand_to(std::string_view path) {
+    if (!sparse_) return;
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+        size_t pos = find(path.substr(0, slash + 1));
+        if (pos != npos && records_[pos].is_sparse_directory()) expand_sparse_directory(pos);
+    }
+}
+
+void Index::ensure_full() {
+    if (!sparse_) return;
+    for (size_t i = 0; i < records_.size();) {
+        if (records_[i].is_sparse_directory()) expand_sparse_directory(i); // Its first entry is looked at next
+        else ++i;
+    }
+    sparse_ = false;
+}
+
+const char* Index::store_path(std::string_view path) {
+    const size_t BLOCK_SIZE = 64 * 1024;
+    if (path.size() > BLOCK_SIZE / 4) { // Long paths get a block of their own
+        path_blocks_.emplace_back(new char[path.size()]);
+        std::memcpy(path_blocks_.back().get(), path.data(), path.size());
+        char* stored = path_blocks_.back().get();
+        // Keep the current small-path block last
+        if (path_blocks_.size() > 1) std::swap(path_blocks_.back(), path_blocks_[path_blocks_.size() - 2]);
+        return stored;
+    }
+    if (path_blocks_.empty() || block_used_ + path.size() > block_size_) {
+        path_blocks_.emplace_back(new char[BLOCK_SIZE]);
+        block_used_ = 0;
+        block_size_ = BLOCK_SIZE;
+    }
+    char* stored = path_blocks_.back().get() + block_used_;
+    std::memcpy(stored, path.data(), path.size());
+    block_used_ += path.size();
+    return stored;
+}
+
+namespace {
+
+// Works out the split index entries and bitmaps that turn `base` into
+// `entries`. Returns false when more than max_percent_change percent of the
+// base would differ, in which case a new base is due.
+bool diff_against_base(const std::vector<IndexRecord>& base, const std::vector<const IndexRecord*>& entries,
+                       unsigned max_percent_change, SplitLink& link,
+                       std::vector<const IndexRecord*>& split_entries, std::deque<IndexRecord>& stripped) {
+    link.deleted = Bitmap(base.size());
+    link.replaced = Bitmap(base.size());
+    std::vector<const IndexRecord*> added;
+    size_t changes = 0;
+    size_t i = 0, j = 0;
+    while (i < base.size() || j < entries.size()) {
+        int c = i == base.size() ? 1 : j == entries.size() ? -1
+              : compare_path_stage(base[i].path(), base[i].stage, entries[j]->path(), entries[j]->stage);
+        if (c < 0) {
+            link.deleted.set(i++);
+            ++changes;
+        } else if (c > 0) {
+            added.push_back(entries[j++]);
+            ++changes;
+        } else {
+            if (!same_record(base[i], *entries[j])) {
+                link.replaced.set(i);
+                stripped.push_back(*entries[j]);
+                stripped.back().path_size = 0; // Same path as the base entry
+                split_entries.push_back(&stripped.back());
+                ++changes;
+            }
+            ++i;
+            ++j;
+        }
+        if (changes * 100 > base.size() * max_percent_change) return false;
+    }
+    split_entries.insert(split_entries.end(), added.begin(), added.end());
+    return true;
+}
+
+} // namespace
+
+Index read_index() {
+    std::string index_path = GIT_DIR + "/index";
+    Index index;
+    if (!fs::exists(index_path)) return index;
+
+    IndexTimestamp timestamp = file_timestamp(index_path);
+    index.timestamp_sec_ = timestamp.sec;
+    index.timestamp_nsec_ = timestamp.nsec;
+    index.file_ = MappedFile(index_path);
+    const unsigned char* data = index.file_.data();
+    size_t size = index.file_.size();
+
+    if (size < 4 || std::memcmp(data, INDEX_SIGNATURE, 4) != 0) {
+        parse_text_index(std::string_view(reinterpret_cast<const char*>(data), size), index);
+        return index;
+    }
+
+    size_t pos = parse_binary_index(data, size, index_path, index.records_);
+    size_t body_size = size - ObjectId::RAW_SIZE;
+    std::optional<SplitLink> link;
+    std::optional<std::pair<std::string, Bitmap>> fsmonitor;
+    while (body_size - pos >= 8) {
+        const unsigned char* ext = data + pos;
+        uint32_t ext_size = get_be32(ext + 4);
+        if (ext_size > body_size - pos - 8) {
+            throw std::runtime_error("Index extension overruns the file: " + index_path);
+        }
+        if (std::memcmp(ext, CACHE_TREE_SIGNATURE, 4) == 0) {
+            const unsigned char* p = ext + 8;
+            auto root = std::make_unique<CacheTreeNode>();
+            std::string root_name;
+            if (parse_cache_tree(p, p + ext_size, *root, root_name) && root_name.empty()) {
+                index.cache_tree_ = std::move(root);
+            } else {
+                std::cerr << "Warning: Ignoring malformed cached tree data in " << index_path << std::endl;
+            }
+        } else if (std::memcmp(ext, UNTRACKED_CACHE_SIGNATURE, 4) == 0) {
+            const unsigned char* p = ext + 8;
+            auto root = std::make_unique<UntrackedCacheDir>();
+            std::string root_name;
+            if (parse_untracked_cache(p, p + ext_size, *root, root_name) && root_name.empty() && p == ext + 8 + ext_size) {
+                index.untracked_cache_ = std::move(root);
+            } else {
+                std::cerr << "Warning: Ignoring malformed untracked cache in " << index_path << std::endl;
+            }
+        } else if (std::memcmp(ext, FSMONITOR_SIGNATURE, 4) == 0) {
+            fsmonitor.emplace();
+            if (!parse_fsmonitor_extension(ext + 8, ext + 8 + ext_size, fsmonitor->first, fsmonitor->second)) {
+                std::cerr << "Warning: Ignoring malformed fsmonitor data in " << index_path << std::endl;
+                fsmonitor.reset();
+            }
+        } else if (std::memcmp(ext, SPARSE_DIRECTORY_SIGNATURE, 4) == 0) {
+            index.sparse_ = true;
+        } else if (std::memcmp(ext, LINK_SIGNATURE, 4) == 0) {
+            link.emplace();
+            if (!parse_link_extension(ext + 8, ext + 8 + ext_size, *link)) {
+                throw std::runtime_error("Malformed split index link in " + index_path);
+            }
+        } else if (ext[0] < 'A' || ext[0] > 'Z') {
+            // Only extensions starting with an upper-case letter are optional.
+            throw std::runtime_error("Unsupported index extension '" + std::string(reinterpret_cast<const char*>(ext), 4) + "': " + index_path);
+        }
+        pos += 8 + ext_size;
+    }
+    // Flags apply to the final entry list; a bitmap of another size is stale.
+    auto apply_fsmonitor_state = [&]() {
+        if (!fsmonitor || fsmonitor->second.bit_size != index.records_.size()) return;
+        index.fsmonitor_token_ = fsmonitor->first;
+        for (size_t i = 0; i < index.records_.size(); ++i) index.records_[i].fsmonitor_valid = fsmonitor->second.test(i);
+    };
+    if (!link || link->base.is_null()) {
+        check_index_order(index.records_, index_path);
+        apply_fsmonitor_state();
+        return index;
+    }
+
+    // Split index: apply this file's replacements, deletions and additions
+    // to the shared base.
+    std::string shared_path = GIT_DIR + "/" + SHARED_INDEX_PREFIX + link->base.hex();
+    if (!fs::exists(shared_path)) {
+        throw std::runtime_error("Shared index file is missing: " + shared_path);
+    }
+    index.base_file_ = MappedFile(shared_path);
+    const unsigned char* base_data = index.base_file_.data();
+    size_t base_size = index.base_file_.size();
+    parse_binary_index(base_data, base_size, shared_path, index.base_records_);
+    check_index_order(index.base_records_, shared_path);
+    if (std::memcmp(base_data + base_size - ObjectId::RAW_SIZE, link->base.data(), ObjectId::RAW_SIZE) != 0) {
+        throw std::runtime_error("Shared index file does not match its name: " + shared_path);
+    }
+    index.base_oid_ = link->base;
+
+    std::vector<IndexRecord> split = std::move(index.records_);
+    std::vector<IndexRecord> kept;
+    kept.reserve(index.base_records_.size());
+    size_t next = 0;
+    for (size_t i = 0; i < index.base_records_.size(); ++i) {
+        const IndexRecord& base_rec = index.base_records_[i];
+        IndexRecord rec = base_rec;
+        if (link->replaced.test(i)) {
+            if (next >= split.size()) {
+                throw std::runtime_error("Split index has fewer entries than replacements: " + index_path);
+            }
+            rec = split[next++];
+            if (rec.path_size == 0) {
+                rec.path_data = base_rec.path_data;
+                rec.path_size = base_rec.path_size;
+            }
+        }
+        if (!link->deleted.test(i)) kept.push_back(rec);
+    }
+    auto by_path_stage = [](const IndexRecord& a, const IndexRecord& b) {
+        return compare_path_stage(a.path(), a.stage, b.path(), b.stage) < 0;
+    };
+    index.records_.resize(kept.size() + (split.size() - next));
+    std::merge(kept.begin(), kept.end(), split.begin() + static_cast<std::ptrdiff_t>(next), split.end(),
+               index.records_.begin(), by_path_stage);
+    check_index_order(index.records_, index_path);
+    apply_fsmonitor_state();
+    return index;
+}
+
+void write_index(const Index& index) {
+    std::string index_path = GIT_DIR + "/index";
     std::string lock_path_str = GIT_DIR + "/index.lock";
     std::ofstream lock_file(lock_path_str);
     if (!lock_file) {
@@ -68,57 +1328,112 @@ void write_index(const IndexMap& index_data) {
     lock_file << "locked";
     lock_file.close();
 
-
-    std::string temp_index_path = index_path + ".tmp";
-    std::ofstream temp_file(temp_index_path, std::ios::binary | std::ios::trunc);
-    if (!temp_file) {
-        fs::remove(lock_path_str);
-        throw std::runtime_error("Failed to open temporary index file for writing: " + temp_index_path);
-    }
-
     try {
-        std::vector<IndexEntry> sorted_entries;
-        for (const auto& path_pair : index_data) {
-            for (const auto& stage_pair : path_pair.second) {
-                sorted_entries.push_back(stage_pair.second);
+        // Records are already in order; racily clean ones are re-checked and
+        // written from a copy if they had to be smudged.
+        IndexTimestamp old_timestamp = file_timestamp(index_path);
+        std::deque<IndexRecord> adjusted;
+        std::vector<const IndexRecord*> entries;
+        entries.reserve(index.size());
+        for (const IndexRecord& rec : index) {
+            if (rec.stage == 0 && !rec.stat.empty() && is_racy(rec.stat, old_timestamp)) {
+                IndexStat stat = rec.stat;
+                smudge_racily_clean_entry(rec, stat);
+                if (stat != rec.stat) {
+                    adjusted.push_back(rec);
+                    adjusted.back().stat = stat;
+                    adjusted.back().fsmonitor_valid = false;
+                    entries.push_back(&adjusted.back());
+                    continue;
+                }
             }
+            entries.push_back(&rec);
         }
-        std::sort(sorted_entries.begin(), sorted_entries.end());
 
-        for (const auto& entry : sorted_entries) {
-            temp_file << entry.mode << " " << entry.sha1 << " " << entry.stage << "\t" << entry.path << "\n";
-            if (!temp_file) {
-                throw std::runtime_error("Failed to write entry to temporary index file");
-            }
+        std::vector<std::pair<const char*, std::string>> extensions;
+        if (index.is_sparse() && std::any_of(entries.begin(), entries.end(), [](const IndexRecord* rec) { return rec->is_sparse_directory(); })) {
+            extensions.emplace_back(SPARSE_DIRECTORY_SIGNATURE, std::string());
         }
-        temp_file.close();
-        fs::rename(temp_index_path, index_path);
+        std::string cache_tree;
+        if (index.cache_tree()) serialize_cache_tree(*index.cache_tree(), "", cache_tree);
+        std::string untracked_cache;
+        if (index.untracked_cache()) serialize_untracked_cache(*index.untracked_cache(), "", untracked_cache);
+        std::string fsmonitor;
+        if (!index.fsmonitor_token().empty()) fsmonitor = format_fsmonitor_extension(index.fsmonitor_token(), entries);
 
+        if (!split_index_enabled(entries.size())) {
+            if (!cache_tree.empty()) extensions.emplace_back(CACHE_TREE_SIGNATURE, std::move(cache_tree));
+            if (!untracked_cache.empty()) extensions.emplace_back(UNTRACKED_CACHE_SIGNATURE, std::move(untracked_cache));
+            if (!fsmonitor.empty()) extensions.emplace_back(FSMONITOR_SIGNATURE, std::move(fsmonitor));
+            replace_file(index_path, format_index_file(entries, extensions));
+            if (!index.base_oid_.is_null()) remove_stale_shared_indexes("");
+        } else {
+            SplitLink link;
+            link.base = index.base_oid_;
+            std::vector<const IndexRecord*> split_entries;
+            std::string new_base;
+            if (index.base_oid_.is_null() ||
+                !diff_against_base(index.base_records_, entries, split_index_max_percent_change(), link,
+                                   split_entries, adjusted)) {
+                // Start a new base holding everything; this file then only links to it.
+                std::string shared = format_index_file(entries, {});
+                link.base = ObjectId::from_raw(reinterpret_cast<const unsigned char*>(shared.data()) + shared.size() - ObjectId::RAW_SIZE);
+                link.deleted = Bitmap(entries.size());
+                link.replaced = Bitmap(entries.size());
+                split_entries.clear();
+                new_base = SHARED_INDEX_PREFIX + link.base.hex();
+                if (!fs::exists(GIT_DIR + "/" + new_base)) replace_file(GIT_DIR + "/" + new_base, shared);
+            }
+            extensions.emplace_back(LINK_SIGNATURE, format_link_extension(link));
+            if (!cache_tree.empty()) extensions.emplace_back(CACHE_TREE_SIGNATURE, std::move(cache_tree));
+            if (!untracked_cache.empty()) extensions.emplace_back(UNTRACKED_CACHE_SIGNATURE, std::move(untracked_cache));
+            if (!fsmonitor.empty()) extensions.emplace_back(FSMONITOR_SIGNATURE, std::move(fsmonitor));
+            replace_file(index_path, format_index_file(split_entries, extensions));
+            if (!new_base.empty()) remove_stale_shared_indexes(new_base);
+        }
     } catch (...) {
-        fs::remove(temp_index_path);
         fs::remove(lock_path_str);
         throw;
     }
     fs::remove(lock_path_str);
 }
 
-void add_or_update_entry(IndexMap& index_data, const IndexEntry& entry) {
-    index_data[entry.path][entry.stage] = entry;
+namespace {
+
+void fill_index_stat(const struct stat& st, uint32_t mode, IndexStat& out) {
+    out.ctime_sec = static_cast<uint32_t>(st.st_ctime);
+    out.ctime_nsec = ctime_nsec(st);
+    out.mtime_sec = static_cast<uint32_t>(st.st_mtime);
+    out.mtime_nsec = mtime_nsec(st);
+    out.dev = static_cast<uint32_t>(st.st_dev);
+    out.ino = static_cast<uint32_t>(st.st_ino);
+    out.mode = mode;
+    out.uid = static_cast<uint32_t>(st.st_uid);
+    out.gid = static_cast<uint32_t>(st.st_gid);
+    out.size = static_cast<uint32_t>(st.st_size);
 }
 
-void remove_entry(IndexMap& index_data, const std::string& path, int stage) {
-    auto path_it = index_data.find(path);
-    if (path_it != index_data.end()) {
-        if (stage == -1) {
-            index_data.erase(path_it);
-        } else {
-            auto stage_it = path_it->second.find(stage);
-            if (stage_it != path_it->second.end()) {
-                path_it->second.erase(stage_it);
-                if (path_it->second.empty()) {
-                    index_data.erase(path_it);
-                }
-            }
-        }
+} // namespace
+
+bool stat_workdir_file(const std::string& path, IndexStat& out) {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0) return false;
+    uint32_t mode;
+    if (S_ISLNK(st.st_mode)) {
+        mode = 0120000;
+        if (::stat(path.c_str(), &st) != 0) return false; // Content is read through the link
+    } else if (S_ISREG(st.st_mode)) {
+        mode = (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) ? 0100755 : 0100644;
+    } else {
+        return false;
     }
-}
\ No newline at end of file
+    fill_index_stat(st, mode, out);
+    return true;
+}
+
+bool stat_workdir_directory(const std::string& path, IndexStat& out) {
+    struct stat st;
+    if (::lstat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+    fill_index_stat(st, 040000, out);
+    return true;
+}
@@ -0,0 +1,72 @@
+#include "headers/object_id.h"
+
+#include <stdexcept>
+
+namespace {
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+struct HexDecodeTable {
+    signed char values[256];
+    HexDecodeTable() {
+        for (int i = 0; i < 256; ++i) values[i] = -1;
+        for (int i = 0; i < 10; ++i) values['0' + i] = static_cast<signed char>(i);
+        for (int i = 0; i < 6; ++i) {
+            values['a' + i] = static_cast<signed char>(10 + i);
+            values['A' + i] = static_cast<signed char>(10 + i);
+        }
+    }
+};
+
+const HexDecodeTable HEX_DECODE;
+
+} // namespace
+
+int hex_digit_value(char c) {
+    return HEX_DECODE.values[static_cast<unsigned char>(c)];
+}
+
+bool ObjectId::try_from_hex(std::string_view hex, ObjectId& out) {
+    if (hex.size() != HEX_SIZE) return false;
+    for (size_t i = 0; i < RAW_SIZE; ++i) {
+        int hi = HEX_DECODE.values[static_cast<unsigned char>(hex[2 * i])];
+        int lo = HEX_DECODE.values[static_cast<unsigned char>(hex[2 * i + 1])];
+        if ((hi | lo) < 0) return false;
+        out.bytes[i] = static_cast<unsigned char>((hi << 4) | lo);
+    }
+    return true;
+}
+
+ObjectId ObjectId::from_hex(std::string_view hex) {
+    ObjectId id;
+    if (!try_from_hex(hex, id)) {
+        throw std::invalid_argument("Invalid object name '" + std::string(hex) + "'");
+    }
+    return id;
+}
+
+void ObjectId::write_hex(char* out) const {
+    for (size_t i = 0; i < RAW_SIZE; ++i) {
+        out[2 * i] = HEX_DIGITS[bytes[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[bytes[i] & 0x0f];
+    }
+}
+
+std::string ObjectId::hex() const {
+    std::string out(HEX_SIZE, '\0');
+    write_hex(&out[0]);
+    return out;
+}
+
+bool ObjectId::is_null() const {
+    for (unsigned char b : bytes) {
+        if (b) return false;
+    }
+    return true;
+}
+
+std::ostream& operator<<(std::ostream& os, const ObjectId& id) {
+    char buf[ObjectId::HEX_SIZE];
+    id.write_hex(buf);
+    return os.write(buf, ObjectId::HEX_SIZE);
+}
@@ -1,5 +1,9 @@
 #include "headers/objects.h"
+#include "headers/pack.h"
 #include "headers/utils.h"
+#include "headers/config.h"
+#include "headers/oid_table.h"
+#include "headers/hash.h"
 
 #include <stdexcept>
 #include <sstream>
@@ -7,12 +11,23 @@
 #include <algorithm>
 #include <cstring>
 #include <iostream> 
+#include <limits>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <cstdlib>
 
 #include <fstream>
+#include <cerrno>
+#include <cstdio>
 
-#include <openssl/sha.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-std::vector<unsigned char> hex_to_sha1(const std::string& sha1_hex);
+#include <openssl/sha.h>
+#include <zlib.h>
 
 std::string get_object_path(const std::string& sha1) {
     if (sha1.length() != 40) {
@@ -21,6 +36,15 @@ std::string get_object_path(const std::string& sha1) {
     return OBJECTS_DIR + "/" + sha1.substr(0, 2) + "/" + sha1.substr(2);
 }
 
+std::string get_object_path(const ObjectId& id) {
+    char hex[ObjectId::HEX_SIZE];
+    id.write_hex(hex);
+    std::string path;
+    path.reserve(OBJECTS_DIR.size() + ObjectId::HEX_SIZE + 2);
+    path.append(OBJECTS_DIR).append(1, '/').append(hex, 2).append(1, '/').append(hex + 2, ObjectId::HEX_SIZE - 2);
+    return path;
+}
+
 void ensure_object_directory_exists(const std::string& sha1) {
     if (sha1.length() != 40) {
          throw std::invalid_argument("Invalid SHA-1 length for directory creation: " + sha1);
@@ -33,49 +57,97 @@ std::string find_object(const std::string& sha1_prefix) {
     if (sha1_prefix.length() < 4) {
         throw std::runtime_error("fatal: ambiguous argument '" + sha1_prefix + "': unknown revision or path not in the working tree.");
     }
-    if (sha1_prefix.length() > 40) {
+    if (sha1_prefix.length() > 40 || sha1_prefix.find_first_not_of("0123456789abcdef") != std::string::npos) {
          throw std::runtime_error("fatal: Not a valid object name " + sha1_prefix);
     }
 
-    std::string dir_path = OBJECTS_DIR + "/" + sha1_prefix.substr(0, 2);
-    if (!fs::exists(dir_path) || !fs::is_directory(dir_path)) {
+    // Full names need no scan: one index lookup per pack, then one stat.
+    if (sha1_prefix.length() == 40) {
+        if (has_object(sha1_prefix)) return sha1_prefix;
+        throw std::runtime_error("fatal: Not a valid object name " + sha1_prefix);
+    }
+
+    // Abbreviations are a binary search in the process-wide name table.
+    std::vector<ObjectId> matches = find_objects_by_prefix(sha1_prefix);
+    if (matches.empty()) {
         throw std::runtime_error("fatal: Not a valid object name " + sha1_prefix);
     }
+    if (matches.size() > 1) {
+        throw std::runtime_error("fatal: ambiguous argument '" + sha1_prefix + "': multiple possibilities");
+    }
+    return matches[0].hex();
+}
+
+bool has_object(const std::string& sha1) {
+    ObjectId id;
+    return ObjectId::try_from_hex(sha1, id) && has_object(id);
+}
 
-    std::string rest_prefix = sha1_prefix.substr(2);
-    std::vector<std::string> matches;
+bool has_object(const ObjectId& id) {
+    return pack_has_object(id) || file_exists(get_object_path(id));
+}
 
-    for (const auto& entry : fs::directory_iterator(dir_path)) {
-        std::string filename = entry.path().filename().string();
-        if (filename.rfind(rest_prefix, 0) == 0) {
-             if (sha1_prefix.length() == 40 && filename.length() == 38) {
-                 return sha1_prefix;
-             }
-             matches.push_back(sha1_prefix.substr(0, 2) + filename);
+std::vector<ObjectId> list_loose_objects() {
+    std::vector<ObjectId> names;
+    if (!fs::is_directory(OBJECTS_DIR)) return names;
+    for (const auto& dir : fs::directory_iterator(OBJECTS_DIR)) {
+        std::string prefix = dir.path().filename().string();
+        if (prefix.length() != 2 || prefix.find_first_not_of("0123456789abcdef") != std::string::npos || !dir.is_directory()) {
+            continue;
+        }
+        for (const auto& entry : fs::directory_iterator(dir.path())) {
+            std::string filename = entry.path().filename().string();
+            ObjectId id;
+            if (filename.length() == 38 && filename.find_first_not_of("0123456789abcdef") == std::string::npos &&
+                ObjectId::try_from_hex(prefix + filename, id)) {
+                names.push_back(id);
+            }
         }
     }
+    return names;
+}
 
-    if (matches.empty()) {
-        throw std::runtime_error("fatal: Not a valid object name " + sha1_prefix);
+namespace {
+
+// Writes a loose object under a temporary name and renames it into place, so
+// readers (and other threads writing the same blob) never see a partial file.
+void write_loose_object_file(const ObjectId& id, const std::vector<unsigned char>& compressed) {
+    std::string path = get_object_path(id);
+    std::string tmp_path = path.substr(0, path.size() - (ObjectId::HEX_SIZE - 2)) + "tmp_obj_XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create temporary object file for " + path + ": " + std::strerror(errno));
     }
-    if (matches.size() > 1) {
-        if (sha1_prefix.length() < 40) {
-            throw std::runtime_error("fatal: ambiguous argument '" + sha1_prefix + "': multiple possibilities");
-        } else {
-            throw std::runtime_error("fatal: internal error - multiple objects found for full SHA: " + sha1_prefix);
+    size_t done = 0;
+    while (done < compressed.size()) {
+        ssize_t n = ::write(fd, compressed.data() + done, compressed.size() - done);
+        if (n <= 0) {
+            close(fd);
+            unlink(tmp_path.c_str());
+            throw std::runtime_error("Failed to write object file " + path);
         }
+        done += static_cast<size_t>(n);
+    }
+    fchmod(fd, 0444);
+    close(fd);
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        int err = errno;
+        unlink(tmp_path.c_str());
+        throw std::runtime_error("Failed to move object file into place " + path + ": " + std::strerror(err));
     }
-    return matches[0];
 }
 
+} // namespace
+
 void write_object(const std::string& sha1, const std::vector<unsigned char>& compressed_data) {
      try {
         ensure_object_directory_exists(sha1);
-        std::string path = get_object_path(sha1);
-        if (file_exists(path)) {
+        if (has_object(sha1)) {
             return;
         }
-        write_file(path, compressed_data);
+        ObjectId id = ObjectId::from_hex(sha1);
+        write_loose_object_file(id, compressed_data);
+        note_new_object(id);
     } catch (const std::exception& e) {
         throw std::runtime_error("Failed to write object " + sha1 + ": " + e.what());
     }
@@ -92,106 +164,400 @@ void write_object(const std::string& sha1, const std::string& object_type, const
     write_object(sha1, compressed);
 }
 
-std::string hash_and_write_object(const std::string& type, const std::string& content) {
+ObjectId hash_and_write_object(const std::string& type, const std::string& content) {
     // 1. Calculate SHA of the raw content
-    std::string content_sha1 = compute_sha1(content);
+    ObjectId id = compute_object_id(content);
 
-    // 2. Determine the object path based on the content SHA
-    std::string path = get_object_path(content_sha1);
-
-    // 3. If object doesn't exist at that path, create and write it
-    if (!file_exists(path)) {
+    // 2. If object doesn't exist loose or in a pack, create and write it
+    if (!has_object(id)) {
         // a. Construct the full object data with header
         std::string object_data = type + " " + std::to_string(content.size()) + '\0' + content;
 
         // b. Compress the full object data
         std::vector<unsigned char> compressed = compress_data(object_data);
 
-        // c. Ensure the directory exists for the path
+        // c. Ensure the directory exists, then write the file
          try {
-            ensure_object_directory_exists(content_sha1); // Use content SHA for directory
-            // d. Write the compressed data to the file
-            write_file(path, compressed);
+            ensure_object_directory_exists(id.hex());
+            write_loose_object_file(id, compressed);
+            note_new_object(id);
          } catch (const std::exception& e) {
-             // Rethrow or handle more gracefully?
-              throw std::runtime_error("Failed to write object content for SHA " + content_sha1 + ": " + e.what());
+              throw std::runtime_error("Failed to write object content for SHA " + id.hex() + ": " + e.what());
          }
     }
 
-    // 4. Return the SHA of the raw content
-    return content_sha1;
+    // 3. Return the SHA of the raw content
+    return id;
 }
 
-ParsedObject read_object(const std::string& sha1_prefix_or_full) {
-    std::string sha1 = find_object(sha1_prefix_or_full);
-    std::string path = get_object_path(sha1);
+namespace {
+
+// Files are streamed through hash and deflate in chunks of this size; files no
+// bigger than the threshold are simply read whole and go through
+// hash_and_write_object, which skips compression for objects we already have.
+const size_t STREAM_CHUNK_SIZE = 64 * 1024;
+const uint64_t STREAM_THRESHOLD = 1024 * 1024;
+
+struct FileCloser {
+    int fd;
+    ~FileCloser() { if (fd >= 0) close(fd); }
+};
+
+std::string read_fd_fully(int fd, size_t size, const std::string& path) {
+    std::string content(size, '\0');
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(fd, &content[done], size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("Failed to read file: " + path);
+        done += static_cast<size_t>(n);
+    }
+    return content;
+}
 
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    if (!file) {
-        throw std::runtime_error("Failed to open object file: " + path);
+// Deflates everything handed to it straight into a temporary file under
+// objects/, to be renamed once the object name is known.
+class LooseObjectStream {
+public:
+    LooseObjectStream() : tmp_path_(OBJECTS_DIR + "/tmp_obj_XXXXXX"), out_(STREAM_CHUNK_SIZE) {
+        fd_ = mkstemp(&tmp_path_[0]);
+        if (fd_ < 0) {
+            throw std::runtime_error("Failed to create temporary object file: " + std::string(std::strerror(errno)));
+        }
+        if (deflateInit(&strm_, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            close(fd_);
+            unlink(tmp_path_.c_str());
+            throw std::runtime_error("zlib deflateInit failed");
+        }
+    }
+    ~LooseObjectStream() {
+        deflateEnd(&strm_);
+        if (fd_ >= 0) close(fd_);
+        if (!committed_) unlink(tmp_path_.c_str());
+    }
+
+    void write(const char* data, size_t len) { deflate_into_file(data, len, Z_NO_FLUSH); }
+
+    // Finishes the stream and moves it to the object's path, unless an
+    // identical object appeared meanwhile.
+    void commit(const ObjectId& id) {
+        deflate_into_file(nullptr, 0, Z_FINISH);
+        fchmod(fd_, 0444);
+        close(fd_);
+        fd_ = -1;
+        if (has_object(id)) return;
+        ensure_object_directory_exists(id.hex());
+        std::string path = get_object_path(id);
+        if (std::rename(tmp_path_.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Failed to move object file into place " + path + ": " + std::strerror(errno));
+        }
+        committed_ = true;
     }
 
-    std::streamsize compressed_size = file.tellg();
-    if (compressed_size < 0) {
-        file.close();
-        throw std::runtime_error("Failed to get size of object file: " + path);
+private:
+    void deflate_into_file(const char* data, size_t len, int flush) {
+        strm_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        strm_.avail_in = static_cast<uInt>(len);
+        int ret;
+        do {
+            strm_.next_out = out_.data();
+            strm_.avail_out = static_cast<uInt>(out_.size());
+            ret = deflate(&strm_, flush);
+            if (ret == Z_STREAM_ERROR) throw std::runtime_error("zlib compression failed");
+            size_t have = out_.size() - strm_.avail_out;
+            size_t done = 0;
+            while (done < have) {
+                ssize_t n = ::write(fd_, out_.data() + done, have - done);
+                if (n <= 0) throw std::runtime_error("Failed to write temporary object file " + tmp_path_);
+                done += static_cast<size_t>(n);
+            }
+        } while (strm_.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
     }
-    file.seekg(0, std::ios::beg);
-    std::vector<unsigned char> compressed_data(compressed_size);
-    if (compressed_size > 0 && !file.read(reinterpret_cast<char*>(compressed_data.data()), compressed_size)) {
-        file.close();
-        throw std::runtime_error("Failed to read object file: " + path);
+
+    std::string tmp_path_;
+    int fd_ = -1;
+    bool committed_ = false;
+    z_stream strm_ = {};
+    std::vector<unsigned char> out_;
+};
+
+// Reads exactly `size` bytes from `fd` in fixed-size chunks, hashing them and
+// handing them to `stream` if given. The object name covers the content only;
+// the "type size\0" header is written to the stream by the caller.
+ObjectId stream_file_content(int fd, uint64_t size, const std::string& path, LooseObjectStream* stream) {
+    Sha1Context sha;
+    std::vector<char> chunk(STREAM_CHUNK_SIZE);
+    uint64_t remaining = size;
+    while (remaining > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, chunk.size()));
+        ssize_t n = ::read(fd, chunk.data(), want);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("File " + path + " shrank while it was being hashed");
+        sha.update(chunk.data(), static_cast<size_t>(n));
+        if (stream) stream->write(chunk.data(), static_cast<size_t>(n));
+        remaining -= static_cast<uint64_t>(n);
+    }
+    char extra;
+    if (::read(fd, &extra, 1) > 0) {
+        throw std::runtime_error("File " + path + " grew while it was being hashed");
     }
-    file.close();
 
+    return sha.finish();
+}
+
+} // namespace
 
-    std::string decompressed_data;
-    try {
-        decompressed_data = decompress_chunk(compressed_data);
-    } catch (const std::runtime_error& e) {
-        throw std::runtime_error("Failed to decompress object " + sha1 + ": " + e.what());
+ObjectId hash_file_object(const std::string& path, const std::string& type, bool write) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file " + path + ": " + std::strerror(errno));
     }
-    if (decompressed_data.empty() && compressed_size > 0) {
-        throw std::runtime_error("Decompression resulted in empty data for object " + sha1);
+    FileCloser closer{fd};
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        throw std::runtime_error("Failed to stat file " + path + ": " + std::strerror(errno));
     }
+    uint64_t size = static_cast<uint64_t>(st.st_size);
 
-    const char* null_terminator = static_cast<const char*>(memchr(decompressed_data.data(), '\0', decompressed_data.size()));
-    if (!null_terminator) {
-        throw std::runtime_error("Invalid object format: Missing null terminator in object " + sha1);
+    if (size <= STREAM_THRESHOLD) {
+        std::string content = read_fd_fully(fd, static_cast<size_t>(size), path);
+        return write ? hash_and_write_object(type, content) : compute_object_id(content);
     }
 
-    std::string header(decompressed_data.data(), null_terminator - decompressed_data.data());
-    size_t header_len = header.length() + 1;
-    std::string content = decompressed_data.substr(header_len);
+    // Hash first: objects we already have (re-adding an unchanged file) cost
+    // one read and no compression, just as in hash_and_write_object.
+    ObjectId id = stream_file_content(fd, size, path, nullptr);
+    if (!write || has_object(id)) return id;
+
+    if (lseek(fd, 0, SEEK_SET) != 0) {
+        throw std::runtime_error("Failed to rewind file " + path + ": " + std::strerror(errno));
+    }
+    LooseObjectStream stream;
+    std::string header = type + " " + std::to_string(size) + '\0';
+    stream.write(header.data(), header.size());
+    if (stream_file_content(fd, size, path, &stream) != id) {
+        throw std::runtime_error("File " + path + " changed while it was being added");
+    }
+    stream.commit(id);
+    note_new_object(id);
+    return id;
+}
+
+namespace {
+
+// Loose objects below this size are read with a single read(); larger ones are mmap'd.
+const size_t LOOSE_MMAP_THRESHOLD = 64 * 1024;
 
+std::string zlib_failure(const std::string& sha1, int ret) {
+    if (ret == Z_BUF_ERROR) return "Failed to decompress object " + sha1 + ": data is truncated";
+    return "Failed to decompress object " + sha1 + ": zlib error " + std::to_string(ret);
+}
+
+// Parses the "type size" header of a loose object (without the trailing NUL).
+ObjectHeader parse_loose_header(const std::string& header, const std::string& sha1) {
     size_t space_pos = header.find(' ');
     if (space_pos == std::string::npos) {
         throw std::runtime_error("Invalid object format: Malformed header '" + header + "' in object " + sha1);
     }
 
-    ParsedObject result;
+    ObjectHeader result;
     result.type = header.substr(0, space_pos);
     std::string size_str = header.substr(space_pos + 1);
-
     try {
         char* endptr;
         unsigned long long parsed_size_ll = std::strtoull(size_str.c_str(), &endptr, 10);
-        if (*endptr != '\0') throw std::invalid_argument("Invalid size characters");
+        if (size_str.empty() || *endptr != '\0') throw std::invalid_argument("Invalid size characters");
         if (parsed_size_ll > std::numeric_limits<size_t>::max()) throw std::out_of_range("Size exceeds size_t capacity");
         result.size = static_cast<size_t>(parsed_size_ll);
     } catch (const std::exception& e) {
         throw std::runtime_error("Invalid object format: Cannot parse size '" + size_str + "' in object " + sha1 + ": " + e.what());
     }
+    return result;
+}
 
-    if (result.size != content.length()) {
-        throw std::runtime_error("Object size mismatch: Header says " + std::to_string(result.size)
-                                 + ", but content length is " + std::to_string(content.length())
+// Inflates a loose object in two steps: just enough to see the "type size\0"
+// header, then the rest straight into a content buffer of exactly that size.
+RawObject inflate_loose_object(const unsigned char* data, size_t len, const std::string& sha1) {
+    if (len == 0) {
+        throw std::runtime_error("Decompression resulted in empty data for object " + sha1);
+    }
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        throw std::runtime_error("inflateInit failed for object " + sha1);
+    }
+    struct StreamGuard {
+        z_stream* zs;
+        ~StreamGuard() { inflateEnd(zs); }
+    } guard{&zs};
+
+    zs.next_in = const_cast<Bytef*>(data);
+    zs.avail_in = static_cast<uInt>(std::min<size_t>(len, std::numeric_limits<uInt>::max()));
+
+    // "commit 18446744073709551615\0" is the longest valid header.
+    char header_buf[64];
+    zs.next_out = reinterpret_cast<Bytef*>(header_buf);
+    zs.avail_out = sizeof(header_buf);
+    const char* null_terminator = nullptr;
+    int ret = Z_OK;
+    while (!null_terminator) {
+        ret = inflate(&zs, Z_SYNC_FLUSH);
+        size_t have = sizeof(header_buf) - zs.avail_out;
+        null_terminator = static_cast<const char*>(memchr(header_buf, '\0', have));
+        if (null_terminator) break;
+        if (ret == Z_STREAM_END || zs.avail_out == 0) {
+            throw std::runtime_error("Invalid object format: Missing null terminator in object " + sha1);
+        }
+        if (ret != Z_OK) {
+            throw std::runtime_error(zlib_failure(sha1, ret));
+        }
+    }
+    size_t have = sizeof(header_buf) - zs.avail_out;
+
+    std::string header_text(header_buf, null_terminator - header_buf);
+    size_t header_len = header_text.length() + 1;
+    ObjectHeader header = parse_loose_header(header_text, sha1);
+    size_t header_size = header.size;
+    RawObject raw;
+    raw.type = std::move(header.type);
+
+    size_t already = have - header_len;
+    if (already > header_size) {
+        throw std::runtime_error("Object size mismatch: Header says " + std::to_string(header_size)
+                                 + ", but content is longer in object " + sha1);
+    }
+    raw.content.resize(header_size);
+    std::memcpy(&raw.content[0], null_terminator + 1, already);
+
+    size_t filled = already;
+    while (ret != Z_STREAM_END && filled < header_size) {
+        zs.next_out = reinterpret_cast<Bytef*>(&raw.content[filled]);
+        zs.avail_out = static_cast<uInt>(std::min<size_t>(header_size - filled, std::numeric_limits<uInt>::max()));
+        size_t before = zs.avail_out;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        filled += before - zs.avail_out;
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            throw std::runtime_error(zlib_failure(sha1, ret));
+        }
+    }
+    if (ret != Z_STREAM_END) {
+        // The content buffer is full; the stream must end without producing more.
+        char extra;
+        zs.next_out = reinterpret_cast<Bytef*>(&extra);
+        zs.avail_out = 1;
+        ret = inflate(&zs, Z_FINISH);
+        if (ret != Z_STREAM_END || zs.avail_out == 0) {
+            throw std::runtime_error("Object size mismatch: Header says " + std::to_string(header_size)
+                                     + ", but content is longer in object " + sha1);
+        }
+    }
+    if (filled != header_size) {
+        throw std::runtime_error("Object size mismatch: Header says " + std::to_string(header_size)
+                                 + ", but content length is " + std::to_string(filled)
                                  + " in object " + sha1);
     }
+    return raw;
+}
+
+// Inflates just enough of a loose object to see its header. The file is read
+// in small pieces rather than mapped, so this costs the same for any size.
+ObjectHeader read_loose_object_header(const std::string& sha1) {
+    std::string path = get_object_path(sha1);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open object file: " + path);
+    }
+    FileCloser closer{fd};
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        throw std::runtime_error("inflateInit failed for object " + sha1);
+    }
+    struct StreamGuard {
+        z_stream* zs;
+        ~StreamGuard() { inflateEnd(zs); }
+    } guard{&zs};
+
+    unsigned char in[512];
+    char header_buf[64];
+    zs.next_out = reinterpret_cast<Bytef*>(header_buf);
+    zs.avail_out = sizeof(header_buf);
+    while (true) {
+        if (zs.avail_in == 0) {
+            ssize_t n = ::read(fd, in, sizeof(in));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error(zlib_failure(sha1, Z_BUF_ERROR));
+            zs.next_in = in;
+            zs.avail_in = static_cast<uInt>(n);
+        }
+        int ret = inflate(&zs, Z_SYNC_FLUSH);
+        size_t have = sizeof(header_buf) - zs.avail_out;
+        const char* null_terminator = static_cast<const char*>(memchr(header_buf, '\0', have));
+        if (null_terminator) {
+            return parse_loose_header(std::string(header_buf, null_terminator - header_buf), sha1);
+        }
+        if (ret == Z_STREAM_END || zs.avail_out == 0) {
+            throw std::runtime_error("Invalid object format: Missing null terminator in object " + sha1);
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw std::runtime_error(zlib_failure(sha1, ret));
+        }
+    }
+}
+
+} // namespace
+
+RawObject read_loose_object(const std::string& sha1) {
+    std::string path = get_object_path(sha1);
+    MappedFile file;
+    try {
+        file = MappedFile(path, LOOSE_MMAP_THRESHOLD);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Failed to open object file: " + path);
+    }
+    return inflate_loose_object(file.data(), file.size(), sha1);
+}
+
+RawObject read_raw_object(const ObjectId& id) {
+    RawObject raw;
+    if (read_packed_object(id, raw)) {
+        return raw;
+    }
+    return read_loose_object(id.hex());
+}
+
+RawObject read_raw_object(const std::string& sha1) {
+    return read_raw_object(ObjectId::from_hex(sha1));
+}
+
+ObjectHeader read_object_header(const ObjectId& id) {
+    ObjectHeader header;
+    if (read_packed_object_header(id, header)) {
+        return header;
+    }
+    return read_loose_object_header(id.hex());
+}
+
+ObjectHeader read_object_header(const std::string& sha1_prefix_or_full) {
+    ObjectId id;
+    if (!ObjectId::try_from_hex(sha1_prefix_or_full, id)) {
+        id = ObjectId::from_hex(find_object(sha1_prefix_or_full));
+    }
+    return read_object_header(id);
+}
+
+namespace {
+
+ParsedObject parse_raw_object(const std::string& sha1, RawObject raw) {
+    ParsedObject result;
+    result.type = std::move(raw.type);
+    result.size = raw.content.size();
+    const std::string& content = raw.content;
 
     try {
         if (result.type == "blob") {
-            result.data = parse_blob_content(content);
+            result.data = parse_blob_content(std::move(raw.content));
         } else if (result.type == "tree") {
             result.data = parse_tree_content(content);
         } else if (result.type == "commit") {
@@ -204,185 +570,321 @@ ParsedObject read_object(const std::string& sha1_prefix_or_full) {
     } catch (const std::exception& e) {
          throw std::runtime_error("Failed to parse " + result.type + " object " + sha1 + ": " + e.what());
     }
-
-
     return result;
 }
 
-BlobObject parse_blob_content(const std::string& content) {
-    return {content};
+// --- Parsed object cache ---
+// Objects are immutable, so entries never need invalidating; the LRU only
+// bounds memory. Keyed by the binary object name.
+
+const uint64_t DEFAULT_OBJECT_CACHE_LIMIT = 64ull << 20;
+
+// Rough heap footprint, so the limit tracks real memory rather than entry count.
+size_t estimate_object_bytes(const ParsedObject& object) {
+    size_t bytes = sizeof(ParsedObject) + 64;
+    if (const auto* blob = std::get_if<BlobObject>(&object.data)) {
+        bytes += blob->content.capacity();
+    } else if (const auto* tree = std::get_if<TreeObject>(&object.data)) {
+        for (const auto& entry : tree->entries) {
+            bytes += sizeof(TreeEntry) + entry.mode.capacity() + entry.name.capacity();
+        }
+    } else if (const auto* commit = std::get_if<CommitObject>(&object.data)) {
+        bytes += commit->message.capacity() + commit->author_info.capacity() + commit->committer_info.capacity()
+                 + commit->parent_sha1s.capacity() * sizeof(ObjectId);
+    } else if (const auto* tag = std::get_if<TagObject>(&object.data)) {
+        bytes += tag->message.capacity() + tag->tagger_info.capacity() + tag->tag_name.capacity() + tag->type.capacity();
+    }
+    return bytes;
 }
 
-TreeObject parse_tree_content(const std::string& content) {
-    TreeObject tree;
-    const char* data_ptr = content.data();
-    const char* end_ptr = data_ptr + content.size();
-
-    while (data_ptr < end_ptr) {
-        const char* space_ptr = static_cast<const char*>(memchr(data_ptr, ' ', end_ptr - data_ptr));
-        if (!space_ptr) throw std::runtime_error("Malformed tree entry: missing space after mode");
-        std::string mode(data_ptr, space_ptr - data_ptr);
-
-        const char* name_start_ptr = space_ptr + 1;
-        const char* null_ptr = static_cast<const char*>(memchr(name_start_ptr, '\0', end_ptr - name_start_ptr));
-        if (!null_ptr) throw std::runtime_error("Malformed tree entry: missing null after name");
-        std::string name(name_start_ptr, null_ptr - name_start_ptr);
-
-        const char* sha1_start_ptr = null_ptr + 1;
-        if (sha1_start_ptr + SHA_DIGEST_LENGTH > end_ptr) {
-             throw std::runtime_error("Malformed tree entry: insufficient data for SHA-1");
+class ObjectCache {
+public:
+    std::shared_ptr<const ParsedObject> get(const ObjectId& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        init();
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            stats_.misses++;
+            return nullptr;
+        }
+        stats_.hits++;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->object;
+    }
+
+    void put(const ObjectId& key, std::shared_ptr<const ParsedObject> object) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        init();
+        size_t bytes = estimate_object_bytes(*object);
+        // A single huge blob would flush everything else for little benefit.
+        if (bytes > stats_.limit / 8 || map_.count(key)) return;
+        lru_.push_front(Entry{key, std::move(object), bytes});
+        map_[key] = lru_.begin();
+        stats_.bytes += bytes;
+        stats_.entries++;
+        while (stats_.bytes > stats_.limit && !lru_.empty()) {
+            stats_.bytes -= lru_.back().bytes;
+            stats_.entries--;
+            stats_.evictions++;
+            map_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    }
+
+    bool accepts(const ParsedObject& object) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        init();
+        return estimate_object_bytes(object) <= stats_.limit / 8;
+    }
+
+    ObjectCacheStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        init();
+        return stats_;
+    }
+
+    void set_limit(uint64_t limit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        init();
+        stats_.limit = limit;
+        while (stats_.bytes > stats_.limit && !lru_.empty()) {
+            stats_.bytes -= lru_.back().bytes;
+            stats_.entries--;
+            stats_.evictions++;
+            map_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    }
+
+private:
+    struct Entry {
+        ObjectId key;
+        std::shared_ptr<const ParsedObject> object;
+        size_t bytes;
+    };
+
+    // The limit comes from MYGIT_OBJECT_CACHE_LIMIT or core.objectCacheLimit.
+    void init() {
+        if (initialised_) return;
+        initialised_ = true;
+        stats_.limit = DEFAULT_OBJECT_CACHE_LIMIT;
+        const char* env = std::getenv("MYGIT_OBJECT_CACHE_LIMIT");
+        std::optional<std::string> value = env ? std::optional<std::string>(env) : get_config_value("core.objectCacheLimit");
+        if (value) {
+            try {
+                stats_.limit = parse_size_value(*value);
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: Ignoring object cache limit: " << e.what() << std::endl;
+            }
         }
+        if (std::getenv("MYGIT_TRACE_OBJECT_CACHE")) std::atexit(print_object_cache_stats);
+    }
+
+    std::mutex mutex_; // Readers may run on several threads
+    bool initialised_ = false;
+    ObjectCacheStats stats_;
+    std::list<Entry> lru_; // Most recently used first
+    std::unordered_map<ObjectId, std::list<Entry>::iterator> map_;
+};
+
+ObjectCache g_object_cache;
+
+} // namespace
+
+std::shared_ptr<const ParsedObject> read_object_cached(const ObjectId& id) {
+    if (auto hit = g_object_cache.get(id)) return hit;
+    std::string sha1 = id.hex();
+    auto object = std::make_shared<const ParsedObject>(parse_raw_object(sha1, read_raw_object(id)));
+    g_object_cache.put(id, object);
+    return object;
+}
 
-        std::string sha1_hex = sha1_to_hex(reinterpret_cast<const unsigned char*>(sha1_start_ptr));
+std::shared_ptr<const ParsedObject> read_object_cached(const std::string& sha1_prefix_or_full) {
+    ObjectId id;
+    // A cached full name needs no existence check on disk.
+    if (ObjectId::try_from_hex(sha1_prefix_or_full, id)) {
+        if (auto hit = g_object_cache.get(id)) return hit;
+    }
+    return read_object_cached(ObjectId::from_hex(find_object(sha1_prefix_or_full)));
+}
 
-        tree.entries.push_back({mode, name, sha1_hex});
+ParsedObject read_object(const ObjectId& id) {
+    if (auto hit = g_object_cache.get(id)) return *hit;
+    ParsedObject object = parse_raw_object(id.hex(), read_raw_object(id));
+    if (g_object_cache.accepts(object)) g_object_cache.put(id, std::make_shared<const ParsedObject>(object));
+    return object;
+}
 
-        data_ptr = sha1_start_ptr + SHA_DIGEST_LENGTH;
+ParsedObject read_object(const std::string& sha1_prefix_or_full) {
+    ObjectId id;
+    if (ObjectId::try_from_hex(sha1_prefix_or_full, id)) {
+        if (auto hit = g_object_cache.get(id)) return *hit;
     }
-    if (data_ptr != end_ptr) {
-        throw std::runtime_error("Malformed tree object: trailing data found");
+    return read_object(ObjectId::from_hex(find_object(sha1_prefix_or_full)));
+}
+
+ObjectCacheStats get_object_cache_stats() {
+    return g_object_cache.stats();
+}
+
+void set_object_cache_limit(uint64_t bytes) {
+    g_object_cache.set_limit(bytes);
+}
+
+void print_object_cache_stats() {
+    ObjectCacheStats stats = g_object_cache.stats();
+    std::cerr << "object cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evictions, " << stats.entries << " entries, "
+              << stats.bytes << "/" << stats.limit << " bytes" << std::endl;
+}
+
+BlobObject parse_blob_content(std::string content) {
+    return {std::move(content)};
+}
+
+bool TreeReader::next(TreeEntryView& entry) {
+    if (pos_ >= data_.size()) return false;
+    const char* data_ptr = data_.data() + pos_;
+    const char* end_ptr = data_.data() + data_.size();
+
+    const char* space_ptr = static_cast<const char*>(memchr(data_ptr, ' ', end_ptr - data_ptr));
+    if (!space_ptr) throw std::runtime_error("Malformed tree entry: missing space after mode");
+    entry.mode = std::string_view(data_ptr, space_ptr - data_ptr);
+
+    const char* name_start_ptr = space_ptr + 1;
+    const char* null_ptr = static_cast<const char*>(memchr(name_start_ptr, '\0', end_ptr - name_start_ptr));
+    if (!null_ptr) throw std::runtime_error("Malformed tree entry: missing null after name");
+    entry.name = std::string_view(name_start_ptr, null_ptr - name_start_ptr);
+
+    const char* sha1_start_ptr = null_ptr + 1;
+    if (end_ptr - sha1_start_ptr < SHA_DIGEST_LENGTH) {
+         throw std::runtime_error("Malformed tree entry: insufficient data for SHA-1");
     }
+    entry.sha1 = ObjectId::from_raw(reinterpret_cast<const unsigned char*>(sha1_start_ptr));
 
+    pos_ = (sha1_start_ptr + SHA_DIGEST_LENGTH) - data_.data();
+    return true;
+}
+
+TreeObject parse_tree_content(std::string_view content) {
+    TreeObject tree;
+    TreeReader reader(content);
+    TreeEntryView entry;
+    while (reader.next(entry)) {
+        tree.entries.push_back({std::string(entry.mode), std::string(entry.name), entry.sha1});
+    }
     return tree;
 }
 
-CommitObject parse_commit_content(const std::string& content) {
-    CommitObject commit;
-    std::istringstream iss(content);
-    std::string line;
-    bool in_message = false;
+namespace {
+
+// Walks "key value" header lines up to the first blank line and returns the
+// message after it (minus one trailing newline).
+template <typename HeaderFn>
+std::string_view parse_header_lines(std::string_view content, const char* kind, HeaderFn&& on_header) {
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t eol = content.find('\n', pos);
+        size_t line_end = (eol == std::string_view::npos) ? content.size() : eol;
+        std::string_view line = content.substr(pos, line_end - pos);
+        pos = (eol == std::string_view::npos) ? content.size() : eol + 1;
 
-    while (std::getline(iss, line)) {
-        if (in_message) {
-            commit.message += line + "\n";
-            continue;
-        }
         if (line.empty()) {
-            in_message = true;
-            continue;
+            std::string_view message = content.substr(pos);
+            if (!message.empty() && message.back() == '\n') message.remove_suffix(1);
+            return message;
         }
-
         size_t space_pos = line.find(' ');
-        if (space_pos == std::string::npos) {
-            throw std::runtime_error("Malformed commit header line: " + line);
+        if (space_pos == std::string_view::npos) {
+            throw std::runtime_error(std::string("Malformed ") + kind + " header line: " + std::string(line));
         }
-        std::string key = line.substr(0, space_pos);
-        std::string value = line.substr(space_pos + 1);
+        on_header(line.substr(0, space_pos), line.substr(space_pos + 1));
+    }
+    return {};
+}
+
+ObjectId parse_header_oid(std::string_view value, const char* kind, std::string_view key) {
+    ObjectId id;
+    if (!ObjectId::try_from_hex(value, id)) {
+        throw std::runtime_error(std::string("Malformed ") + kind + " " + std::string(key) + " line: " + std::string(value));
+    }
+    return id;
+}
+
+} // namespace
 
+CommitView parse_commit_view(std::string_view content) {
+    CommitView commit;
+    commit.message = parse_header_lines(content, "commit", [&](std::string_view key, std::string_view value) {
         if (key == "tree") {
-            commit.tree_sha1 = value;
+            commit.tree_sha1 = parse_header_oid(value, "commit", key);
         } else if (key == "parent") {
-            commit.parent_sha1s.push_back(value);
+            commit.parent_sha1s.push_back(parse_header_oid(value, "commit", key));
         } else if (key == "author") {
             commit.author_info = value;
         } else if (key == "committer") {
             commit.committer_info = value;
         }
-    }
-    if (!commit.message.empty() && commit.message.back() == '\n') {
-        commit.message.pop_back();
-    }
+    });
+    return commit;
+}
 
+CommitObject parse_commit_content(std::string_view content) {
+    CommitView view = parse_commit_view(content);
+    CommitObject commit;
+    commit.tree_sha1 = view.tree_sha1;
+    commit.parent_sha1s = std::move(view.parent_sha1s);
+    commit.author_info = std::string(view.author_info);
+    commit.committer_info = std::string(view.committer_info);
+    commit.message = std::string(view.message);
     return commit;
 }
 
-TagObject parse_tag_content(const std::string& content) {
+TagObject parse_tag_content(std::string_view content) {
     TagObject tag;
-    std::istringstream iss(content);
-    std::string line;
-    bool in_message = false;
-
-     while (std::getline(iss, line)) {
-        if (in_message) {
-            tag.message += line + "\n";
-            continue;
-        }
-        if (line.empty()) {
-            in_message = true;
-            continue;
-        }
-
-        size_t space_pos = line.find(' ');
-        if (space_pos == std::string::npos) {
-            throw std::runtime_error("Malformed tag header line: " + line);
-        }
-        std::string key = line.substr(0, space_pos);
-        std::string value = line.substr(space_pos + 1);
-
+    std::string_view message = parse_header_lines(content, "tag", [&](std::string_view key, std::string_view value) {
         if (key == "object") {
-            tag.object_sha1 = value;
+            tag.object_sha1 = parse_header_oid(value, "tag", key);
         } else if (key == "type") {
-            tag.type = value;
+            tag.type = std::string(value);
         } else if (key == "tag") {
-            tag.tag_name = value;
+            tag.tag_name = std::string(value);
         } else if (key == "tagger") {
-            tag.tagger_info = value;
+            tag.tagger_info = std::string(value);
         }
-    }
-    if (!tag.message.empty() && tag.message.back() == '\n') {
-        tag.message.pop_back();
-    }
+    });
+    tag.message = std::string(message);
     return tag;
 }
 
 
 std::string format_tree_content(const std::vector<TreeEntry>& entries) {
     std::vector<TreeEntry> sorted_entries = entries;
-    // Use default string comparison, which works for Git tree sorting rules
-    std::sort(sorted_entries.begin(), sorted_entries.end(), [](const TreeEntry& a, const TreeEntry& b) {
-        return a.name < b.name;
+    // Git's order: a subtree sorts as "name/", so "a-b" comes before "a/"
+    // and a tree flattened depth first is in index order.
+    auto sort_key = [](const TreeEntry& entry) {
+        return (entry.mode == "40000" || entry.mode == "040000") ? entry.name + '/' : entry.name;
+    };
+    std::sort(sorted_entries.begin(), sorted_entries.end(), [&](const TreeEntry& a, const TreeEntry& b) {
+        return sort_key(a) < sort_key(b);
     });
 
     // *** LET'S USE std::ostringstream for safer binary construction ***
     std::ostringstream oss(std::ios::binary); // Ensure binary mode
 
     for (const auto& entry : sorted_entries) {
-        std::cout << "DEBUG_FORMAT_TREE: Processing entry Name=" << entry.name << " Mode=" << entry.mode << " SHA=" << entry.sha1.substr(0,7) << std::endl; // ADD DEBUG
-
         // Validate mode and name before proceeding
-        if (entry.mode.empty() || entry.name.empty() || entry.sha1.length() != 40) {
-             std::cerr << "DEBUG_FORMAT_TREE: Skipping invalid entry: Name=" << entry.name << " Mode=" << entry.mode << " SHA=" << entry.sha1 << std::endl;
-             continue; // Skip invalid entry
-        }
-
-        std::vector<unsigned char> sha1_binary;
-        try {
-             sha1_binary = hex_to_sha1(entry.sha1);
-             if (sha1_binary.size() != SHA_DIGEST_LENGTH) {
-                  throw std::runtime_error("hex_to_sha1 returned incorrect size"); // Should not happen if hex_to_sha1 is correct
-             }
-        } catch (const std::exception& e) {
-             // This would prevent the entry from being added if SHA is bad
-             std::cerr << "DEBUG_FORMAT_TREE: Error converting hex SHA for " << entry.name << ": " << e.what() << std::endl;
-             continue; // Skip entry with bad SHA
-        }
-
-
-        // Write "mode<space>name<null>"
-        oss << entry.mode << ' ' << entry.name << '\0';
-
-        // Check stream state *before* writing binary
-        if (!oss) {
-             std::cerr << "DEBUG_FORMAT_TREE: Stream error before writing binary for " << entry.name << std::endl;
-             // This indicates a problem writing the text part
+        if (entry.mode.empty() || entry.name.empty()) {
+             std::cerr << "Warning: Skipping invalid tree entry: Name=" << entry.name << " Mode=" << entry.mode << std::endl;
              continue;
         }
 
-        // Write 20-byte binary SHA
-        oss.write(reinterpret_cast<const char*>(sha1_binary.data()), sha1_binary.size());
-
-         // Check stream state *after* writing binary
-        if (!oss) {
-             std::cerr << "DEBUG_FORMAT_TREE: Stream error after writing binary for " << entry.name << std::endl;
-             // This indicates a problem writing the binary SHA
-             continue;
-        }
-         std::cout << "DEBUG_FORMAT_TREE: Wrote entry for " << entry.name << std::endl; // ADD DEBUG
+        // Write "mode<space>name<null>" followed by the 20-byte binary SHA
+        oss << entry.mode << ' ' << entry.name << '\0';
+        oss.write(reinterpret_cast<const char*>(entry.sha1.data()), ObjectId::RAW_SIZE);
     }
 
-    std::string result = oss.str();
-    std::cout << "DEBUG_FORMAT_TREE: Final content size = " << result.size() << std::endl; // ADD DEBUG
-    return result; // Return the built string
+    return oss.str();
 }
 
 
@@ -431,7 +933,7 @@ std::string format_tree_content(const std::vector<TreeEntry>& entries) {
 //     return result;
 // }
 
-std::string format_commit_content(const std::string& tree_sha1, const std::vector<std::string>& parent_sha1s,
+std::string format_commit_content(const ObjectId& tree_sha1, const std::vector<ObjectId>& parent_sha1s,
                                   const std::string& author, const std::string& committer, const std::string& message) {
     std::ostringstream oss;
     oss << "tree " << tree_sha1 << "\n";
@@ -449,7 +951,7 @@ std::string format_commit_content(const std::string& tree_sha1, const std::vecto
     return oss.str();
 }
 
-std::string format_tag_content(const std::string& object_sha1, const std::string& type, const std::string& tag_name,
+std::string format_tag_content(const ObjectId& object_sha1, const std::string& type, const std::string& tag_name,
                                const std::string& tagger, const std::string& message) {
     std::ostringstream oss;
     oss << "object " << object_sha1 << "\n";
@@ -0,0 +1,120 @@
+#include "headers/oid_table.h"
+#include "headers/objects.h"
+#include "headers/pack.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace {
+
+struct OidTable {
+    bool loaded = false;
+    std::vector<ObjectId> sorted; // Everything on disk when the table was built
+    std::vector<ObjectId> added;  // Written since, also sorted; normally tiny
+};
+
+OidTable g_oid_table;
+std::mutex g_oid_table_mutex; // add writes blobs from several threads
+
+OidTable& load_table() {
+    if (g_oid_table.loaded) return g_oid_table;
+    g_oid_table.loaded = true;
+
+    std::vector<ObjectId>& ids = g_oid_table.sorted;
+    for (const auto& pack : get_packs()) {
+        std::vector<ObjectId> packed = list_packed_objects(pack);
+        ids.insert(ids.end(), packed.begin(), packed.end());
+    }
+    std::vector<ObjectId> loose = list_loose_objects();
+    ids.insert(ids.end(), loose.begin(), loose.end());
+
+    // An object can be both packed and loose.
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return g_oid_table;
+}
+
+int nibble_at(const ObjectId& id, size_t i) {
+    unsigned char b = id.bytes[i / 2];
+    return (i % 2 == 0) ? (b >> 4) : (b & 0x0f);
+}
+
+bool has_hex_prefix(const ObjectId& id, std::string_view prefix) {
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        if (hex_digit_value(prefix[i]) != nibble_at(id, i)) return false;
+    }
+    return true;
+}
+
+// Number of leading hex digits two names share.
+size_t common_hex_digits(const ObjectId& a, const ObjectId& b) {
+    for (size_t i = 0; i < ObjectId::RAW_SIZE; ++i) {
+        if (a.bytes[i] != b.bytes[i]) {
+            return 2 * i + (((a.bytes[i] ^ b.bytes[i]) & 0xf0) ? 0 : 1);
+        }
+    }
+    return ObjectId::HEX_SIZE;
+}
+
+void collect_matches(const std::vector<ObjectId>& ids, const ObjectId& lower, std::string_view prefix,
+                     std::vector<ObjectId>& out) {
+    for (auto it = std::lower_bound(ids.begin(), ids.end(), lower); it != ids.end() && has_hex_prefix(*it, prefix); ++it) {
+        out.push_back(*it);
+    }
+}
+
+// Digits needed to tell `id` apart from its neighbours in `ids`.
+size_t digits_to_disambiguate(const std::vector<ObjectId>& ids, const ObjectId& id) {
+    size_t needed = 0;
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.begin()) needed = std::max(needed, common_hex_digits(*(it - 1), id) + 1);
+    if (it != ids.end() && *it == id) ++it;
+    if (it != ids.end()) needed = std::max(needed, common_hex_digits(*it, id) + 1);
+    return needed;
+}
+
+} // namespace
+
+std::vector<ObjectId> find_objects_by_prefix(std::string_view hex_prefix) {
+    std::vector<ObjectId> matches;
+    if (hex_prefix.size() > ObjectId::HEX_SIZE) return matches;
+
+    // Smallest name with this prefix: the prefix padded with zero digits.
+    ObjectId lower;
+    for (size_t i = 0; i < hex_prefix.size(); ++i) {
+        int v = hex_digit_value(hex_prefix[i]);
+        if (v < 0) return matches;
+        lower.bytes[i / 2] |= static_cast<unsigned char>((i % 2 == 0) ? (v << 4) : v);
+    }
+
+    std::lock_guard<std::mutex> lock(g_oid_table_mutex);
+    OidTable& table = load_table();
+    collect_matches(table.sorted, lower, hex_prefix, matches);
+    if (!table.added.empty()) {
+        collect_matches(table.added, lower, hex_prefix, matches);
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    }
+    return matches;
+}
+
+std::string find_unique_abbrev(const ObjectId& id, size_t min_len) {
+    std::lock_guard<std::mutex> lock(g_oid_table_mutex);
+    OidTable& table = load_table();
+    size_t len = std::max(digits_to_disambiguate(table.sorted, id), digits_to_disambiguate(table.added, id));
+    len = std::max(len, min_len);
+    return id.hex().substr(0, std::min(len, ObjectId::HEX_SIZE));
+}
+
+void note_new_object(const ObjectId& id) {
+    std::lock_guard<std::mutex> lock(g_oid_table_mutex);
+    if (!g_oid_table.loaded) return; // Picked up from disk when the table is built
+    if (std::binary_search(g_oid_table.sorted.begin(), g_oid_table.sorted.end(), id)) return;
+    auto it = std::lower_bound(g_oid_table.added.begin(), g_oid_table.added.end(), id);
+    if (it == g_oid_table.added.end() || *it != id) g_oid_table.added.insert(it, id);
+}
+
+void reset_oid_table() {
+    std::lock_guard<std::mutex> lock(g_oid_table_mutex);
+    g_oid_table = OidTable();
+}
@@ -0,0 +1,763 @@
+#include "headers/pack.h"
+#include "headers/objects.h"
+#include "headers/utils.h"
+#include "headers/delta.h"
+#include "headers/oid_table.h"
+#include "headers/hash.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <deque>
+#include <cctype>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <openssl/sha.h>
+#include <zlib.h>
+
+namespace {
+
+const unsigned char IDX_MAGIC[4] = {0xff, 't', 'O', 'c'};
+const uint32_t IDX_VERSION = 2;
+const uint32_t PACK_VERSION = 2;
+const size_t IDX_HEADER_SIZE = 8 + 256 * 4;
+
+uint32_t get_be32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void put_be32(std::string& out, uint32_t v) {
+    out.push_back(static_cast<char>(v >> 24));
+    out.push_back(static_cast<char>(v >> 16));
+    out.push_back(static_cast<char>(v >> 8));
+    out.push_back(static_cast<char>(v));
+}
+
+std::string pack_type_name(int type) {
+    switch (type) {
+        case static_cast<int>(PackObjectType::Commit): return "commit";
+        case static_cast<int>(PackObjectType::Tree): return "tree";
+        case static_cast<int>(PackObjectType::Blob): return "blob";
+        case static_cast<int>(PackObjectType::Tag): return "tag";
+    }
+    throw std::runtime_error("Unknown pack object type " + std::to_string(type));
+}
+
+PackObjectType pack_type_code(const std::string& type) {
+    if (type == "commit") return PackObjectType::Commit;
+    if (type == "tree") return PackObjectType::Tree;
+    if (type == "blob") return PackObjectType::Blob;
+    if (type == "tag") return PackObjectType::Tag;
+    throw std::runtime_error("Cannot pack object of unknown type '" + type + "'");
+}
+
+const unsigned char* idx_fanout(const PackFile& pack) {
+    return pack.idx_map.data() + 8;
+}
+
+const unsigned char* idx_sha_at(const PackFile& pack, uint32_t i) {
+    return pack.idx_map.data() + IDX_HEADER_SIZE + size_t(i) * SHA_DIGEST_LENGTH;
+}
+
+uint64_t idx_offset_at(const PackFile& pack, uint32_t i) {
+    size_t n = pack.object_count;
+    const unsigned char* offsets = pack.idx_map.data() + IDX_HEADER_SIZE + n * (SHA_DIGEST_LENGTH + 4);
+    uint32_t off = get_be32(offsets + size_t(i) * 4);
+    if (!(off & 0x80000000u)) return off;
+
+    const unsigned char* large = offsets + n * 4 + size_t(off & 0x7fffffffu) * 8;
+    return (uint64_t(get_be32(large)) << 32) | get_be32(large + 4);
+}
+
+// Binary search of one pack's name table, narrowed by the fanout entry for the first byte.
+bool idx_find(const PackFile& pack, const unsigned char* sha1, uint32_t& pos) {
+    const unsigned char* fanout = idx_fanout(pack);
+    uint32_t lo = sha1[0] == 0 ? 0 : get_be32(fanout + (sha1[0] - 1) * 4);
+    uint32_t hi = get_be32(fanout + sha1[0] * 4);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(idx_sha_at(pack, mid), sha1, SHA_DIGEST_LENGTH);
+        if (cmp == 0) { pos = mid; return true; }
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return false;
+}
+
+void load_pack_index(const fs::path& idx_path, PackFile& pack) {
+    pack.idx_path = idx_path.string();
+    pack.pack_path = fs::path(idx_path).replace_extension(".pack").string();
+    pack.idx_map = MappedFile(pack.idx_path);
+
+    const MappedFile& idx = pack.idx_map;
+    if (idx.size() < IDX_HEADER_SIZE + 2 * SHA_DIGEST_LENGTH ||
+        std::memcmp(idx.data(), IDX_MAGIC, 4) != 0 || get_be32(idx.data() + 4) != IDX_VERSION) {
+        throw std::runtime_error("Unsupported or corrupt pack index: " + pack.idx_path);
+    }
+    pack.object_count = get_be32(idx_fanout(pack) + 255 * 4);
+    size_t min_size = IDX_HEADER_SIZE + size_t(pack.object_count) * (SHA_DIGEST_LENGTH + 8) + 2 * SHA_DIGEST_LENGTH;
+    if (idx.size() < min_size) {
+        throw std::runtime_error("Truncated pack index: " + pack.idx_path);
+    }
+    pack.checksum_hex = sha1_to_hex(idx.data() + idx.size() - 2 * SHA_DIGEST_LENGTH);
+    pack.pack_size = fs::file_size(pack.pack_path);
+}
+
+// Guards the lazily loaded pack list and each pack's lazy mapping, so packed
+// objects can be read from several threads.
+std::mutex g_pack_mutex;
+
+// The whole pack is mapped once; entries are then inflated straight out of the
+// mapping without an intermediate read buffer. The sorted offsets needed by
+// entry_end are built at the same time.
+void ensure_pack_mapped(PackFile& pack) {
+    std::lock_guard<std::mutex> lock(g_pack_mutex);
+    if (!pack.pack_map.empty()) return;
+    MappedFile map(pack.pack_path);
+    if (map.size() != pack.pack_size || pack.pack_size < 12 + SHA_DIGEST_LENGTH) {
+        throw std::runtime_error("Pack file changed size or is truncated: " + pack.pack_path);
+    }
+    pack.sorted_offsets.reserve(pack.object_count);
+    for (uint32_t i = 0; i < pack.object_count; ++i) {
+        pack.sorted_offsets.push_back(idx_offset_at(pack, i));
+    }
+    std::sort(pack.sorted_offsets.begin(), pack.sorted_offsets.end());
+    pack.pack_map = std::move(map);
+}
+
+// Each entry runs up to the next entry's offset (or the trailing checksum),
+// so the whole compressed entry is known before inflating it.
+uint64_t entry_end(const PackFile& pack, uint64_t offset) {
+    auto it = std::upper_bound(pack.sorted_offsets.begin(), pack.sorted_offsets.end(), offset);
+    return it == pack.sorted_offsets.end() ? pack.pack_size - SHA_DIGEST_LENGTH : *it;
+}
+
+size_t parse_entry_header(const unsigned char* data, size_t len, int& type, uint64_t& size) {
+    size_t pos = 0;
+    if (len == 0) throw std::runtime_error("Empty pack entry");
+    unsigned char c = data[pos++];
+    type = (c >> 4) & 7;
+    size = c & 15;
+    int shift = 4;
+    while (c & 0x80) {
+        if (pos >= len || shift > 57) throw std::runtime_error("Malformed pack entry header");
+        c = data[pos++];
+        size |= uint64_t(c & 0x7f) << shift;
+        shift += 7;
+    }
+    return pos;
+}
+
+// Delta bases recently rebuilt while reading, keyed by pack and entry offset,
+// so objects sharing a chain do not rebuild it from the start each time.
+const size_t DELTA_BASE_CACHE_LIMIT = 32u << 20;
+const int MAX_DELTA_CHAIN = 10000;
+
+struct DeltaBaseCache {
+    using Key = std::pair<const PackFile*, uint64_t>;
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return std::hash<const void*>()(k.first) ^ std::hash<uint64_t>()(k.second * 0x9e3779b97f4a7c15ull);
+        }
+    };
+    struct Entry {
+        Key key;
+        std::shared_ptr<const RawObject> object;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> lru; // Most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map;
+    size_t bytes = 0;
+
+    std::shared_ptr<const RawObject> get(const PackFile* pack, uint64_t offset) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = map.find(Key(pack, offset));
+        if (it == map.end()) return nullptr;
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->object;
+    }
+
+    void put(const PackFile* pack, uint64_t offset, std::shared_ptr<const RawObject> object) {
+        size_t size = object->content.size();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size > DELTA_BASE_CACHE_LIMIT / 4 || map.count(Key(pack, offset))) return;
+        lru.push_front(Entry{Key(pack, offset), std::move(object)});
+        map[lru.front().key] = lru.begin();
+        bytes += size;
+        while (bytes > DELTA_BASE_CACHE_LIMIT) {
+            bytes -= lru.back().object->content.size();
+            map.erase(lru.back().key);
+            lru.pop_back();
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        map.clear();
+        lru.clear();
+        bytes = 0;
+    }
+};
+
+DeltaBaseCache g_delta_base_cache;
+
+// One undecoded pack entry: header fields plus the still-compressed payload,
+// which points into the pack mapping.
+struct PackEntry {
+    int type = 0;
+    uint64_t size = 0;
+    uint64_t base_offset = 0;                     // OFS_DELTA only
+    ObjectId base_id;                             // REF_DELTA only
+    const unsigned char* data = nullptr;
+    size_t data_len = 0;
+};
+
+void read_entry_at(PackFile& pack, uint64_t offset, PackEntry& entry) {
+    ensure_pack_mapped(pack);
+    uint64_t end = entry_end(pack, offset);
+    if (end <= offset || end > pack.pack_size) {
+        throw std::runtime_error("Invalid pack entry offset " + std::to_string(offset) + " in " + pack.pack_path);
+    }
+
+    const unsigned char* data = pack.pack_map.data() + offset;
+    size_t len = static_cast<size_t>(end - offset);
+    size_t pos = parse_entry_header(data, len, entry.type, entry.size);
+
+    if (entry.type == static_cast<int>(PackObjectType::OfsDelta)) {
+        // Same big-endian varint as Git, with an implicit +1 per continuation byte.
+        if (pos >= len) throw std::runtime_error("Truncated OFS_DELTA entry");
+        unsigned char c = data[pos++];
+        uint64_t distance = c & 0x7f;
+        while (c & 0x80) {
+            if (pos >= len || distance > (UINT64_MAX >> 8)) throw std::runtime_error("Malformed OFS_DELTA offset");
+            c = data[pos++];
+            distance = ((distance + 1) << 7) | (c & 0x7f);
+        }
+        if (distance == 0 || distance > offset) {
+            throw std::runtime_error("OFS_DELTA base out of range at offset " + std::to_string(offset));
+        }
+        entry.base_offset = offset - distance;
+    } else if (entry.type == static_cast<int>(PackObjectType::RefDelta)) {
+        if (len - pos < SHA_DIGEST_LENGTH) throw std::runtime_error("Truncated REF_DELTA entry");
+        entry.base_id = ObjectId::from_raw(data + pos);
+        pos += SHA_DIGEST_LENGTH;
+    }
+    entry.data = data + pos;
+    entry.data_len = len - pos;
+}
+
+std::string inflate_entry(const PackEntry& entry) {
+    return decompress_exact(entry.data, entry.data_len, static_cast<size_t>(entry.size));
+}
+
+// Walks the delta chain down to a full object (or a cached base), then applies
+// the deltas back up. Every intermediate base is offered to the cache.
+void read_pack_entry(PackFile& pack, uint64_t offset, RawObject& out) {
+    struct PendingDelta {
+        uint64_t offset;
+        std::string delta;
+    };
+    std::vector<PendingDelta> chain;
+    std::shared_ptr<const RawObject> base;
+
+    PackFile* current_pack = &pack;
+    uint64_t current = offset;
+    PackEntry entry;
+    while (true) {
+        if (!chain.empty()) {
+            base = g_delta_base_cache.get(current_pack, current);
+            if (base) break;
+        }
+        read_entry_at(*current_pack, current, entry);
+        if (entry.type != static_cast<int>(PackObjectType::OfsDelta) &&
+            entry.type != static_cast<int>(PackObjectType::RefDelta)) {
+            auto object = std::make_shared<RawObject>();
+            object->type = pack_type_name(entry.type);
+            object->content = inflate_entry(entry);
+            if (chain.empty()) {
+                out = std::move(*object);
+                return;
+            }
+            g_delta_base_cache.put(current_pack, current, object);
+            base = std::move(object);
+            break;
+        }
+
+        if (chain.size() >= MAX_DELTA_CHAIN) {
+            throw std::runtime_error("Delta chain too long in " + current_pack->pack_path);
+        }
+        chain.push_back(PendingDelta{current, inflate_entry(entry)});
+
+        if (entry.type == static_cast<int>(PackObjectType::OfsDelta)) {
+            current = entry.base_offset;
+            continue;
+        }
+        uint32_t pos;
+        if (idx_find(*current_pack, entry.base_id.data(), pos)) {
+            current = idx_offset_at(*current_pack, pos);
+            continue;
+        }
+        // Thin-pack style base living in another pack or as a loose object.
+        base = std::make_shared<RawObject>(read_raw_object(entry.base_id));
+        break;
+    }
+
+    for (size_t i = chain.size(); i-- > 0;) {
+        auto object = std::make_shared<RawObject>();
+        object->type = base->type;
+        const std::string& delta = chain[i].delta;
+        object->content = apply_delta(base->content, reinterpret_cast<const unsigned char*>(delta.data()), delta.size());
+        if (i == 0) {
+            out = std::move(*object);
+            return;
+        }
+        g_delta_base_cache.put(current_pack, chain[i].offset, object);
+        base = std::move(object);
+    }
+}
+
+// Result size of a delta entry: the second varint of the delta header, so only
+// its first few bytes are inflated.
+uint64_t delta_result_size(const PackEntry& entry) {
+    unsigned char head[20]; // Two varints of at most 10 bytes each
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) throw std::runtime_error("inflateInit failed for delta header");
+    zs.next_in = const_cast<Bytef*>(entry.data);
+    zs.avail_in = static_cast<uInt>(std::min<size_t>(entry.data_len, UINT32_MAX));
+    zs.next_out = head;
+    zs.avail_out = sizeof(head);
+    int ret = Z_OK;
+    while (zs.avail_out > 0 && ret == Z_OK) ret = inflate(&zs, Z_SYNC_FLUSH);
+    size_t have = sizeof(head) - zs.avail_out;
+    inflateEnd(&zs);
+
+    size_t pos = 0;
+    uint64_t value = 0;
+    for (int field = 0; field < 2; ++field) {
+        value = 0;
+        int shift = 0;
+        unsigned char c;
+        do {
+            if (pos >= have || shift > 63) throw std::runtime_error("Truncated delta header");
+            c = head[pos++];
+            value |= uint64_t(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+    }
+    return value;
+}
+
+// Type and size of the object at `offset` without rebuilding it: the size
+// comes from the entry itself (or its delta header), the type from the end
+// of the delta chain.
+void read_pack_entry_header(PackFile& pack, uint64_t offset, ObjectHeader& out) {
+    PackFile* current_pack = &pack;
+    uint64_t current = offset;
+    PackEntry entry;
+    bool have_size = false;
+    for (int depth = 0;; ++depth) {
+        if (depth > MAX_DELTA_CHAIN) {
+            throw std::runtime_error("Delta chain too long in " + current_pack->pack_path);
+        }
+        read_entry_at(*current_pack, current, entry);
+        if (entry.type != static_cast<int>(PackObjectType::OfsDelta) &&
+            entry.type != static_cast<int>(PackObjectType::RefDelta)) {
+            out.type = pack_type_name(entry.type);
+            if (!have_size) out.size = static_cast<size_t>(entry.size);
+            return;
+        }
+        if (!have_size) {
+            out.size = static_cast<size_t>(delta_result_size(entry));
+            have_size = true;
+        }
+
+        if (entry.type == static_cast<int>(PackObjectType::OfsDelta)) {
+            current = entry.base_offset;
+            continue;
+        }
+        uint32_t pos;
+        if (idx_find(*current_pack, entry.base_id.data(), pos)) {
+            current = idx_offset_at(*current_pack, pos);
+            continue;
+        }
+        out.type = read_object_header(entry.base_id).type;
+        return;
+    }
+}
+
+void encode_entry_header(std::string& out, PackObjectType type, uint64_t size) {
+    unsigned char c = static_cast<unsigned char>((static_cast<int>(type) << 4) | (size & 15));
+    size >>= 4;
+    while (size) {
+        out.push_back(static_cast<char>(c | 0x80));
+        c = size & 0x7f;
+        size >>= 7;
+    }
+    out.push_back(static_cast<char>(c));
+}
+
+// Buffers pack output, hashing everything written so the trailer can be appended.
+struct PackWriter {
+    int fd = -1;
+    std::string path;
+    uint64_t offset = 0;
+    std::string buffer;
+    Sha1Context sha;
+
+    PackWriter(int fd_in, std::string path_in) : fd(fd_in), path(std::move(path_in)) {}
+
+    void write(const std::string& data) {
+        sha.update(data);
+        buffer += data;
+        offset += data.size();
+        if (buffer.size() >= (1u << 20)) flush();
+    }
+
+    void flush() {
+        size_t done = 0;
+        while (done < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+            if (n <= 0) throw std::runtime_error("Failed to write pack file: " + path);
+            done += static_cast<size_t>(n);
+        }
+        buffer.clear();
+    }
+
+    void finish(unsigned char checksum[SHA_DIGEST_LENGTH]) {
+        ObjectId digest = sha.finish();
+        std::memcpy(checksum, digest.data(), SHA_DIGEST_LENGTH);
+        buffer.append(reinterpret_cast<const char*>(checksum), SHA_DIGEST_LENGTH);
+        flush();
+    }
+};
+
+struct WrittenEntry {
+    ObjectId id;
+    uint64_t offset;
+    uint32_t crc;
+};
+
+std::string build_index(std::vector<WrittenEntry>& entries, const unsigned char pack_checksum[SHA_DIGEST_LENGTH]) {
+    std::sort(entries.begin(), entries.end(), [](const WrittenEntry& a, const WrittenEntry& b) {
+        return a.id < b.id;
+    });
+
+    std::string idx;
+    idx.append(reinterpret_cast<const char*>(IDX_MAGIC), 4);
+    put_be32(idx, IDX_VERSION);
+
+    uint32_t fanout[256] = {0};
+    for (const auto& e : entries) fanout[e.id.bytes[0]]++;
+    uint32_t running = 0;
+    for (int i = 0; i < 256; ++i) {
+        running += fanout[i];
+        put_be32(idx, running);
+    }
+    for (const auto& e : entries) idx.append(reinterpret_cast<const char*>(e.id.data()), ObjectId::RAW_SIZE);
+    for (const auto& e : entries) put_be32(idx, e.crc);
+
+    std::string large_offsets;
+    uint32_t large_count = 0;
+    for (const auto& e : entries) {
+        if (e.offset < 0x80000000ull) {
+            put_be32(idx, static_cast<uint32_t>(e.offset));
+        } else {
+            put_be32(idx, 0x80000000u | large_count++);
+            put_be32(large_offsets, static_cast<uint32_t>(e.offset >> 32));
+            put_be32(large_offsets, static_cast<uint32_t>(e.offset));
+        }
+    }
+    idx += large_offsets;
+    idx.append(reinterpret_cast<const char*>(pack_checksum), SHA_DIGEST_LENGTH);
+
+    ObjectId idx_checksum = sha1_of(idx);
+    idx.append(reinterpret_cast<const char*>(idx_checksum.data()), SHA_DIGEST_LENGTH);
+    return idx;
+}
+
+// Objects smaller than this are not worth a delta (the instruction
+// overhead eats most of the saving).
+const size_t MIN_DELTA_TARGET = 50;
+
+// Git's pack_name_hash: weighted towards the last characters, so files with
+// the same name (or extension) in different directories sort next to each other.
+uint32_t pack_name_hash(const std::string& path) {
+    uint32_t hash = 0;
+    for (unsigned char c : path) {
+        if (std::isspace(c)) continue;
+        hash = (hash >> 2) + (uint32_t(c) << 24);
+    }
+    return hash;
+}
+
+void encode_ofs_distance(std::string& out, uint64_t distance) {
+    unsigned char buf[10];
+    size_t pos = sizeof(buf) - 1;
+    buf[pos] = distance & 0x7f;
+    while (distance >>= 7) {
+        buf[--pos] = static_cast<unsigned char>(0x80 | (--distance & 0x7f));
+    }
+    out.append(reinterpret_cast<const char*>(buf + pos), sizeof(buf) - pos);
+}
+
+struct PackCandidate {
+    ObjectId id;
+    PackObjectType type;
+    size_t size = 0;
+    uint32_t name_hash = 0;
+    size_t order = 0;
+};
+
+// A recently written object kept around as a possible delta base.
+struct WindowSlot {
+    PackObjectType type;
+    uint64_t offset = 0;
+    int depth = 0;
+    std::shared_ptr<const std::string> content;
+    mutable std::unique_ptr<DeltaIndex> index; // Built on first use as a base
+};
+
+std::vector<PackFile> g_packs;
+bool g_packs_loaded = false;
+
+void close_packs() {
+    g_delta_base_cache.clear();
+    g_packs.clear(); // Unmaps every pack and index
+}
+
+} // namespace
+
+std::vector<PackFile>& get_packs() {
+    std::lock_guard<std::mutex> lock(g_pack_mutex);
+    if (g_packs_loaded) return g_packs;
+    g_packs_loaded = true;
+
+    if (!fs::is_directory(PACK_DIR)) return g_packs;
+    std::vector<fs::path> idx_files;
+    for (const auto& entry : fs::directory_iterator(PACK_DIR)) {
+        if (entry.path().extension() == ".idx") idx_files.push_back(entry.path());
+    }
+    std::sort(idx_files.begin(), idx_files.end());
+
+    for (const auto& idx_path : idx_files) {
+        PackFile pack;
+        try {
+            load_pack_index(idx_path, pack);
+            g_packs.push_back(std::move(pack));
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Ignoring pack " << idx_path.filename().string() << ": " << e.what() << std::endl;
+        }
+    }
+    return g_packs;
+}
+
+void reload_packs() {
+    {
+        std::lock_guard<std::mutex> lock(g_pack_mutex);
+        close_packs();
+        g_packs_loaded = false;
+    }
+    reset_oid_table();
+}
+
+bool pack_has_object(const ObjectId& id) {
+    uint32_t pos;
+    for (const auto& pack : get_packs()) {
+        if (idx_find(pack, id.data(), pos)) return true;
+    }
+    return false;
+}
+
+bool read_packed_object(const ObjectId& id, RawObject& out) {
+    uint32_t pos;
+    for (auto& pack : get_packs()) {
+        if (idx_find(pack, id.data(), pos)) {
+            try {
+                read_pack_entry(pack, idx_offset_at(pack, pos), out);
+            } catch (const std::exception& e) {
+                throw std::runtime_error("Failed to read packed object " + id.hex() + ": " + e.what());
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool read_packed_object_header(const ObjectId& id, ObjectHeader& out) {
+    uint32_t pos;
+    for (auto& pack : get_packs()) {
+        if (idx_find(pack, id.data(), pos)) {
+            try {
+                read_pack_entry_header(pack, idx_offset_at(pack, pos), out);
+            } catch (const std::exception& e) {
+                throw std::runtime_error("Failed to read packed object " + id.hex() + ": " + e.what());
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<ObjectId> list_packed_objects(const PackFile& pack) {
+    std::vector<ObjectId> names;
+    names.reserve(pack.object_count);
+    for (uint32_t i = 0; i < pack.object_count; ++i) {
+        names.push_back(ObjectId::from_raw(idx_sha_at(pack, i)));
+    }
+    return names;
+}
+
+std::string write_pack(const std::vector<PackInput>& objects, const PackOptions& options, PackStats* stats) {
+    // Pass 1: dedupe and collect what the delta search sorts on. Only the
+    // headers are read here; pass 2 reads each object in full once.
+    std::vector<PackCandidate> candidates;
+    std::unordered_set<ObjectId> seen;
+    for (const auto& input : objects) {
+        if (!seen.insert(input.sha1).second) continue;
+        PackCandidate candidate;
+        ObjectHeader header = read_object_header(input.sha1);
+        candidate.id = input.sha1;
+        candidate.type = pack_type_code(header.type);
+        candidate.size = header.size;
+        candidate.name_hash = pack_name_hash(input.path);
+        candidate.order = candidates.size();
+        candidates.push_back(std::move(candidate));
+    }
+
+    // Like Git: group by type, then by file name, largest first. Deltas then
+    // tend to remove data, and every base is written before its deltas.
+    std::sort(candidates.begin(), candidates.end(), [](const PackCandidate& a, const PackCandidate& b) {
+        if (a.type != b.type) return a.type < b.type;
+        if (a.name_hash != b.name_hash) return a.name_hash < b.name_hash;
+        if (a.size != b.size) return a.size > b.size;
+        return a.order < b.order;
+    });
+
+    ensure_directory_exists(PACK_DIR);
+    std::string tmp_template = PACK_DIR + "/tmp_pack_XXXXXX";
+    int fd = mkstemp(&tmp_template[0]);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create temporary pack file in " + PACK_DIR);
+    }
+    std::string tmp_pack_path = tmp_template;
+
+    std::vector<WrittenEntry> written;
+    unsigned char pack_checksum[SHA_DIGEST_LENGTH];
+    size_t delta_count = 0;
+    try {
+        PackWriter writer(fd, tmp_pack_path);
+        std::string header = "PACK";
+        put_be32(header, PACK_VERSION);
+        put_be32(header, static_cast<uint32_t>(candidates.size()));
+        writer.write(header);
+
+        // Pass 2: each object is tried against the previous `window` objects
+        // of the same type, and written right away (as a delta or in full).
+        size_t window_size = static_cast<size_t>(std::max(options.window, 0));
+        std::deque<WindowSlot> window;
+        for (const auto& candidate : candidates) {
+            RawObject raw = read_raw_object(candidate.id);
+            if (raw.content.size() != candidate.size) {
+                throw std::runtime_error("Object " + candidate.id.hex() + " changed while packing");
+            }
+
+            const WindowSlot* best_base = nullptr;
+            std::string best_delta;
+            if (raw.content.size() >= MIN_DELTA_TARGET) {
+                size_t max_size = raw.content.size() / 2 - 20;
+                for (auto it = window.rbegin(); it != window.rend(); ++it) {
+                    const WindowSlot& slot = *it;
+                    if (slot.type != candidate.type) break; // Sorted by type, nothing further back matches
+                    if (slot.depth >= options.depth) continue;
+                    size_t src_size = slot.content->size();
+                    // Hopeless when the sizes alone differ by more than the budget.
+                    if (src_size < raw.content.size() / 32) continue;
+                    if (src_size > raw.content.size() && src_size - raw.content.size() > max_size) continue;
+                    if (src_size < raw.content.size() && raw.content.size() - src_size > max_size) continue;
+
+                    if (!slot.index) slot.index.reset(new DeltaIndex(create_delta_index(*slot.content)));
+                    std::string delta;
+                    if (create_delta(*slot.index, raw.content, max_size, delta)) {
+                        max_size = delta.size() - 1;
+                        best_delta.swap(delta);
+                        best_base = &slot;
+                    }
+                }
+            }
+
+            WrittenEntry entry;
+            entry.id = candidate.id;
+            entry.offset = writer.offset;
+
+            std::string data;
+            int depth = 0;
+            if (best_base) {
+                encode_entry_header(data, PackObjectType::OfsDelta, best_delta.size());
+                encode_ofs_distance(data, entry.offset - best_base->offset);
+                std::vector<unsigned char> compressed = compress_data(best_delta);
+                data.append(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+                depth = best_base->depth + 1;
+                ++delta_count;
+            } else {
+                encode_entry_header(data, candidate.type, raw.content.size());
+                std::vector<unsigned char> compressed = compress_data(raw.content);
+                data.append(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+            }
+
+            entry.crc = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(data.data()), data.size()));
+            writer.write(data);
+            written.push_back(entry);
+
+            if (window_size > 0) {
+                if (window.size() == window_size) window.pop_front();
+                WindowSlot slot;
+                slot.type = candidate.type;
+                slot.offset = entry.offset;
+                slot.depth = depth;
+                slot.content = std::make_shared<std::string>(std::move(raw.content));
+                window.push_back(std::move(slot));
+            }
+        }
+        writer.finish(pack_checksum);
+        fchmod(fd, 0444);
+        close(fd);
+        fd = -1;
+    } catch (...) {
+        if (fd >= 0) close(fd);
+        fs::remove(tmp_pack_path);
+        throw;
+    }
+
+    if (stats) {
+        stats->total = written.size();
+        stats->deltas = delta_count;
+    }
+
+    std::string checksum_hex = sha1_to_hex(pack_checksum);
+    std::string base = PACK_DIR + "/pack-" + checksum_hex;
+    std::string idx_data = build_index(written, pack_checksum);
+
+    // The .idx is what makes a pack visible, so it is moved into place last.
+    std::string tmp_idx_path = tmp_pack_path + ".idx";
+    try {
+        write_file(tmp_idx_path, idx_data);
+        fs::rename(tmp_pack_path, base + ".pack");
+        fs::rename(tmp_idx_path, base + ".idx");
+    } catch (...) {
+        fs::remove(tmp_pack_path);
+        fs::remove(tmp_idx_path);
+        throw;
+    }
+
+    reload_packs();
+    return checksum_hex;
+}
@@ -0,0 +1,49 @@
+#include "headers/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+unsigned resolve_thread_count(int requested) {
+    if (requested > 0) return static_cast<unsigned>(requested);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallel_for(size_t count, unsigned threads, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+    size_t workers = std::min<size_t>(std::max(1u, threads), count);
+    if (workers == 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+
+    auto work = [&]() {
+        while (!failed.load(std::memory_order_relaxed)) {
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= count) return;
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!first_error) first_error = std::current_exception();
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (size_t t = 1; t < workers; ++t) pool.emplace_back(work);
+    work();
+    for (auto& thread : pool) thread.join();
+
+    if (first_error) std::rethrow_exception(first_error);
+}
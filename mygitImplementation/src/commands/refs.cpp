@@ -133,9 +133,10 @@ std::optional<std::string> resolve_ref(const std::string& ref_or_sha_prefix) {
                 }
                 if (sha1.length() == 40 && sha1.find_first_not_of("0123456789abcdef") == std::string::npos) {
                     try {
+                        // Lightweight tags point straight at the commit; only tag objects need parsing.
+                        if (read_object_header(sha1).type != "tag") return sha1;
                         ParsedObject obj = read_object(sha1);
-                        if (obj.type == "tag") return std::get<TagObject>(obj.data).object_sha1;
-                        else return sha1;
+                        return std::get<TagObject>(obj.data).object_sha1.hex();
                     } catch (const std::exception& e) {
                         std::cerr << "Warning: Failed to read object for tag ref '" << tag_ref_path << "': " << e.what() << std::endl;
                         return std::nullopt;
@@ -162,6 +163,13 @@ std::optional<std::string> resolve_ref(const std::string& ref_or_sha_prefix) {
     return std::nullopt;
 }
 
+std::optional<ObjectId> resolve_ref_id(const std::string& ref_or_sha_prefix) {
+    std::optional<std::string> sha1 = resolve_ref(ref_or_sha_prefix);
+    ObjectId id;
+    if (!sha1 || !ObjectId::try_from_hex(*sha1, id)) return std::nullopt;
+    return id;
+}
+
 std::string read_head() {
     return read_ref_direct("HEAD");
 }
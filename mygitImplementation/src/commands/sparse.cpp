@@ -0,0 +1,177 @@
+#include "headers/sparse.h"
+#include "headers/config.h"
+#include "headers/index.h"
+#include "headers/utils.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::string sparse_checkout_path() {
+    return GIT_DIR + "/info/sparse-checkout";
+}
+
+// "/a//b/" -> "a/b"; empty for the top.
+std::string normalize_dir(std::string_view dir) {
+    std::string result;
+    size_t pos = 0;
+    while (pos < dir.size()) {
+        size_t slash = dir.find('/', pos);
+        if (slash == std::string_view::npos) slash = dir.size();
+        std::string_view part = dir.substr(pos, slash - pos);
+        pos = slash + 1;
+        if (part.empty() || part == ".") continue;
+        if (part == "..") throw std::runtime_error("'" + std::string(dir) + "' is outside the repository");
+        if (!result.empty()) result.push_back('/');
+        result.append(part);
+    }
+    return result;
+}
+
+bool parse_bool_value_or(const std::string& value, bool fallback) {
+    try {
+        return parse_bool_value(value);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << std::endl;
+        return fallback;
+    }
+}
+
+} // namespace
+
+SparseCone::SparseCone(const std::vector<std::string>& dirs) {
+    for (const std::string& dir : dirs) add(normalize_dir(dir));
+}
+
+void SparseCone::add(std::string dir) {
+    if (dir.empty()) return; // The top's own files are always in
+    for (size_t slash = dir.find('/'); slash != std::string::npos; slash = dir.find('/', slash + 1)) {
+        if (recursive_.count(std::string_view(dir).substr(0, slash))) return; // Already covered
+    }
+    // Directories below the new one are now covered by it.
+    std::string prefix = dir + "/";
+    for (auto it = recursive_.lower_bound(prefix); it != recursive_.end() && it->compare(0, prefix.size(), prefix) == 0;) {
+        it = recursive_.erase(it);
+    }
+    recursive_.insert(dir);
+    parents_.clear();
+    for (const std::string& listed : recursive_) {
+        for (size_t slash = listed.find('/'); slash != std::string::npos; slash = listed.find('/', slash + 1)) {
+            parents_.insert(listed.substr(0, slash));
+        }
+    }
+}
+
+SparseCone SparseCone::parse(std::string_view content) {
+    std::vector<std::string> listed;
+    std::set<std::string, std::less<>> parents;
+    std::istringstream in{std::string(content)};
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#' || line == "/*" || line == "!/*/") continue;
+        bool parent = line.size() > 5 && line.compare(0, 2, "!/") == 0 && line.compare(line.size() - 3, 3, "/*/") == 0;
+        bool dir = line.size() > 2 && line[0] == '/' && line.back() == '/' && line.find('*') == std::string::npos;
+        if (parent) {
+            parents.insert(normalize_dir(line.substr(2, line.size() - 5)));
+        } else if (dir) {
+            listed.push_back(normalize_dir(line.substr(1, line.size() - 2)));
+        } else {
+            throw std::runtime_error("'" + line + "' is not a cone pattern");
+        }
+    }
+    SparseCone cone;
+    for (std::string& dir : listed) {
+        if (!parents.count(dir)) cone.add(std::move(dir));
+    }
+    return cone;
+}
+
+std::string SparseCone::format() const {
+    std::set<std::string, std::less<>> all = parents_;
+    all.insert(recursive_.begin(), recursive_.end());
+    std::string out = "/*\n!/*/\n";
+    for (const std::string& dir : all) {
+        out += "/" + dir + "/\n";
+        if (parents_.count(dir)) out += "!/" + dir + "/*/\n";
+    }
+    return out;
+}
+
+bool SparseCone::includes(std::string_view path) const {
+    size_t last = path.rfind('/');
+    if (last == std::string_view::npos || parents_.count(path.substr(0, last))) return true;
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+        if (recursive_.count(path.substr(0, slash))) return true;
+    }
+    return false;
+}
+
+bool SparseCone::reaches(std::string_view dir) const {
+    if (!dir.empty() && dir.back() == '/') dir.remove_suffix(1);
+    if (dir.empty() || parents_.count(dir)) return true;
+    for (size_t slash = dir.find('/');; slash = dir.find('/', slash + 1)) {
+        if (recursive_.count(dir.substr(0, slash))) return true;
+        if (slash == std::string_view::npos) return false;
+    }
+}
+
+std::optional<SparseCone> load_sparse_cone() {
+    std::optional<std::string> enabled = get_config_value("core.sparseCheckout");
+    if (!enabled || !parse_bool_value_or(*enabled, false)) return std::nullopt;
+    std::optional<std::string> cone_mode = get_config_value("core.sparseCheckoutCone");
+    if (cone_mode && !parse_bool_value_or(*cone_mode, true)) {
+        std::cerr << "Warning: Only cone mode sparse checkout is supported; reading the patterns as a cone" << std::endl;
+    }
+    std::ifstream file(sparse_checkout_path(), std::ios::binary);
+    if (!file) return SparseCone();
+    std::ostringstream content;
+    content << file.rdbuf();
+    try {
+        return SparseCone::parse(content.str());
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: Ignoring " << sparse_checkout_path() << ": " << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+void write_sparse_cone(const SparseCone& cone) {
+    ensure_parent_directory_exists(sparse_checkout_path());
+    write_file(sparse_checkout_path(), cone.format());
+}
+
+bool sparse_index_enabled() {
+    std::optional<std::string> value = get_config_value("index.sparse");
+    return value && parse_bool_value_or(*value, false);
+}
+
+void expand_into_cone(Index& index, const SparseCone* cone) {
+    if (!cone) {
+        index.ensure_full();
+        return;
+    }
+    if (!index.is_sparse()) return;
+    for (size_t i = 0; i < index.size();) {
+        const IndexRecord& rec = index[i];
+        if (rec.is_sparse_directory() && cone->reaches(rec.path())) index.expand_sparse_directory(i); // Look at its entries next
+        else ++i;
+    }
+}
+
+bool apply_sparse_cone(Index& index, const SparseCone* cone) {
+    expand_into_cone(index, cone);
+    bool changed = false;
+    for (size_t i = 0; i < index.size(); ++i) {
+        const IndexRecord& rec = index[i];
+        if (rec.stage != 0) continue;
+        bool skip = cone && !cone->includes(rec.path());
+        if (rec.skip_worktree != skip) {
+            index.set_skip_worktree(i, skip);
+            changed = true;
+        }
+    }
+    return changed;
+}
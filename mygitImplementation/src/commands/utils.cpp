@@ -1,4 +1,6 @@
 #include "headers/utils.h"
+#include "headers/object_id.h"
+#include "headers/hash.h"
 
 #include <iostream>
 #include <fstream>
@@ -10,6 +12,9 @@
 #include <chrono>
 #include <ctime> 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <openssl/sha.h>
 #include <zlib.h>
@@ -17,6 +22,71 @@
 const std::string GIT_DIR = ".mygit";
 const std::string OBJECTS_DIR = GIT_DIR + "/objects";
 const std::string REFS_DIR = GIT_DIR + "/refs";
+const std::string PACK_DIR = OBJECTS_DIR + "/pack";
+
+MappedFile::MappedFile(const std::string& path, size_t min_map_size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to stat file: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    if (size_ > 0 && size_ >= min_map_size) {
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            map_ = map;
+            close(fd);
+            return;
+        }
+        // Fall through to a plain read (e.g. filesystems without mmap support).
+    }
+
+    buffer_.resize(size_);
+    size_t done = 0;
+    while (done < size_) {
+        ssize_t n = read(fd, buffer_.data() + done, size_ - done);
+        if (n <= 0) {
+            close(fd);
+            throw std::runtime_error("Failed to read file: " + path);
+        }
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : map_(other.map_), size_(other.size_), buffer_(std::move(other.buffer_)) {
+    other.map_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        map_ = other.map_;
+        size_ = other.size_;
+        buffer_ = std::move(other.buffer_);
+        other.map_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void MappedFile::release() {
+    if (map_) munmap(map_, size_);
+    map_ = nullptr;
+    size_ = 0;
+    buffer_.clear();
+}
 
 std::string read_file(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
@@ -141,15 +211,15 @@ void set_file_executable(const std::string& filename, bool executable) {
 }
 
 std::string compute_sha1(const std::string& data) {
-    unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1(reinterpret_cast<const unsigned char*>(data.c_str()), data.size(), hash);
-    return sha1_to_hex(hash);
+    return sha1_of(data).hex();
 }
 
 std::string compute_sha1(const std::vector<unsigned char>& data) {
-     unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1(data.data(), data.size(), hash);
-    return sha1_to_hex(hash);
+    return sha1_of(std::string_view(reinterpret_cast<const char*>(data.data()), data.size())).hex();
+}
+
+ObjectId compute_object_id(const std::string& data) {
+    return sha1_of(data);
 }
 
 std::vector<unsigned char> compress_data(const std::string& input) {
@@ -207,36 +277,49 @@ std::string decompress_chunk(const std::vector<unsigned char>& compressed_data,
     return decompressed_string;
 }
 
-std::string sha1_to_hex(const unsigned char* sha1_binary) {
-    std::ostringstream result;
-    result << std::hex << std::setfill('0');
-    for (int i = 0; i < SHA_DIGEST_LENGTH; ++i) {
-        result << std::setw(2) << static_cast<int>(sha1_binary[i]);
+// Inflates a zlib stream whose decompressed size is known up front (pack entries),
+// writing straight into a buffer of that size.
+std::string decompress_exact(const unsigned char* compressed_data, size_t compressed_size, size_t expected_size) {
+    std::string output(expected_size, '\0');
+    z_stream strm = {};
+    strm.avail_in = static_cast<uInt>(compressed_size);
+    strm.next_in = const_cast<Bytef*>(compressed_data);
+    strm.avail_out = static_cast<uInt>(expected_size);
+    strm.next_out = reinterpret_cast<Bytef*>(&output[0]);
+
+    if (inflateInit(&strm) != Z_OK) {
+        throw std::runtime_error("zlib inflateInit failed");
+    }
+
+    // A zero-sized output still needs one call so zlib sees the end of the stream.
+    unsigned char dummy;
+    if (expected_size == 0) {
+        strm.avail_out = 1;
+        strm.next_out = &dummy;
+    }
+    int ret = inflate(&strm, Z_FINISH);
+    size_t produced = expected_size == 0 ? (1 - strm.avail_out) : (expected_size - strm.avail_out);
+    inflateEnd(&strm);
+
+    if (ret != Z_STREAM_END) {
+        throw std::runtime_error("zlib inflate failed with error: " + std::to_string(ret));
+    }
+    if (produced != expected_size) {
+        throw std::runtime_error("Inflated size " + std::to_string(produced) + " does not match expected size " + std::to_string(expected_size));
     }
-    return result.str();
+    return output;
+}
+
+std::string sha1_to_hex(const unsigned char* sha1_binary) {
+    return ObjectId::from_raw(sha1_binary).hex();
 }
 
 std::vector<unsigned char> hex_to_sha1(const std::string& sha1_hex) {
-    std::cout << "DEBUG_HEX_TO_SHA1: Input = " << sha1_hex << std::endl; // ADD DEBUG
-    if (sha1_hex.length() != SHA_DIGEST_LENGTH * 2) {
-        std::cerr << "DEBUG_HEX_TO_SHA1: Invalid length " << sha1_hex.length() << std::endl; // Add cerr debug
-        throw std::invalid_argument("Invalid hex SHA-1 string length: " + sha1_hex + " (Length: " + std::to_string(sha1_hex.length()) + ")");
-    }
-    std::vector<unsigned char> sha1_binary(SHA_DIGEST_LENGTH);
-    for (size_t i = 0; i < SHA_DIGEST_LENGTH; ++i) {
-        try {
-            std::string byte_str = sha1_hex.substr(i * 2, 2);
-            unsigned int byte = std::stoul(byte_str, nullptr, 16);
-            if (byte > 255) { throw std::out_of_range("Hex byte value out of range: " + byte_str); }
-            sha1_binary[i] = static_cast<unsigned char>(byte);
-        } catch (const std::exception& e) { // Catch base std::exception
-             std::cerr << "DEBUG_HEX_TO_SHA1: Error at byte " << i << ": " << e.what() << std::endl; // Add cerr debug
-             // Rethrow with more context maybe?
-             throw std::runtime_error("Error converting hex SHA '" + sha1_hex + "' at byte " + std::to_string(i) + ": " + e.what());
-        }
+    ObjectId id;
+    if (!ObjectId::try_from_hex(sha1_hex, id)) {
+        throw std::invalid_argument("Invalid hex SHA-1 string: " + sha1_hex + " (Length: " + std::to_string(sha1_hex.length()) + ")");
     }
-     std::cout << "DEBUG_HEX_TO_SHA1: Conversion successful." << std::endl; // ADD DEBUG
-    return sha1_binary;
+    return std::vector<unsigned char>(id.bytes.begin(), id.bytes.end());
 }
 
 std::string get_current_timestamp_and_zone() {
@@ -10,11 +10,14 @@ void print_usage() {
     std::cerr << std::endl;
     std::cerr << "Available commands:" << std::endl;
     std::cerr << "  init              Create an empty Git repository or reinitialize an existing one" << std::endl;
-    std::cerr << "  add <file>...     Add file contents to the index" << std::endl;
+    std::cerr << "  add [-f] [-j <n>] <file>..." << std::endl;
+    std::cerr << "                    Add file contents to the index, hashing on <n> threads (default: one per core)" << std::endl;
     std::cerr << "  rm [--cached] <file>..." << std::endl;
     std::cerr << "                    Remove files from the working tree and from the index" << std::endl;
     std::cerr << "  commit -m <msg>   Record changes to the repository" << std::endl;
     std::cerr << "  status            Show the working tree status" << std::endl;
+    std::cerr << "  diff [--name-status | --stat] [--cached [<commit>] | <commit> <commit>]" << std::endl;
+    std::cerr << "                    Show changed paths: working tree vs index, index vs a commit, or two commits" << std::endl;
     std::cerr << "  log [<ref>] [--graph]" << std::endl;
     std::cerr << "  branch            List, create, or delete branches" << std::endl;
     std::cerr << "  branch <name> [<start>] Create a new branch" << std::endl;
@@ -30,10 +33,22 @@ void print_usage() {
     std::cerr << "  rev-parse <ref>   Resolve ref name to SHA-1" << std::endl;
     std::cerr << "  cat-file (-t | -s | -p) <object>" << std::endl;
     std::cerr << "                    Provide content or type and size information for repository objects" << std::endl;
+    std::cerr << "  cat-file (--batch | --batch-check)" << std::endl;
+    std::cerr << "                    Same, for each object named on stdin, in one long-running process" << std::endl;
     std::cerr << "  hash-object [-w] [-t <type>] <file>" << std::endl;
     std::cerr << "                    Compute object ID and optionally create an object from a file" << std::endl;
-    std::cerr << "  ls-tree [-r] <tree-ish>" << std::endl;
+    std::cerr << "  ls-tree [-r] [--abbrev[=<n>]] <tree-ish>" << std::endl;
     std::cerr << "                    List the contents of a tree object" << std::endl;
+    std::cerr << "  pack-objects [--window=<n>] [--depth=<n>]" << std::endl;
+    std::cerr << "                    Write the objects named on stdin into a new (deltified) pack" << std::endl;
+    std::cerr << "  repack [--window=<n>] [--depth=<n>]" << std::endl;
+    std::cerr << "                    Pack all reachable objects into one pack, dropping redundant loose objects" << std::endl;
+    std::cerr << "  gc [--prune=<expiry> | --no-prune] [--aggressive]" << std::endl;
+    std::cerr << "                    Repack, then delete unreachable loose objects older than the expiry" << std::endl;
+    std::cerr << "  fsmonitor (start | run | stop | status)" << std::endl;
+    std::cerr << "                    Watch the working tree so status only checks changed paths (Linux)" << std::endl;
+    std::cerr << "  sparse-checkout (init | list | reapply | disable | set <dir>... | add <dir>...) [--[no-]sparse-index]" << std::endl;
+    std::cerr << "                    Check out only the files below some directories (cone mode)" << std::endl;
 }
 
 std::vector<std::string> collect_args(int start_index, int argc, char* argv[]) {
@@ -152,8 +167,12 @@ int main(int argc, char* argv[]) {
             }
             return handle_merge(argv[2]);
         } else if (command == "cat-file") {
+            if (argc == 3 && (std::string(argv[2]) == "--batch" || std::string(argv[2]) == "--batch-check")) {
+                return handle_cat_file_batch(std::string(argv[2]) == "--batch");
+            }
             if (argc != 4) {
                 std::cerr << "Usage: mygit cat-file (-t | -s | -p) <object>" << std::endl;
+                std::cerr << "   or: mygit cat-file (--batch | --batch-check) < <list-of-objects>" << std::endl;
                 return 1;
             }
             std::string operation = argv[2];
@@ -185,6 +204,18 @@ int main(int argc, char* argv[]) {
             return handle_rev_parse(collect_args(2, argc, argv));
         } else if (command == "ls-tree") {
             return handle_ls_tree(collect_args(2, argc, argv));
+        } else if (command == "pack-objects") {
+            return handle_pack_objects(collect_args(2, argc, argv));
+        } else if (command == "repack") {
+            return handle_repack(collect_args(2, argc, argv));
+        } else if (command == "gc") {
+            return handle_gc(collect_args(2, argc, argv));
+        } else if (command == "fsmonitor") {
+            return handle_fsmonitor(collect_args(2, argc, argv));
+        } else if (command == "diff") {
+            return handle_diff(collect_args(2, argc, argv));
+        } else if (command == "sparse-checkout") {
+            return handle_sparse_checkout(collect_args(2, argc, argv));
         } else {
             std::cerr << "mygit: '" << command << "' is not a mygit command. See 'mygit --help' (or just 'mygit')." << std::endl;
             print_usage();
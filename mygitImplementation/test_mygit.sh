@@ -358,6 +358,15 @@ run_cmd "read-tree: Overwrite index with Tree 1" read-tree $TREE1_SHA; check_sta
 run_cmd "status: After read-tree (index updated)" status; check_status 0; check_output_not_contains "Changes to be committed:"; check_output_contains "Untracked files:"; check_output_contains "file3.txt"
 rm file3.txt
 
+# --- Test: ls-tree --abbrev ---
+echo -e "\n${COLOR_YELLOW}--- Testing: ls-tree --abbrev ---${COLOR_RESET}"
+FILE2_BLOB_SHA=$(${MYGIT_CMD} hash-object file2.txt)
+FILE2_BLOB_SIZE=$(wc -c < file2.txt | tr -d ' ')
+run_cmd "ls-tree: Default abbrev" ls-tree --abbrev HEAD; check_status 0
+check_output_contains "blob ${FILE2_BLOB_SHA:0:7}	file2.txt"
+run_cmd "ls-tree: Abbrev 12" ls-tree --abbrev=12 HEAD; check_status 0
+check_output_contains "blob ${FILE2_BLOB_SHA:0:12}	file2.txt"
+
 
 # --- Test: merge ---
 echo -e "\n${COLOR_YELLOW}--- Testing: merge ---${COLOR_RESET}"
@@ -430,6 +439,149 @@ check_status 1
 check_output_contains "True merge logic is not implemented"
 
 
+# --- Test: gc ---
+echo -e "\n${COLOR_YELLOW}--- Testing: gc ---${COLOR_RESET}"
+mkdir -p gc_sub && echo "Only reachable through gc_sub" > gc_sub/only.txt
+run_cmd "add: Subtree for corrupt gc" add gc_sub; check_status 0
+run_cmd "commit: Subtree for corrupt gc" commit -m "Add gc_sub"; check_status 0
+GC_SUB_TREE_SHA=$(${MYGIT_CMD} ls-tree HEAD | grep "	gc_sub$" | awk '{print $3}')
+GC_SUB_BLOB_SHA=$(${MYGIT_CMD} hash-object gc_sub/only.txt)
+GC_SUB_TREE_PATH=".mygit/objects/${GC_SUB_TREE_SHA:0:2}/${GC_SUB_TREE_SHA:2}"
+GC_SUB_BLOB_PATH=".mygit/objects/${GC_SUB_BLOB_SHA:0:2}/${GC_SUB_BLOB_SHA:2}"
+cp "$GC_SUB_TREE_PATH" gc_sub_tree.bak
+chmod u+w "$GC_SUB_TREE_PATH"; echo "corrupt" > "$GC_SUB_TREE_PATH"
+run_cmd "gc: Unreadable reachable tree" gc --prune=now; check_status 1; check_output_contains "Cannot read reachable object ${GC_SUB_TREE_SHA}"
+check_file_exists "$GC_SUB_TREE_PATH"; check_file_exists "$GC_SUB_BLOB_PATH"
+cp gc_sub_tree.bak "$GC_SUB_TREE_PATH"; rm gc_sub_tree.bak
+echo "Dangling blob content" > dangling.txt
+DANGLING_SHA=$(${MYGIT_CMD} hash-object -w dangling.txt)
+DANGLING_PATH=".mygit/objects/${DANGLING_SHA:0:2}/${DANGLING_SHA:2}"
+check_file_exists ".mygit/objects/${FILE2_BLOB_SHA:0:2}/${FILE2_BLOB_SHA:2}"
+run_cmd "cat-file: Loose blob size" cat-file -s "$FILE2_BLOB_SHA"; check_status 0; check_output_contains "$FILE2_BLOB_SIZE"
+run_cmd "gc: Pack reachable objects" gc; check_status 0; check_output_contains "Packed"
+check_file_not_exists ".mygit/objects/${COMMIT8_SHA:0:2}/${COMMIT8_SHA:2}"
+check_file_exists "$DANGLING_PATH" # Unreachable but inside the grace period
+check_file_not_exists ".mygit/objects/${FILE2_BLOB_SHA:0:2}/${FILE2_BLOB_SHA:2}"
+run_cmd "cat-file: Packed blob size" cat-file -s "$FILE2_BLOB_SHA"; check_status 0; check_output_contains "$FILE2_BLOB_SIZE"
+run_cmd "log: After gc" log; check_status 0; check_output_contains "commit ${COMMIT8_SHA}"; check_output_contains "commit ${COMMIT1_SHA}"
+run_cmd "cat-file: Packed commit" cat-file -t "${COMMIT9_SHA:0:8}"; check_status 0; check_output_contains "commit"
+run_cmd "cat-file: Batch check" cat-file --batch-check <<< "$(printf '%s\n%s\n' "${COMMIT9_SHA:0:8}" "0000000")"
+check_status 0; check_output_contains "${COMMIT9_SHA} commit"; check_output_contains "0000000 missing"
+run_cmd "cat-file: Batch" cat-file --batch <<< "${COMMIT9_SHA}"; check_status 0; check_output_contains "${COMMIT9_SHA} commit"; check_output_contains "tree "
+run_cmd "gc: Prune now" gc --prune=now; check_status 0; check_output_contains "unreachable objects"
+check_file_not_exists "$DANGLING_PATH"
+run_cmd "log: After prune" log feature2; check_status 0; check_output_contains "commit ${COMMIT9_SHA}"
+
+
+
+# --- Test: .gitignore ---
+echo -e "\n${COLOR_YELLOW}--- Testing: .gitignore ---${COLOR_RESET}"
+mkdir -p build_out && echo "artifact" > build_out/app.bin
+echo "debug" > debug.log
+echo "keep" > keep.log
+printf 'build_out/\n*.log\n!keep.log\n' > .gitignore
+run_cmd "status: Ignored files hidden" status; check_status 0
+check_output_contains "keep.log"; check_output_not_contains "debug.log"; check_output_not_contains "build_out/app.bin"
+run_cmd "add: Ignored file refused" add debug.log; check_status 1; check_output_contains "ignored by one of your .gitignore files"
+run_cmd "add: Ignored file forced" add -f debug.log; check_status 0
+run_cmd "status: Forced file tracked" status; check_status 0; check_output_contains "debug.log"
+
+# --- Test: sparse-checkout ---
+echo -e "\n${COLOR_YELLOW}--- Testing: sparse-checkout ---${COLOR_RESET}"
+mkdir -p sparse_in sparse_out/a && echo "in" > sparse_in/a.txt && echo "out" > sparse_out/b.txt
+echo "x" > sparse_out/a/x && echo "a-b" > sparse_out/a-b # "a/" sorts after "a-b" in the index
+run_cmd "add: Sparse test dirs" add sparse_in sparse_out; check_status 0
+run_cmd "commit: Sparse test dirs" commit -m "Add sparse test dirs"; check_status 0
+run_cmd "sparse-checkout: Set cone" sparse-checkout set sparse_in; check_status 0
+check_file_exists "sparse_in/a.txt"; check_file_not_exists "sparse_out/b.txt"
+check_file_contains ".mygit/info/sparse-checkout" "/sparse_in/"
+run_cmd "sparse-checkout: List" sparse-checkout list; check_status 0; check_output_contains "sparse_in"; check_output_not_contains "sparse_out"
+run_cmd "status: Skip-worktree entries ignored" status; check_status 0; check_output_not_contains "deleted:    sparse_out/b.txt"
+run_cmd "sparse-checkout: Sparse index" sparse-checkout set sparse_in --sparse-index; check_status 0
+run_cmd "status: Sparse directory entry clean" status; check_status 0; check_output_not_contains "modified:   sparse_out"
+echo "in again" >> sparse_in/a.txt
+run_cmd "add: In-cone change with sparse index" add sparse_in/a.txt; check_status 0
+run_cmd "commit: Tree keeps the sparse directory" commit -m "Change inside the cone"; check_status 0
+mkdir -p sparse_out && echo "a-c" > sparse_out/a-c
+run_cmd "add: File under a sparse directory" add sparse_out/a-c; check_status 0
+run_cmd "status: Expanded sparse directory" status; check_status 0; check_output_contains "new file:   sparse_out/a-c"
+run_cmd "rm: Cached file under a sparse directory" rm --cached sparse_out/a-b; check_status 0
+run_cmd "status: Index still sorted" status; check_status 0; check_output_contains "deleted:    sparse_out/a-b"
+run_cmd "commit: Changes under a sparse directory" commit -m "Change sparse_out"; check_status 0
+run_cmd "ls-tree: Sparse directory contents" ls-tree -r HEAD; check_status 0; check_output_contains "sparse_out/b.txt"
+check_output_contains "sparse_out/a/x"; check_output_contains "sparse_out/a-c"; check_output_not_contains "sparse_out/a-b"
+run_cmd "sparse-checkout: Disable" sparse-checkout disable; check_status 0
+check_file_contains "sparse_out/b.txt" "out"
+
+# --- Test: diff ---
+echo -e "\n${COLOR_YELLOW}--- Testing: diff ---${COLOR_RESET}"
+run_cmd "diff: Clean after commit" diff --cached; check_status 0; check_output_not_contains "sparse_in"
+echo "changed" > sparse_in/a.txt
+run_cmd "diff: Working tree" diff --name-status; check_status 0; check_output_contains "M	sparse_in/a.txt"
+run_cmd "add: Change for diff" add sparse_in/a.txt; check_status 0
+run_cmd "diff: Staged" diff --cached --stat; check_status 0; check_output_contains "sparse_in/a.txt | 3 +--"
+check_output_contains "1 file changed, 1 insertion(+), 2 deletions(-)"
+run_cmd "tag: Base for diff" tag diff_base; check_status 0
+run_cmd "commit: Change for diff" commit -m "Change for diff"; check_status 0
+run_cmd "diff: Two commits" diff diff_base HEAD; check_status 0; check_output_contains "M	sparse_in/a.txt"
+run_cmd "diff: Same commit" diff HEAD HEAD; check_status 0; check_output_not_contains "sparse_in"
+mkdir -p order/a && echo "x" > order/a/x && echo "a-b" > order/a-b
+run_cmd "add: Directory next to a-b" add order; check_status 0
+run_cmd "commit: Directory next to a-b" commit -m "Add order/a/x and order/a-b"; check_status 0
+run_cmd "tag: Before removing order/a/x" tag order_base; check_status 0
+run_cmd "rm: order/a/x" rm order/a/x; check_status 0
+run_cmd "diff: Staged removal next to a-b" diff --cached; check_status 0
+check_output_contains "D	order/a/x"; check_output_not_contains "order/a-b"
+run_cmd "commit: Remove order/a/x" commit -m "Remove order/a/x"; check_status 0
+run_cmd "diff: Removal next to a-b" diff order_base HEAD; check_status 0
+check_output_contains "D	order/a/x"; check_output_not_contains "order/a-b"
+
+# --- Test: fsmonitor ---
+# The daemon uses inotify, so this only runs on Linux.
+if [ "$(uname)" = "Linux" ]; then
+    echo -e "\n${COLOR_YELLOW}--- Testing: fsmonitor ---${COLOR_RESET}"
+    printf '[core]\n\tfsmonitor = true\n' >> .mygit/config
+    run_cmd "fsmonitor: Start" fsmonitor start; check_status 0; check_output_contains "fsmonitor started"
+    check_file_exists ".mygit/fsmonitor.sock"
+    run_cmd "status: With fsmonitor" status; check_status 0
+    echo "Watched change" >> file1.txt
+    echo "watched" > fsmonitor_new.txt
+    run_cmd "status: Changes seen by fsmonitor" status; check_status 0
+    check_output_contains "modified:   file1.txt"; check_output_contains "fsmonitor_new.txt"
+    run_cmd "fsmonitor: Stop" fsmonitor stop; check_status 0; check_output_contains "fsmonitor stopped"
+    check_file_not_exists ".mygit/fsmonitor.sock"
+    printf '[core]\n\tfsmonitor = false\n' >> .mygit/config
+    run_cmd "add: fsmonitor test files" add file1.txt fsmonitor_new.txt; check_status 0
+    run_cmd "commit: fsmonitor test files" commit -m "fsmonitor test files"; check_status 0
+fi
+
+# --- Test: split index ---
+echo -e "\n${COLOR_YELLOW}--- Testing: split index ---${COLOR_RESET}"
+printf '[core]\n\tsplitIndex = true\n' >> .mygit/config
+echo "split" > split_a.txt
+run_cmd "add: With split index" add split_a.txt; check_status 0
+SHARED_INDEX=$(ls .mygit/sharedindex.* 2>/dev/null | head -n 1)
+check_file_exists "$SHARED_INDEX"
+run_cmd "status: Split index entries" status; check_status 0; check_output_contains "new file:   split_a.txt"
+check_output_not_contains "deleted:    file1.txt"
+run_cmd "diff: Split index staged" diff --cached --name-status; check_status 0; check_output_contains "A	split_a.txt"
+check_output_not_contains "file1.txt"
+run_cmd "commit: From split index" commit -m "Add split_a.txt"; check_status 0
+run_cmd "ls-tree: Split index commit" ls-tree -r HEAD; check_status 0
+check_output_contains "split_a.txt"; check_output_contains "file1.txt"; check_output_contains "sparse_in/a.txt"
+SHARED_INDEX=$(ls .mygit/sharedindex.* 2>/dev/null | head -n 1)
+echo "split again" >> split_a.txt
+run_cmd "add: Small change keeps the base" add split_a.txt; check_status 0
+check_file_exists "$SHARED_INDEX"
+printf '[splitIndex]\n\tmaxPercentChange = 0\n' >> .mygit/config
+echo "split b" > split_b.txt
+run_cmd "add: Change above maxPercentChange" add split_b.txt; check_status 0
+check_file_not_exists "$SHARED_INDEX"
+NEW_SHARED_INDEX=$(ls .mygit/sharedindex.* 2>/dev/null | head -n 1)
+check_file_exists "$NEW_SHARED_INDEX"
+run_cmd "status: After new base" status; check_status 0
+check_output_contains "modified:   split_a.txt"; check_output_contains "new file:   split_b.txt"
+
 # --- Final Summary ---
 echo -e "\n${COLOR_YELLOW}===================================${COLOR_RESET}"
 echo -e "${COLOR_YELLOW}         Test Summary              ${COLOR_RESET}"